@@ -0,0 +1,64 @@
+#include "arena.h"
+#include <cstdint>
+#include <new>
+
+Arena::~Arena() { free_chunks(chunks); }
+
+void Arena::free_chunks(Chunk *chunk) {
+  while (chunk) {
+    Chunk *next = chunk->next;
+    stats_.bytes_reserved -= chunk->size;
+    stats_.chunks--;
+    ::operator delete(chunk);
+    chunk = next;
+  }
+}
+
+void Arena::add_chunk(size_t min_size) {
+  size_t size = next_chunk;
+  while (size < min_size + sizeof(Chunk))
+    size *= 2;
+  if (next_chunk < ARENA_MAX_CHUNK)
+    next_chunk *= 2;
+
+  Chunk *chunk = static_cast<Chunk *>(::operator new(size));
+  chunk->next = chunks;
+  chunk->size = size;
+  chunks = chunk;
+
+  cursor = reinterpret_cast<char *>(chunk + 1);
+  end = reinterpret_cast<char *>(chunk) + size;
+
+  stats_.chunks++;
+  stats_.bytes_reserved += size;
+  if (stats_.bytes_reserved > stats_.peak_reserved)
+    stats_.peak_reserved = stats_.bytes_reserved;
+}
+
+void *Arena::do_allocate(size_t bytes, size_t alignment) {
+  uintptr_t aligned =
+      (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~(alignment - 1);
+  if (!cursor || aligned + bytes > reinterpret_cast<uintptr_t>(end)) {
+    add_chunk(bytes + alignment);
+    aligned = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) &
+              ~(alignment - 1);
+  }
+
+  cursor = reinterpret_cast<char *>(aligned + bytes);
+  stats_.allocations++;
+  stats_.bytes_allocated += bytes;
+  return reinterpret_cast<void *>(aligned);
+}
+
+void Arena::reset() {
+  if (chunks) {
+    free_chunks(chunks->next);
+    chunks->next = nullptr;
+    cursor = reinterpret_cast<char *>(chunks + 1);
+    end = reinterpret_cast<char *>(chunks) + chunks->size;
+  }
+
+  stats_.allocations = 0;
+  stats_.bytes_allocated = 0;
+  stats_.resets++;
+}
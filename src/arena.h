@@ -0,0 +1,56 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <memory_resource>
+
+#define ARENA_CHUNK (64 * 1024)
+#define ARENA_MAX_CHUNK (16 * 1024 * 1024)
+
+struct ArenaStats {
+  size_t allocations = 0;
+  size_t bytes_allocated = 0; // bytes handed out since the last reset
+  size_t bytes_reserved = 0;  // bytes currently held in chunks
+  size_t peak_reserved = 0;
+  size_t chunks = 0;
+  size_t resets = 0;
+};
+
+// Bump allocator for the values created while a VM runs. Deallocation is a
+// no-op; everything is given back at once by reset(), which keeps only the
+// newest (largest) chunk around for the next run.
+class Arena : public std::pmr::memory_resource {
+public:
+  Arena() = default;
+  ~Arena();
+
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  void reset();
+  const ArenaStats &stats() const { return stats_; }
+
+protected:
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *, size_t, size_t) override {}
+  bool do_is_equal(const memory_resource &other) const noexcept override {
+    return this == &other;
+  }
+
+private:
+  struct Chunk {
+    Chunk *next;
+    size_t size;
+  };
+
+  Chunk *chunks = nullptr;
+  char *cursor = nullptr;
+  char *end = nullptr;
+  size_t next_chunk = ARENA_CHUNK;
+  ArenaStats stats_;
+
+  void add_chunk(size_t min_size);
+  void free_chunks(Chunk *chunk);
+};
+
+#endif // ARENA_H
@@ -0,0 +1,479 @@
+#include "bench.h"
+#include "arena.h"
+#include "bytecode.h"
+#include "loader.h"
+#include "map.h"
+#include "simd.h"
+#include "vm.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+
+using std::chrono::steady_clock;
+
+// bench_utils {{{
+template <typename F> double time_ms(int runs, F body) {
+  auto start = steady_clock::now();
+  for (int i = 0; i < runs; i++)
+    body();
+  std::chrono::duration<double, std::milli> elapsed =
+      steady_clock::now() - start;
+  return elapsed.count() / runs;
+}
+
+size_t file_size(const string &path) {
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  return file.tellg();
+}
+
+void print_bench_result(const string &bench_name, const string &bench,
+                        double ms, const string &extra = "") {
+  std::cout << "[\x1b[1;36mBENCH\x1b[0m] \x1b[34m" << std::left
+            << std::setw(18) << bench_name << "\x1b[0m " << std::setw(32)
+            << bench << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << ms << " ms" << extra << std::endl;
+}
+// bench_utils }}}
+
+// compression_bench {{{
+void compression_bench() {
+  // A synthetic program shaped like generated code: long runs of similar
+  // instructions and a pool full of near-identical labels.
+  vector<uint8_t> bytecode;
+  vector<Object> const_pool;
+  for (int i = 0; i < 200000; i++) {
+    const_pool.push_back(Object(STRING, "field_" + std::to_string(i % 5000) +
+                                            "_" + std::to_string(i)));
+    const_pool.push_back(Object(INTEGER, i));
+    const_pool.push_back(Object(FLOAT, i * 0.5));
+  }
+  for (uint32_t i = 0; i < 200000; i++) {
+    uint32_t index = 3 * i + 1;
+    bytecode.insert(bytecode.end(),
+                    {PUSH, static_cast<uint8_t>(index),
+                     static_cast<uint8_t>(index >> 8),
+                     static_cast<uint8_t>(index >> 16), 0});
+    if (i != 0)
+      bytecode.push_back(ADD);
+  }
+  bytecode.push_back(HALT);
+
+  File file = {MAJOR, MINOR, bytecode, const_pool, 0};
+
+  struct Mode {
+    string name;
+    uint32_t flags;
+  };
+  const vector<Mode> modes = {
+      {"uncompressed", 0},
+      {"bytecode", COMPRESS_BYTECODE},
+      {"const pool", COMPRESS_CONST_POOL},
+      {"bytecode + const pool", COMPRESS_BYTECODE | COMPRESS_CONST_POOL},
+  };
+
+  size_t raw_size = 0;
+  for (const auto &mode : modes) {
+    string path = "bench_compression.bin";
+    double write_ms =
+        time_ms(1, [&] { generate_file(file, path, mode.flags); });
+    size_t size = file_size(path);
+    if (mode.flags == 0)
+      raw_size = size;
+
+    double load_ms = time_ms(5, [&] { load_from_file(path); });
+
+    std::ostringstream extra;
+    extra << std::fixed << std::setprecision(2) << "  (write " << write_ms
+          << " ms, " << size << " bytes, ratio "
+          << static_cast<double>(raw_size) / size << ")";
+    print_bench_result("compression_bench", "load " + mode.name, load_ms,
+                       extra.str());
+  }
+  std::remove("bench_compression.bin");
+}
+// compression_bench }}}
+
+// pool_decode_bench {{{
+void pool_decode_bench() {
+  vector<uint8_t> encoded;
+  for (int i = 0; i < 1000000; i++) {
+    if (i % 2 == 0)
+      encode_object(Object(STRING, "entry_" + std::to_string(i)), encoded);
+    else
+      encode_object(Object(LIST, List{Object(INTEGER, i),
+                                                Object(STRING, "value")}),
+                    encoded);
+  }
+
+  unsigned hardware = std::thread::hardware_concurrency();
+  for (unsigned threads : {1u, 2u, 4u, hardware}) {
+    double ms = time_ms(3, [&] {
+      decode_const_pool(encoded.data(), encoded.size(), threads);
+    });
+    print_bench_result("pool_decode_bench",
+                       "1M entries, " + std::to_string(threads) + " threads",
+                       ms);
+  }
+}
+// pool_decode_bench }}}
+
+// arena_bench {{{
+// Every thread builds and drops short strings, either through its own arena
+// or through the global allocator.
+void allocation_bench(unsigned threads, bool use_arena) {
+  auto work = [use_arena] {
+    Arena arena;
+    std::pmr::memory_resource *resource =
+        use_arena ? static_cast<std::pmr::memory_resource *>(&arena)
+                  : std::pmr::new_delete_resource();
+    for (int round = 0; round < 20; round++) {
+      for (int i = 0; i < 20000; i++) {
+        StringData str("label number ", resource);
+        str.append(std::to_string(i));
+        String value(std::move(str));
+      }
+      arena.reset();
+    }
+  };
+
+  double ms = time_ms(1, [&] {
+    vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+      workers.emplace_back(work);
+    for (auto &worker : workers)
+      worker.join();
+  });
+
+  print_bench_result("arena_bench",
+                     string(use_arena ? "arena" : "global new") + ", " +
+                         std::to_string(threads) + " threads",
+                     ms);
+}
+
+// Runs a string heavy program on one VM per thread, resetting between runs.
+void vm_arena_bench(unsigned threads) {
+  vector<uint8_t> bytecode;
+  for (int i = 0; i < 10000; i++)
+    bytecode.insert(bytecode.end(),
+                    {PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, ADD, POP});
+  bytecode.push_back(HALT);
+  // Too long together to be stored inline, so every ADD allocates.
+  const vector<Object> pool = {Object(STRING, "session_key_"),
+                               Object(STRING, "cached_value")};
+
+  vector<ArenaStats> stats(threads);
+  double ms = time_ms(1, [&] {
+    vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; t++)
+      workers.emplace_back([&, t] {
+        VM vm(bytecode, pool);
+        for (int run = 0; run < 20; run++) {
+          vm.reset();
+          vm.run();
+        }
+        stats[t] = vm.arena_stats();
+      });
+    for (auto &worker : workers)
+      worker.join();
+  });
+
+  std::ostringstream extra;
+  extra << "  (per run: " << stats[0].allocations << " allocations, "
+        << stats[0].bytes_allocated << " bytes; reserved "
+        << stats[0].bytes_reserved << ", peak " << stats[0].peak_reserved
+        << ")";
+  print_bench_result("arena_bench",
+                     "vm string ops, " + std::to_string(threads) + " threads",
+                     ms, extra.str());
+}
+
+void arena_bench() {
+  for (unsigned threads : {1u, 4u}) {
+    allocation_bench(threads, false);
+    allocation_bench(threads, true);
+    vm_arena_bench(threads);
+  }
+}
+// arena_bench }}}
+
+// gc_bench {{{
+// Keeps a growing number of strings alive on the stack while producing
+// garbage, and reports how long the collector pauses.
+void gc_bench() {
+  for (int live : {1000, 10000, 100000}) {
+    vector<uint8_t> bytecode;
+    for (int i = 0; i < live; i++)
+      bytecode.insert(bytecode.end(), {PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0,
+                                       ADD, PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0,
+                                       0, ADD, POP});
+    bytecode.push_back(HALT);
+    const vector<Object> pool = {Object(STRING, "a long enough key for "),
+                                 Object(STRING, "the arena")};
+
+    VM vm(bytecode, pool);
+    vm.set_heap_config({0, 64 * 1024});
+    double ms = time_ms(1, [&] { vm.run(); });
+
+    const HeapStats &stats = vm.heap_stats();
+    std::ostringstream extra;
+    extra << std::fixed << std::setprecision(3) << "  (" << stats.collections
+          << " collections, max pause " << stats.max_pause_ms
+          << " ms, total " << stats.total_pause_ms << " ms, heap "
+          << stats.heap_size << " bytes)";
+    print_bench_result("gc_bench", std::to_string(live) + " live strings", ms,
+                       extra.str());
+  }
+}
+// gc_bench }}}
+
+// simd_bench {{{
+// One element-wise ADD and LT over a million element arrays at each SIMD
+// level the CPU supports.
+void simd_bench() {
+  const size_t n = 1000000;
+  IntArray::Data ints(n);
+  FloatArray::Data floats(n);
+  for (size_t i = 0; i < n; i++) {
+    ints[i] = static_cast<int64_t>(i);
+    floats[i] = static_cast<double>(i) * 0.25;
+  }
+  const vector<Object> pool = {Object(INT_ARRAY, IntArray(std::move(ints))),
+                               Object(FLOAT_ARRAY,
+                                      FloatArray(std::move(floats)))};
+
+  SimdLevel best = simd_supported();
+  for (int level = SIMD_SCALAR; level <= best; level++) {
+    set_simd_level(static_cast<SimdLevel>(level));
+    string name = simd_level_name(static_cast<SimdLevel>(level));
+    for (uint8_t op : {ADD, LT}) {
+      VM vm({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, op, POP, PUSH, 1, 0, 0, 0,
+             PUSH, 1, 0, 0, 0, op, HALT},
+            pool);
+      double ms = time_ms(20, [&] {
+        vm.reset();
+        vm.run();
+      });
+      print_bench_result("simd_bench",
+                         inst_to_string(op) + " 1M ints, floats (" + name +
+                             ")",
+                         ms);
+    }
+  }
+  set_simd_level(best);
+}
+// simd_bench }}}
+
+// reduce_bench {{{
+void push_const(vector<uint8_t> &bytecode, uint32_t index) {
+  bytecode.insert(bytecode.end(), {PUSH, static_cast<uint8_t>(index),
+                                   static_cast<uint8_t>(index >> 8),
+                                   static_cast<uint8_t>(index >> 16),
+                                   static_cast<uint8_t>(index >> 24)});
+}
+
+// Reductions and SORT against what a program does without them: one PUSH
+// and ADD (and MUL) per element, or std::sort. There are no jumps, so the
+// interpreted versions are unrolled; MIN, MAX and COUNT_IF need branches
+// and have no interpreted equivalent.
+void reduce_bench() {
+  const uint32_t n = 100000;
+  IntArray::Data ints(n);
+  FloatArray::Data floats(n);
+  vector<Object> scalars;
+  for (uint32_t i = 0; i < n; i++) {
+    ints[i] = i % 100;
+    floats[i] = i * 0.5;
+    scalars.push_back(Object(INTEGER, static_cast<int>(i % 100)));
+  }
+  for (uint32_t i = 0; i < n; i++)
+    scalars.push_back(Object(FLOAT, i * 0.5));
+
+  vector<uint8_t> sum_loop, dot_loop;
+  for (uint32_t i = 0; i < n; i++) {
+    push_const(sum_loop, i);
+    if (i != 0)
+      sum_loop.push_back(ADD);
+    push_const(dot_loop, n + i);
+    push_const(dot_loop, n + i);
+    dot_loop.push_back(MUL);
+    if (i != 0)
+      dot_loop.push_back(ADD);
+  }
+  sum_loop.push_back(HALT);
+  dot_loop.push_back(HALT);
+
+  const vector<Object> arrays = {
+      Object(INT_ARRAY, IntArray(std::move(ints))),
+      Object(FLOAT_ARRAY, FloatArray(std::move(floats)))};
+  auto run = [](VM &vm) {
+    return time_ms(20, [&] {
+      vm.reset();
+      vm.run();
+    });
+  };
+
+  VM sum_vm(sum_loop, scalars);
+  VM sum_op({PUSH, 0, 0, 0, 0, SUM, HALT}, arrays);
+  print_bench_result("reduce_bench", "100k ints, PUSH/ADD loop",
+                     run(sum_vm));
+  print_bench_result("reduce_bench", "100k ints, SUM", run(sum_op));
+
+  VM dot_vm(dot_loop, scalars);
+  VM dot_op({PUSH, 1, 0, 0, 0, PUSH, 1, 0, 0, 0, DOT, HALT}, arrays);
+  print_bench_result("reduce_bench", "100k floats, PUSH/MUL/ADD loop",
+                     run(dot_vm));
+  print_bench_result("reduce_bench", "100k floats, DOT", run(dot_op));
+
+  const size_t big = 4000000;
+  IntArray::Data random(big);
+  uint64_t state = 1;
+  for (auto &value : random) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    value = static_cast<int64_t>(state >> 16);
+  }
+  FloatArray::Data random_floats(random.begin(), random.end());
+
+  vector<int64_t> copy;
+  double ms = time_ms(3, [&] {
+    copy.assign(random.begin(), random.end());
+    std::sort(copy.begin(), copy.end());
+  });
+  print_bench_result("reduce_bench", "4M ints, std::sort", ms);
+  VM sort_ints({PUSH, 0, 0, 0, 0, SORT, HALT},
+               {Object(INT_ARRAY, IntArray(std::move(random)))});
+  print_bench_result("reduce_bench", "4M ints, SORT (radix)",
+                     time_ms(3, [&] {
+                       sort_ints.reset();
+                       sort_ints.run();
+                     }));
+
+  vector<double> float_copy;
+  ms = time_ms(3, [&] {
+    float_copy.assign(random_floats.begin(), random_floats.end());
+    std::sort(float_copy.begin(), float_copy.end());
+  });
+  print_bench_result("reduce_bench", "4M floats, std::sort", ms);
+  VM sort_floats({PUSH, 0, 0, 0, 0, SORT, HALT},
+                 {Object(FLOAT_ARRAY, FloatArray(std::move(random_floats)))});
+  print_bench_result("reduce_bench", "4M floats, SORT (parallel)",
+                     time_ms(3, [&] {
+                       sort_floats.reset();
+                       sort_floats.run();
+                     }));
+}
+// reduce_bench }}}
+
+// map_bench {{{
+// A lookup in a MAP against the linear scan scripts use without one: EQ of
+// the probe against every key of a list of pairs, combined with LOG_OR and
+// unrolled since there are no jumps.
+void map_bench() {
+  const uint32_t n = 10000;
+  MapTable table;
+  vector<Object> keys;
+  for (uint32_t i = 0; i < n; i++) {
+    Object key(STRING, "key number " + std::to_string(i));
+    table.set(key, Object(INTEGER, static_cast<int>(i)));
+    keys.push_back(key);
+  }
+  Object probe = keys.back();
+  keys.push_back(probe);
+
+  vector<uint8_t> scan;
+  for (uint32_t i = 0; i < n; i++) {
+    push_const(scan, i);
+    push_const(scan, n);
+    scan.push_back(EQ);
+    if (i != 0)
+      scan.push_back(LOG_OR);
+  }
+  scan.push_back(HALT);
+
+  auto run = [](VM &vm) {
+    return time_ms(20, [&] {
+      vm.reset();
+      vm.run();
+    });
+  };
+  VM scan_vm(scan, keys);
+  VM get_vm({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, GET, HALT},
+            {Object(MAP, Map(std::move(table))), probe});
+  print_bench_result("map_bench", "10k string keys, EQ/LOG_OR scan",
+                     run(scan_vm));
+  print_bench_result("map_bench", "10k string keys, GET", run(get_vm));
+}
+// map_bench }}}
+
+// typed_bench {{{
+// `i = 0; x = 0.0; while i < n: x = x + 0.5; i = i + 1`, with the generic
+// instructions and with the typed ones the compiler emits for it.
+vector<uint8_t> counting_loop(bool typed) {
+  vector<uint8_t> loop;
+  auto emit = [&](uint8_t inst, uint32_t operand) {
+    size_t at = loop.size();
+    push_const(loop, operand);
+    loop[at] = inst;
+    return at;
+  };
+  auto patch = [&](size_t at, uint32_t target) {
+    for (int i = 0; i < 4; i++)
+      loop[at + 1 + i] = static_cast<uint8_t>(target >> (8 * i));
+  };
+
+  push_const(loop, 0);
+  push_const(loop, 2);
+  uint32_t top = loop.size();
+  emit(LOAD, 0);
+  push_const(loop, 1);
+  loop.push_back(typed ? LT_INT : LT);
+  size_t exit = emit(JMP_IF_FALSE, 0);
+  emit(LOAD, 1);
+  push_const(loop, 3);
+  loop.push_back(typed ? ADD_FLOAT : ADD);
+  emit(STORE, 1);
+  emit(LOAD, 0);
+  push_const(loop, 4);
+  loop.push_back(typed ? ADD_INT : ADD);
+  emit(STORE, 0);
+  emit(JMP, top);
+  patch(exit, loop.size());
+  emit(LOAD, 1);
+  loop.push_back(HALT);
+  return loop;
+}
+
+void typed_bench() {
+  const vector<Object> pool = {Object(INTEGER, 0), Object(INTEGER, 1000000),
+                               Object(FLOAT, 0.0), Object(FLOAT, 0.5),
+                               Object(INTEGER, 1)};
+  VM generic(counting_loop(false), pool);
+  VM typed(counting_loop(true), pool);
+  auto run = [](VM &vm) {
+    return time_ms(5, [&] {
+      vm.reset();
+      vm.run();
+    });
+  };
+  print_bench_result("typed_bench", "1M iterations, generic ops",
+                     run(generic));
+  print_bench_result("typed_bench", "1M iterations, typed ops", run(typed));
+}
+// typed_bench }}}
+
+// benchmarks {{{
+void benchmarks() {
+  compression_bench();
+  pool_decode_bench();
+  arena_bench();
+  gc_bench();
+  simd_bench();
+  reduce_bench();
+  map_bench();
+  typed_bench();
+}
+// benchmarks }}}
@@ -0,0 +1,6 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+void benchmarks();
+
+#endif // BENCH_H
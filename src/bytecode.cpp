@@ -44,7 +44,223 @@ string inst_to_string(uint8_t inst) {
     return "BIT_NOT";
   case XOR:
     return "XOR";
+  case SLICE:
+    return "SLICE";
+  case INDEX:
+    return "INDEX";
+  case LEN:
+    return "LEN";
+  case APPEND:
+    return "APPEND";
+  case SUM:
+    return "SUM";
+  case MIN:
+    return "MIN";
+  case MAX:
+    return "MAX";
+  case DOT:
+    return "DOT";
+  case COUNT_IF:
+    return "COUNT_IF";
+  case SORT:
+    return "SORT";
+  case GET:
+    return "GET";
+  case SET:
+    return "SET";
+  case CONTAINS:
+    return "CONTAINS";
+  case DELETE:
+    return "DELETE";
+  case JMP:
+    return "JMP";
+  case JMP_IF_FALSE:
+    return "JMP_IF_FALSE";
+  case LOAD:
+    return "LOAD";
+  case STORE:
+    return "STORE";
+  case CALL:
+    return "CALL";
+  case RET:
+    return "RET";
+  case ADD_INT:
+    return "ADD_INT";
+  case SUB_INT:
+    return "SUB_INT";
+  case MUL_INT:
+    return "MUL_INT";
+  case EQ_INT:
+    return "EQ_INT";
+  case NEQ_INT:
+    return "NEQ_INT";
+  case LT_INT:
+    return "LT_INT";
+  case GT_INT:
+    return "GT_INT";
+  case LTE_INT:
+    return "LTE_INT";
+  case GTE_INT:
+    return "GTE_INT";
+  case ADD_FLOAT:
+    return "ADD_FLOAT";
+  case SUB_FLOAT:
+    return "SUB_FLOAT";
+  case MUL_FLOAT:
+    return "MUL_FLOAT";
+  case DIV_FLOAT:
+    return "DIV_FLOAT";
+  case EQ_FLOAT:
+    return "EQ_FLOAT";
+  case NEQ_FLOAT:
+    return "NEQ_FLOAT";
+  case LT_FLOAT:
+    return "LT_FLOAT";
+  case GT_FLOAT:
+    return "GT_FLOAT";
+  case LTE_FLOAT:
+    return "LTE_FLOAT";
+  case GTE_FLOAT:
+    return "GTE_FLOAT";
+  case NEG:
+    return "NEG";
   default:
     return "UNKNOWN";
   }
 }
+
+uint32_t inst_length(uint8_t inst) {
+  switch (inst) {
+  case PUSH:
+  case JMP:
+  case JMP_IF_FALSE:
+  case LOAD:
+  case STORE:
+    return 5;
+  case CALL:
+    return 6;
+  default:
+    return 1;
+  }
+}
+
+bool stack_effect(uint8_t inst, StackEffect &effect) {
+  switch (inst) {
+  case ADD:
+  case SUB:
+  case MUL:
+  case DIV:
+  case IDIV:
+  case EQ:
+  case NEQ:
+  case LT:
+  case GT:
+  case LTE:
+  case GTE:
+  case LOG_AND:
+  case LOG_OR:
+  case BIT_AND:
+  case BIT_OR:
+  case XOR:
+  case INDEX:
+  case APPEND:
+  case DOT:
+  case GET:
+  case CONTAINS:
+  case DELETE:
+  case ADD_INT:
+  case SUB_INT:
+  case MUL_INT:
+  case EQ_INT:
+  case NEQ_INT:
+  case LT_INT:
+  case GT_INT:
+  case LTE_INT:
+  case GTE_INT:
+  case ADD_FLOAT:
+  case SUB_FLOAT:
+  case MUL_FLOAT:
+  case DIV_FLOAT:
+  case EQ_FLOAT:
+  case NEQ_FLOAT:
+  case LT_FLOAT:
+  case GT_FLOAT:
+  case LTE_FLOAT:
+  case GTE_FLOAT:
+    effect = {2, 1};
+    return true;
+  case LOG_NOT:
+  case BIT_NOT:
+  case NEG:
+  case LEN:
+  case SUM:
+  case MIN:
+  case MAX:
+  case COUNT_IF:
+  case SORT:
+    effect = {1, 1};
+    return true;
+  case SLICE:
+  case SET:
+    effect = {3, 1};
+    return true;
+  case PUSH:
+  case LOAD:
+    effect = {0, 1};
+    return true;
+  case POP:
+  case JMP_IF_FALSE:
+  case STORE:
+  case RET:
+    effect = {1, 0};
+    return true;
+  // CALL also pops the arguments counted by its second operand.
+  case CALL:
+    effect = {0, 1};
+    return true;
+  case JMP:
+    effect = {0, 0};
+    return true;
+  case HALT:
+    effect = {0, 0};
+    return true;
+  default:
+    return false;
+  }
+}
+
+uint8_t generic_inst(uint8_t inst) {
+  switch (inst) {
+  case ADD_INT:
+  case ADD_FLOAT:
+    return ADD;
+  case SUB_INT:
+  case SUB_FLOAT:
+    return SUB;
+  case MUL_INT:
+  case MUL_FLOAT:
+    return MUL;
+  case EQ_INT:
+  case EQ_FLOAT:
+    return EQ;
+  case NEQ_INT:
+  case NEQ_FLOAT:
+    return NEQ;
+  case LT_INT:
+  case LT_FLOAT:
+    return LT;
+  case GT_INT:
+  case GT_FLOAT:
+    return GT;
+  case LTE_INT:
+  case LTE_FLOAT:
+    return LTE;
+  case GTE_INT:
+  case GTE_FLOAT:
+    return GTE;
+  case DIV_FLOAT:
+    return DIV;
+  default:
+    return inst;
+  }
+}
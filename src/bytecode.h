@@ -30,8 +30,70 @@ enum {
   BIT_OR,
   BIT_NOT,
   XOR,
+
+  SLICE,
+  INDEX,
+  LEN,
+  APPEND,
+
+  SUM,
+  MIN,
+  MAX,
+  DOT,
+  COUNT_IF,
+  SORT,
+
+  GET,
+  SET,
+  CONTAINS,
+  DELETE,
+
+  JMP,
+  JMP_IF_FALSE,
+  LOAD,
+  STORE,
+  CALL,
+  RET,
+
+  // The arithmetic and comparisons for two INTEGER or two FLOAT operands,
+  // emitted where the compiler proved the types. They skip the generic
+  // instruction's dispatch on the operand types and fall back to it when
+  // the operands turn out to be anything else.
+  ADD_INT,
+  SUB_INT,
+  MUL_INT,
+  EQ_INT,
+  NEQ_INT,
+  LT_INT,
+  GT_INT,
+  LTE_INT,
+  GTE_INT,
+
+  ADD_FLOAT,
+  SUB_FLOAT,
+  MUL_FLOAT,
+  DIV_FLOAT,
+  EQ_FLOAT,
+  NEQ_FLOAT,
+  LT_FLOAT,
+  GT_FLOAT,
+  LTE_FLOAT,
+  GTE_FLOAT,
+
+  // -x for a number or an array of them. Ints wrap around, so -INT_MIN is
+  // INT_MIN, and floats keep the sign of zero, so -0.0 is -0.0.
+  NEG,
+};
+
+struct StackEffect {
+  uint8_t pops;
+  uint8_t pushes;
 };
 
 string inst_to_string(uint8_t inst);
+uint32_t inst_length(uint8_t inst);
+bool stack_effect(uint8_t inst, StackEffect &effect);
+// The generic instruction a typed one falls back to, or `inst` itself.
+uint8_t generic_inst(uint8_t inst);
 
 #endif // BYTECODE_H
@@ -0,0 +1,87 @@
+#include "ast.h"
+#include <cstring>
+
+NodeList Ast::make_list(Node *const *items, size_t size) {
+  NodeList list;
+  list.size = size;
+  if (size != 0) {
+    list.items = static_cast<Node **>(
+        arena.allocate(size * sizeof(Node *), alignof(Node *)));
+    std::memcpy(list.items, items, size * sizeof(Node *));
+  }
+  return list;
+}
+
+string_view Ast::make_string(string_view str) {
+  char *data = static_cast<char *>(arena.allocate(str.size() + 1, 1));
+  std::memcpy(data, str.data(), str.size());
+  return string_view(data, str.size());
+}
+
+const char *op_to_string(Op op) {
+  switch (op) {
+  case Op::NONE:
+    return "";
+  case Op::ADD:
+    return "+";
+  case Op::SUB:
+  case Op::NEG:
+    return "-";
+  case Op::MUL:
+    return "*";
+  case Op::DIV:
+    return "/";
+  case Op::MOD:
+    return "%";
+  case Op::EQ:
+    return "==";
+  case Op::NEQ:
+    return "!=";
+  case Op::LT:
+    return "<";
+  case Op::GT:
+    return ">";
+  case Op::LTE:
+    return "<=";
+  case Op::GTE:
+    return ">=";
+  case Op::LOG_AND:
+    return "&&";
+  case Op::LOG_OR:
+    return "||";
+  case Op::LOG_NOT:
+    return "!";
+  case Op::BIT_AND:
+    return "&";
+  case Op::BIT_OR:
+    return "|";
+  case Op::BIT_NOT:
+    return "~";
+  case Op::XOR:
+    return "^";
+  }
+  return "?";
+}
+
+string type_to_string(TypeRef type) {
+  string name;
+  switch (type.name) {
+  case TypeName::INT:
+    name = "Int";
+    break;
+  case TypeName::FLOAT:
+    name = "Float";
+    break;
+  case TypeName::STR:
+    name = "Str";
+    break;
+  case TypeName::BOOL:
+    name = "Bool";
+    break;
+  default:
+    return "unknown";
+  }
+  for (int i = 0; i < type.lists; i++)
+    name += "[]";
+  return name;
+}
@@ -0,0 +1,150 @@
+#ifndef AST_H
+#define AST_H
+
+#include "../arena.h"
+#include <cstdint>
+#include <new>
+#include <string>
+#include <string_view>
+
+using std::string, std::string_view;
+
+enum class NodeKind : uint8_t {
+  INT_LITERAL,
+  FLOAT_LITERAL,
+  STRING_LITERAL,
+  BOOL_LITERAL,
+  LIST_LITERAL,
+  NAME,
+  UNARY,
+  BINARY,
+  CALL,
+  INDEX,
+  SLICE,
+  MEMBER,
+
+  EXPRESSION,
+  ASSIGN,
+  IF,
+  WHILE,
+  BREAK,
+  CONTINUE,
+  RETURN,
+  BLOCK,
+
+  PARAM,
+  FUNCTION,
+  IMPORT,
+  PROGRAM,
+};
+
+enum class Op : uint8_t {
+  NONE,
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  MOD,
+  EQ,
+  NEQ,
+  LT,
+  GT,
+  LTE,
+  GTE,
+  LOG_AND,
+  LOG_OR,
+  LOG_NOT,
+  BIT_AND,
+  BIT_OR,
+  BIT_NOT,
+  XOR,
+  NEG,
+};
+
+// A type annotation, or the inferred type of an expression: one of the type
+// keywords inside `lists` levels of []. NONE is no annotation or a type that
+// could not be inferred. UNSET only appears while types are being inferred,
+// for variables no assignment has been seen for yet.
+enum class TypeName : uint8_t { NONE, INT, FLOAT, STR, BOOL, UNSET };
+
+struct TypeRef {
+  TypeName name = TypeName::NONE;
+  uint8_t lists = 0;
+
+  bool operator==(const TypeRef &other) const {
+    return name == other.name && lists == other.lists;
+  }
+  bool operator!=(const TypeRef &other) const { return !(*this == other); }
+  bool is(TypeName scalar) const { return name == scalar && lists == 0; }
+  // Known and not a list, so the operations it supports are known too.
+  bool is_scalar() const {
+    return lists == 0 && name != TypeName::NONE && name != TypeName::UNSET;
+  }
+};
+
+struct Node;
+
+// The children of a node, in an array that lives in the same arena.
+struct NodeList {
+  Node **items = nullptr;
+  uint32_t size = 0;
+
+  Node **begin() const { return items; }
+  Node **end() const { return items + size; }
+  Node *operator[](size_t i) const { return items[i]; }
+};
+
+// Every kind of node has the same layout, one cache line, and uses the
+// fields it needs:
+//   literals, NAME, IMPORT: text, the decoded value for strings
+//   UNARY: op left; BINARY: left op right
+//   CALL: left(list); INDEX: left[right]; SLICE: left[right:extra]
+//   MEMBER: left.text; LIST_LITERAL, BLOCK, PROGRAM: list
+//   EXPRESSION: left; RETURN: left, null without a value
+//   ASSIGN: text = left
+//   IF: if left then right else extra, a BLOCK, another IF or null
+//   WHILE: while left do right
+//   PARAM: text, type; FUNCTION: text, list of PARAMs, type, body in right
+// and expressions keep the type the Checker inferred for them in type.
+struct Node {
+  NodeKind kind;
+  Op op = Op::NONE;
+  TypeRef type;
+  uint32_t offset; // of the node's first byte in the source, for errors
+  string_view text;
+  Node *left = nullptr;
+  Node *right = nullptr;
+  Node *extra = nullptr;
+  NodeList list;
+
+  Node(NodeKind kind, uint32_t offset) : kind(kind), offset(offset) {}
+};
+
+// A parsed program. Nodes, their child lists and decoded strings are bump
+// allocated in the tree's arena and freed all at once with it, so building
+// the tree costs no more than a pointer increment per node. Names and most
+// literals are views of the source, which must outlive the tree.
+class Ast {
+public:
+  Node *root = nullptr;
+
+  Node *make(NodeKind kind, uint32_t offset) {
+    nodes++;
+    return new (arena.allocate(sizeof(Node), alignof(Node)))
+        Node(kind, offset);
+  }
+  NodeList make_list(Node *const *items, size_t size);
+  string_view make_string(string_view str);
+
+  size_t size() const { return nodes; }
+  const ArenaStats &arena_stats() const { return arena.stats(); }
+
+private:
+  Arena arena;
+  size_t nodes = 0;
+};
+
+const char *op_to_string(Op op);
+string type_to_string(TypeRef type);
+
+#endif // AST_H
@@ -0,0 +1,180 @@
+#include "bench.h"
+#include "lexer.h"
+#include "parser.h"
+#include "scan.h"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+using std::chrono::steady_clock;
+
+// bench_utils {{{
+template <typename F> double time_ms(int runs, F body) {
+  auto start = steady_clock::now();
+  for (int i = 0; i < runs; i++)
+    body();
+  std::chrono::duration<double, std::milli> elapsed =
+      steady_clock::now() - start;
+  return elapsed.count() / runs;
+}
+
+void print_bench_result(const string &bench_name, const string &bench,
+                        double ms, const string &extra = "") {
+  std::cout << "[\x1b[1;36mBENCH\x1b[0m] \x1b[34m" << std::left
+            << std::setw(18) << bench_name << "\x1b[0m " << std::setw(32)
+            << bench << std::right << std::fixed << std::setprecision(3)
+            << std::setw(10) << ms << " ms" << extra << std::endl;
+}
+
+// Source shaped like generated code: mostly identifiers, one keyword in
+// every few words, short lines.
+string identifier_source(size_t words) {
+  const char *keywords[] = {"fn", "if", "else", "return", "while", "Int"};
+  string source;
+  uint64_t state = 1;
+  for (size_t i = 0; i < words; i++) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    if (state >> 62 == 0)
+      source += keywords[(state >> 32) % 6];
+    else
+      source += "name" + to_string((state >> 32) % 5000);
+    source += i % 8 == 7 ? "\n" : " ";
+  }
+  return source;
+}
+
+// A function shaped like hand-written code, repeated: indentation, comments,
+// string literals and arithmetic.
+string typical_source(size_t functions) {
+  string source;
+  for (size_t i = 0; i < functions; i++) {
+    string n = to_string(i);
+    source += "// computes value number " + n + " from its inputs\n"
+              "fn value" + n + "(count: Int, label: Str): Int\n"
+              "  total = (count + " + n + ") * 2.5 - count / 3\n"
+              "  if total >= 100 && label != \"skip\\n\"\n"
+              "    printf(\"%d is the total for %s\\n\", total, label)\n"
+              "  end\n"
+              "  return total\n"
+              "end\n\n";
+  }
+  return source;
+}
+// bench_utils }}}
+
+// keyword_bench {{{
+// What is_keyword did before the perfect hash: build the list, compare
+// against each entry.
+static bool linear_is_keyword(string s) {
+  const vector<string> keywords = {"fn",    "Int",    "Str",   "Bool",
+                                   "Float", "return", "if",    "else",
+                                   "for",   "while",  "break", "continue"};
+  for (string keyword : keywords) {
+    if (keyword == s)
+      return true;
+  }
+  return false;
+}
+
+void keyword_bench() {
+  string source = identifier_source(1000000);
+  Lexer lexer(source);
+  lexer.scan();
+  const TokenList &tokens = lexer.token_list;
+
+  vector<string_view> words;
+  for (size_t i = 0; i < tokens.size(); i++)
+    if (tokens.types[i] == TokenType::KEYWORD ||
+        tokens.types[i] == TokenType::IDENTIFIER)
+      words.push_back(tokens.text(i));
+
+  size_t found = 0;
+  double ms = time_ms(3, [&] {
+    for (string_view word : words)
+      found += linear_is_keyword(string(word));
+  });
+  print_bench_result("keyword_bench", "1M words, linear is_keyword", ms);
+
+  ms = time_ms(3, [&] {
+    for (string_view word : words)
+      found -= keyword_id(word) != NO_KEYWORD;
+  });
+  print_bench_result("keyword_bench", "1M words, keyword_id", ms,
+                     found == 0 ? "" : " (results differ)");
+
+  print_bench_result("keyword_bench", "1M words, Lexer::scan",
+                     time_ms(3, [&] { lexer.scan(); }));
+}
+// keyword_bench }}}
+
+// scan_bench {{{
+// Token objects against the structure-of-arrays scan, on ordinary code.
+void scan_bench() {
+  string source = typical_source(50000);
+  Lexer lexer(source);
+  double mb = source.size() / 1e6;
+  auto throughput = [&](double ms) {
+    return " (" + to_string(static_cast<int>(mb / ms * 1000)) + " MB/s)";
+  };
+
+  double ms = time_ms(3, [&] { lexer.tokenize(); });
+  print_bench_result("scan_bench", to_string(static_cast<int>(mb)) +
+                                       " MB, Lexer::tokenize",
+                     ms, throughput(ms));
+  ms = time_ms(3, [&] { lexer.scan(); });
+  print_bench_result("scan_bench", to_string(static_cast<int>(mb)) +
+                                       " MB, Lexer::scan",
+                     ms, throughput(ms));
+  unsigned threads = std::thread::hardware_concurrency();
+  ms = time_ms(3, [&] { lexer.scan(threads); });
+  print_bench_result("scan_bench", to_string(static_cast<int>(mb)) +
+                                       " MB, scan on " + to_string(threads) +
+                                       " threads",
+                     ms, throughput(ms));
+
+  // What the first row() or col() costs afterwards.
+  vector<uint32_t> starts;
+  ms = time_ms(3, [&] {
+    starts.clear();
+    find_line_starts(source.data(), source.size(), starts);
+  });
+  print_bench_result("scan_bench", to_string(static_cast<int>(mb)) +
+                                       " MB, find_line_starts",
+                     ms, throughput(ms));
+}
+// scan_bench }}}
+
+// parse_bench {{{
+// Parsing the tokens of ordinary code into a fresh arena each run.
+void parse_bench() {
+  string source = typical_source(50000);
+  Lexer lexer(source);
+  lexer.scan();
+  double mb = source.size() / 1e6;
+
+  size_t nodes = 0;
+  size_t bytes = 0;
+  double ms = time_ms(3, [&] {
+    Ast ast;
+    Parser parser(lexer.token_list, ast);
+    parser.parse();
+    nodes = ast.size();
+    bytes = ast.arena_stats().bytes_allocated;
+  });
+  print_bench_result("parse_bench",
+                     to_string(static_cast<int>(mb)) + " MB, Parser::parse",
+                     ms,
+                     " (" + to_string(static_cast<int>(mb / ms * 1000)) +
+                         " MB/s, " + to_string(nodes) + " nodes in " +
+                         to_string(bytes / 1000000) + " MB)");
+}
+// parse_bench }}}
+
+// benchmarks {{{
+void benchmarks() {
+  keyword_bench();
+  scan_bench();
+  parse_bench();
+}
+// benchmarks }}}
@@ -0,0 +1,6 @@
+#ifndef COMPILER_BENCH_H
+#define COMPILER_BENCH_H
+
+void benchmarks();
+
+#endif // COMPILER_BENCH_H
@@ -0,0 +1,174 @@
+#include "cache.h"
+#include "../vm.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::to_string;
+
+// Temporary files left by a compiler that died before renaming them are
+// deleted by evict() once they are this old, in seconds.
+#define STALE_TEMPORARY (60 * 60)
+
+static const char *const kinds[] = {"programs", "units"};
+
+// Creates `path` and any of its parents that are missing.
+static bool make_dirs(const string &path) {
+  for (size_t slash = path.find('/', 1);; slash = path.find('/', slash + 1)) {
+    string prefix = path.substr(0, slash);
+    if (mkdir(prefix.c_str(), 0755) != 0 && errno != EEXIST)
+      return false;
+    if (slash == string::npos)
+      return true;
+  }
+}
+
+// A name no other process or thread writing to the same directory picks.
+static string temporary_path(const string &path) {
+  static std::atomic<unsigned> counter = 0;
+  return path + ".tmp." + to_string(getpid()) + "." + to_string(counter++);
+}
+
+bool read_file(const string &path, vector<uint8_t> &data) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat info;
+  bool ok = fstat(fd, &info) == 0;
+  if (ok) {
+    data.resize(info.st_size);
+    size_t done = 0;
+    while (ok && done < data.size()) {
+      ssize_t got = read(fd, data.data() + done, data.size() - done);
+      ok = got > 0;
+      done += ok ? got : 0;
+    }
+  }
+  close(fd);
+  return ok;
+}
+
+bool write_file_atomically(const string &path, const vector<uint8_t> &data) {
+  string temporary = temporary_path(path);
+  int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                0644);
+  if (fd < 0)
+    return false;
+  size_t done = 0;
+  bool ok = true;
+  while (ok && done < data.size()) {
+    ssize_t wrote = write(fd, data.data() + done, data.size() - done);
+    ok = wrote > 0;
+    done += ok ? wrote : 0;
+  }
+  ok = close(fd) == 0 && ok;
+  if (ok && rename(temporary.c_str(), path.c_str()) == 0)
+    return true;
+  unlink(temporary.c_str());
+  return false;
+}
+
+string default_cache_dir() {
+  if (const char *dir = std::getenv("CLARITY_CACHE_DIR"); dir && *dir)
+    return dir;
+  if (const char *dir = std::getenv("XDG_CACHE_HOME"); dir && *dir)
+    return string(dir) + "/clarity";
+  if (const char *home = std::getenv("HOME"); home && *home)
+    return string(home) + "/.cache/clarity";
+  return "";
+}
+
+void hash_compiler(Sha256 &hash) {
+  hash.field("clarity " + to_string(MAJOR) + "." + to_string(MINOR) +
+             " cache " + to_string(CACHE_FORMAT));
+  struct stat info;
+  if (stat("/proc/self/exe", &info) == 0) {
+    uint64_t identity[] = {static_cast<uint64_t>(info.st_size),
+                           static_cast<uint64_t>(info.st_mtim.tv_sec),
+                           static_cast<uint64_t>(info.st_mtim.tv_nsec)};
+    hash.update(identity, sizeof(identity));
+  }
+}
+
+string CompileCache::path(const char *kind, const Digest &key) const {
+  return dir + "/" + kind + "/" + key.hex();
+}
+
+bool CompileCache::load(const char *kind, const Digest &key,
+                        vector<uint8_t> &data) const {
+  string entry = path(kind, key);
+  if (!read_file(entry, data))
+    return false;
+  // The mtime is when the entry was last used, for evict().
+  utimensat(AT_FDCWD, entry.c_str(), nullptr, 0);
+  return true;
+}
+
+void CompileCache::store(const char *kind, const Digest &key,
+                         const vector<uint8_t> &data) {
+  if (!make_dirs(dir + "/" + kind))
+    return;
+  stored |= write_file_atomically(path(kind, key), data);
+}
+
+void CompileCache::evict() {
+  if (!stored)
+    return;
+
+  struct Entry {
+    string path;
+    uint64_t size;
+    timespec used;
+  };
+  vector<Entry> entries;
+  uint64_t total = 0;
+  time_t now = time(nullptr);
+  for (const char *kind : kinds) {
+    string subdir = dir + "/" + kind;
+    DIR *listing = opendir(subdir.c_str());
+    if (listing == nullptr)
+      continue;
+    while (dirent *file = readdir(listing)) {
+      if (file->d_name[0] == '.')
+        continue;
+      Entry entry{subdir + "/" + file->d_name, 0, {}};
+      struct stat info;
+      // Another process may have evicted it since it was listed.
+      if (stat(entry.path.c_str(), &info) != 0)
+        continue;
+      if (entry.path.find(".tmp.") != string::npos) {
+        if (now - info.st_mtime > STALE_TEMPORARY)
+          unlink(entry.path.c_str());
+        continue;
+      }
+      entry.size = info.st_size;
+      entry.used = info.st_mtim;
+      total += entry.size;
+      entries.push_back(std::move(entry));
+    }
+    closedir(listing);
+  }
+  if (total <= max_bytes)
+    return;
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry &a, const Entry &b) {
+              if (a.used.tv_sec != b.used.tv_sec)
+                return a.used.tv_sec < b.used.tv_sec;
+              return a.used.tv_nsec < b.used.tv_nsec;
+            });
+  uint64_t target = max_bytes / 10 * 9;
+  for (const Entry &entry : entries) {
+    if (total <= target)
+      break;
+    // Whichever process unlinks it first frees the space.
+    if (unlink(entry.path.c_str()) == 0 || errno == ENOENT)
+      total -= entry.size;
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "sha256.h"
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+// Default bound on the bytes a cache directory holds.
+#define CACHE_SIZE (256ull * 1024 * 1024)
+// Bumped whenever what goes into a cache key, or the layout of an entry,
+// changes, so old entries stop matching.
+#define CACHE_FORMAT 1
+
+// An on-disk store of compiler outputs, named by the digest of all their
+// inputs, so an entry never goes stale and only needs evicting for space.
+// Entries are written to a temporary file and renamed into place, which is
+// atomic, so compilers running at the same time never see half an entry
+// and at worst both write the same one. Reading an entry bumps its mtime;
+// once the directory outgrows its bound, the entries used longest ago are
+// deleted first.
+class CompileCache {
+public:
+  // `dir` is created on first store.
+  CompileCache(string dir, uint64_t max_bytes = CACHE_SIZE)
+      : dir(std::move(dir)), max_bytes(max_bytes) {}
+
+  // `kind` is a subdirectory keeping unrelated entries apart.
+  bool load(const char *kind, const Digest &key, vector<uint8_t> &data) const;
+  void store(const char *kind, const Digest &key,
+             const vector<uint8_t> &data);
+  // Deletes entries, least recently used first, until at most 90% of the
+  // bound is left. Does nothing unless something was stored.
+  void evict();
+
+private:
+  string dir;
+  uint64_t max_bytes;
+  bool stored = false;
+
+  string path(const char *kind, const Digest &key) const;
+};
+
+// The cache directory to use when none is given: $CLARITY_CACHE_DIR, else
+// clarity under $XDG_CACHE_HOME or ~/.cache. Empty when none is set.
+string default_cache_dir();
+
+// A key to start every digest with: the cache format and the identity of
+// the running compiler binary, its size and modification time, so a
+// rebuilt compiler never reuses what an older one produced.
+void hash_compiler(Sha256 &hash);
+
+// Writes `data` to `path` through a temporary file in the same directory,
+// so readers see the old contents or the new ones, never a mix.
+bool write_file_atomically(const string &path, const vector<uint8_t> &data);
+bool read_file(const string &path, vector<uint8_t> &data);
+
+#endif // CACHE_H
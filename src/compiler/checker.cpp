@@ -0,0 +1,330 @@
+#include "checker.h"
+
+static constexpr TypeRef UNKNOWN = {TypeName::NONE, 0};
+static constexpr TypeRef UNSET = {TypeName::UNSET, 0};
+static constexpr TypeRef INT = {TypeName::INT, 0};
+static constexpr TypeRef FLOAT = {TypeName::FLOAT, 0};
+static constexpr TypeRef STR = {TypeName::STR, 0};
+static constexpr TypeRef BOOL = {TypeName::BOOL, 0};
+
+static bool is_known(TypeRef type) {
+  return type.name != TypeName::NONE && type.name != TypeName::UNSET;
+}
+
+static bool is_number(TypeRef type) {
+  return type.is(TypeName::INT) || type.is(TypeName::FLOAT);
+}
+
+// The type of a variable holding values of types `a` and `b`: either one
+// when the other is unset, else what they have in common.
+static TypeRef join(TypeRef a, TypeRef b) {
+  if (a == UNSET)
+    return b;
+  if (b == UNSET || a == b)
+    return a;
+  if (a.lists != b.lists)
+    return UNKNOWN;
+  // The elements of an empty list literal are unset.
+  if (a.name == TypeName::UNSET)
+    return b;
+  if (b.name == TypeName::UNSET)
+    return a;
+  return {TypeName::NONE, a.lists};
+}
+
+void Checker::error(const Node *node, const string &message) {
+  if (final)
+    errors.push_back(to_string(tokens.row_at(node->offset)) + ":" +
+                     to_string(tokens.col_at(node->offset)) + " " + message);
+}
+
+void Checker::check(Node *program) {
+  declare(program);
+  for (Node *node : program->list)
+    if (node->kind == NodeKind::FUNCTION)
+      check_function(node);
+}
+
+void Checker::declare(const Node *program) {
+  for (const Node *node : program->list)
+    if (node->kind == NodeKind::FUNCTION)
+      functions.try_emplace(node->text, node);
+}
+
+void Checker::check_function(Node *node) {
+  function = node;
+  params.clear();
+  for (const Node *param : node->list)
+    params[param->text] = param->type;
+  locals = params;
+
+  // A walk only ever widens a variable's type, from UNSET to a type to
+  // NONE, so the walks stop changing anything after a few rounds.
+  final = false;
+  while (true) {
+    auto before = locals;
+    statement(node->right);
+    if (locals == before)
+      break;
+  }
+  final = true;
+  statement(node->right);
+}
+
+void Checker::statement(Node *node) {
+  switch (node->kind) {
+  case NodeKind::EXPRESSION:
+    expression(node->left);
+    break;
+  case NodeKind::ASSIGN: {
+    TypeRef value = expression(node->left);
+    auto param = params.find(node->text);
+    if (param == params.end()) {
+      auto [local, inserted] = locals.try_emplace(node->text, value);
+      if (!inserted)
+        local->second = join(local->second, value);
+    } else if (is_known(value) && is_known(param->second) &&
+               value != param->second) {
+      error(node, "'" + string(node->text) + "' is declared " +
+                      type_to_string(param->second) + ", but is assigned " +
+                      type_to_string(value));
+    }
+    break;
+  }
+  case NodeKind::BLOCK:
+    for (Node *child : node->list)
+      statement(child);
+    break;
+  case NodeKind::IF:
+    condition(node->left);
+    statement(node->right);
+    if (node->extra != nullptr)
+      statement(node->extra);
+    break;
+  case NodeKind::WHILE:
+    condition(node->left);
+    statement(node->right);
+    break;
+  case NodeKind::RETURN: {
+    if (node->left == nullptr)
+      break;
+    TypeRef value = expression(node->left);
+    if (is_known(value) && is_known(function->type) &&
+        value != function->type)
+      error(node, "'" + string(function->text) + "' returns " +
+                      type_to_string(value) + ", but is declared to return " +
+                      type_to_string(function->type));
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+// JMP_IF_FALSE only takes booleans.
+void Checker::condition(Node *node) {
+  TypeRef type = expression(node);
+  if (type.is_scalar() && !type.is(TypeName::BOOL))
+    error(node, "condition is " + type_to_string(type) + ", not Bool");
+}
+
+TypeRef Checker::expression(Node *node) {
+  TypeRef type = UNKNOWN;
+  switch (node->kind) {
+  case NodeKind::INT_LITERAL:
+    type = INT;
+    break;
+  case NodeKind::FLOAT_LITERAL:
+    type = FLOAT;
+    break;
+  case NodeKind::STRING_LITERAL:
+    type = STR;
+    break;
+  case NodeKind::BOOL_LITERAL:
+    type = BOOL;
+    break;
+  case NodeKind::LIST_LITERAL: {
+    TypeRef element = UNSET;
+    for (Node *child : node->list)
+      element = join(element, expression(child));
+    type = {element.name, static_cast<uint8_t>(element.lists + 1)};
+    break;
+  }
+  case NodeKind::NAME: {
+    auto local = locals.find(node->text);
+    type = local == locals.end() ? UNSET : local->second;
+    break;
+  }
+  case NodeKind::UNARY:
+    type = unary(node);
+    break;
+  case NodeKind::BINARY:
+    type = binary(node);
+    break;
+  case NodeKind::CALL:
+    type = call(node);
+    break;
+  case NodeKind::INDEX:
+  case NodeKind::SLICE: {
+    TypeRef seq = expression(node->left);
+    for (Node *index : {node->right, node->extra}) {
+      if (index == nullptr)
+        continue;
+      TypeRef index_type = expression(index);
+      if (index_type.is_scalar() && !index_type.is(TypeName::INT))
+        error(index, "index is " + type_to_string(index_type) + ", not Int");
+    }
+    if (seq.is(TypeName::STR))
+      type = STR;
+    else if (seq.lists > 0 && node->kind == NodeKind::SLICE)
+      type = seq;
+    else if (seq.lists > 0)
+      type = {seq.name, static_cast<uint8_t>(seq.lists - 1)};
+    else if (seq.is_scalar())
+      error(node, "cannot index " + type_to_string(seq));
+    else
+      type = seq == UNSET ? UNSET : UNKNOWN;
+    break;
+  }
+  case NodeKind::MEMBER:
+    expression(node->left);
+    break;
+  default:
+    break;
+  }
+
+  if (final && type.name == TypeName::UNSET)
+    type.name = TypeName::NONE;
+  node->type = type;
+  return type;
+}
+
+TypeRef Checker::unary(Node *node) {
+  TypeRef operand = expression(node->left);
+  if (operand == UNSET)
+    return UNSET;
+
+  bool valid;
+  TypeRef type;
+  switch (node->op) {
+  case Op::NEG:
+    valid = is_number(operand);
+    type = valid ? operand : UNKNOWN;
+    break;
+  case Op::LOG_NOT:
+    valid = operand.is(TypeName::BOOL);
+    type = BOOL;
+    break;
+  default:
+    valid = operand.is(TypeName::INT);
+    type = INT;
+    break;
+  }
+  if (!valid && operand.is_scalar())
+    error(node, string("cannot apply '") + op_to_string(node->op) + "' to " +
+                    type_to_string(operand));
+  return type;
+}
+
+TypeRef Checker::binary(Node *node) {
+  TypeRef a = expression(node->left);
+  TypeRef b = expression(node->right);
+  if (a == UNSET || b == UNSET)
+    return UNSET;
+
+  // Operands that are both known scalars and not one of the combinations
+  // below would fail at run time.
+  auto mismatch = [&]() {
+    if (a.is_scalar() && b.is_scalar())
+      error(node, string("cannot apply '") + op_to_string(node->op) +
+                      "' to " + type_to_string(a) + " and " +
+                      type_to_string(b));
+    return UNKNOWN;
+  };
+  bool numbers = is_number(a) && is_number(b);
+
+  switch (node->op) {
+  case Op::ADD:
+  case Op::SUB:
+  case Op::MUL:
+    if (numbers)
+      return a.is(TypeName::INT) && b.is(TypeName::INT) ? INT : FLOAT;
+    if (node->op == Op::ADD && a.is(TypeName::STR) && b.is(TypeName::STR))
+      return STR;
+    if (node->op == Op::MUL && a.is(TypeName::STR) && b.is(TypeName::INT))
+      return STR;
+    return mismatch();
+  case Op::DIV:
+    return numbers ? FLOAT : mismatch();
+  case Op::LT:
+  case Op::GT:
+  case Op::LTE:
+  case Op::GTE:
+    return numbers ? BOOL : mismatch();
+  // Values of different types are never equal, but still comparable.
+  case Op::EQ:
+  case Op::NEQ:
+    return a.is_scalar() && b.is_scalar() ? BOOL : UNKNOWN;
+  case Op::LOG_AND:
+  case Op::LOG_OR:
+    if ((a.is_scalar() && !a.is(TypeName::BOOL)) ||
+        (b.is_scalar() && !b.is(TypeName::BOOL)))
+      return mismatch();
+    return BOOL;
+  case Op::BIT_AND:
+  case Op::BIT_OR:
+  case Op::XOR:
+    if ((a.is_scalar() && !a.is(TypeName::INT)) ||
+        (b.is_scalar() && !b.is(TypeName::INT)))
+      return mismatch();
+    return INT;
+  default:
+    return UNKNOWN;
+  }
+}
+
+TypeRef Checker::call(Node *node) {
+  const Node *callee = node->left;
+  TypeRef args[3];
+  for (size_t i = 0; i < node->list.size; i++) {
+    TypeRef type = expression(node->list[i]);
+    if (i < 3)
+      args[i] = type;
+  }
+  if (callee->kind != NodeKind::NAME || locals.count(callee->text))
+    return UNKNOWN;
+
+  auto found = functions.find(callee->text);
+  if (found != functions.end()) {
+    const Node *declaration = found->second;
+    for (size_t i = 0; i < node->list.size && i < declaration->list.size;
+         i++) {
+      TypeRef arg = node->list[i]->type;
+      const Node *param = declaration->list[i];
+      if (is_known(arg) && is_known(param->type) && arg != param->type)
+        error(node->list[i], "argument " + to_string(i + 1) + " of '" +
+                                 string(callee->text) + "' is " +
+                                 type_to_string(arg) + ", but '" +
+                                 string(param->text) + "' is declared " +
+                                 type_to_string(param->type));
+    }
+    return declaration->type;
+  }
+
+  // What the builtins give for the types of their arguments.
+  string_view name = callee->text;
+  if (name == "len" || name == "count_if")
+    return INT;
+  if (name == "contains")
+    return BOOL;
+  if ((name == "sum" || name == "min" || name == "max") &&
+      args[0].lists == 1 &&
+      (args[0].name == TypeName::INT || args[0].name == TypeName::FLOAT))
+    return {args[0].name, 0};
+  if (name == "sort" && args[0].lists > 0)
+    return args[0];
+  if (name == "append" && args[0].lists > 0)
+    return join(args[0], {args[1].name,
+                          static_cast<uint8_t>(args[1].lists + 1)});
+  return UNKNOWN;
+}
@@ -0,0 +1,48 @@
+#ifndef CHECKER_H
+#define CHECKER_H
+
+#include "ast.h"
+#include "tokens.h"
+#include <unordered_map>
+
+// Infers the type of every expression and stores it in the node, for the
+// code generator to pick typed instructions with, and reports the type
+// errors it can prove: operations on types that never support them,
+// conditions that are not Bool and calls or returns that contradict a
+// declaration. Parameters and results have their declared types. Any other
+// variable has the type of every value assigned to it, or none when they
+// differ; as assignments can depend on each other through loops, a
+// function is walked until the variables' types stop changing.
+class Checker {
+public:
+  vector<string> errors;
+
+  explicit Checker(const TokenList &tokens) : tokens(tokens) {}
+
+  void check(Node *program);
+  // check() in parts, for callers that only check some functions: declare
+  // the program's functions, then check the ones wanted.
+  void declare(const Node *program);
+  void check_function(Node *node);
+
+private:
+  const TokenList &tokens;
+  std::unordered_map<string_view, const Node *> functions;
+  const Node *function = nullptr;
+  std::unordered_map<string_view, TypeRef> locals;
+  // Parameters keep their declared types whatever is assigned to them.
+  std::unordered_map<string_view, TypeRef> params;
+  // Errors are only reported on the last walk, once the types are final.
+  bool final = false;
+
+  void error(const Node *node, const string &message);
+
+  void statement(Node *node);
+  void condition(Node *node);
+  TypeRef expression(Node *node);
+  TypeRef unary(Node *node);
+  TypeRef binary(Node *node);
+  TypeRef call(Node *node);
+};
+
+#endif // CHECKER_H
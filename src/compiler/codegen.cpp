@@ -0,0 +1,661 @@
+#include "codegen.h"
+#include "../bytecode.h"
+#include "../stream.h"
+#include "../verifier.h"
+#include "optimizer.h"
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+
+struct Builtin {
+  string_view name;
+  uint8_t inst;
+  uint8_t argc;
+};
+
+// Functions that are a single instruction.
+static constexpr Builtin builtins[] = {
+    {"len", LEN, 1},           {"append", APPEND, 2}, {"sum", SUM, 1},
+    {"min", MIN, 1},           {"max", MAX, 1},       {"dot", DOT, 2},
+    {"count_if", COUNT_IF, 1}, {"sort", SORT, 1},     {"get", GET, 2},
+    {"set", SET, 3},           {"contains", CONTAINS, 2},
+    {"delete", DELETE, 2},
+};
+
+static uint8_t binary_inst(Op op) {
+  switch (op) {
+  case Op::ADD:
+    return ADD;
+  case Op::SUB:
+    return SUB;
+  case Op::MUL:
+    return MUL;
+  case Op::DIV:
+    return DIV;
+  case Op::EQ:
+    return EQ;
+  case Op::NEQ:
+    return NEQ;
+  case Op::LT:
+    return LT;
+  case Op::GT:
+    return GT;
+  case Op::LTE:
+    return LTE;
+  case Op::GTE:
+    return GTE;
+  case Op::LOG_AND:
+    return LOG_AND;
+  case Op::LOG_OR:
+    return LOG_OR;
+  case Op::BIT_AND:
+    return BIT_AND;
+  case Op::BIT_OR:
+    return BIT_OR;
+  case Op::XOR:
+    return XOR;
+  default:
+    return HALT;
+  }
+}
+
+// The typed form of a generic instruction for operands the Checker proved
+// to be both Int or both Float, or the generic one.
+static uint8_t typed_inst(uint8_t inst, TypeRef a, TypeRef b) {
+  if (a.is(TypeName::INT) && b.is(TypeName::INT)) {
+    switch (inst) {
+    case ADD:
+      return ADD_INT;
+    case SUB:
+      return SUB_INT;
+    case MUL:
+      return MUL_INT;
+    case EQ:
+      return EQ_INT;
+    case NEQ:
+      return NEQ_INT;
+    case LT:
+      return LT_INT;
+    case GT:
+      return GT_INT;
+    case LTE:
+      return LTE_INT;
+    case GTE:
+      return GTE_INT;
+    }
+  } else if (a.is(TypeName::FLOAT) && b.is(TypeName::FLOAT)) {
+    switch (inst) {
+    case ADD:
+      return ADD_FLOAT;
+    case SUB:
+      return SUB_FLOAT;
+    case MUL:
+      return MUL_FLOAT;
+    case DIV:
+      return DIV_FLOAT;
+    case EQ:
+      return EQ_FLOAT;
+    case NEQ:
+      return NEQ_FLOAT;
+    case LT:
+      return LT_FLOAT;
+    case GT:
+      return GT_FLOAT;
+    case LTE:
+      return LTE_FLOAT;
+    case GTE:
+      return GTE_FLOAT;
+    }
+  }
+  return inst;
+}
+
+void CodeGenerator::fail(const Node *node, string message) const {
+  throw CodegenError{node->offset, std::move(message)};
+}
+
+void CodeGenerator::report(const CodegenError &error) {
+  errors.push_back(to_string(tokens.row_at(error.offset)) + ":" +
+                   to_string(tokens.col_at(error.offset)) + " " +
+                   error.message);
+}
+
+static uint32_t read_u32(const uint8_t *at) {
+  return static_cast<uint32_t>(at[0]) | static_cast<uint32_t>(at[1]) << 8 |
+         static_cast<uint32_t>(at[2]) << 16 |
+         static_cast<uint32_t>(at[3]) << 24;
+}
+
+static void write_u32(uint8_t *at, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    at[i] = value >> (8 * i);
+}
+
+static void append_u32(vector<uint8_t> &out, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    out.push_back(value >> (8 * i));
+}
+
+static uint32_t take_u32(MemorySource &source) {
+  uint8_t bytes[4];
+  source.read(bytes, 4);
+  return read_u32(bytes);
+}
+
+void Unit::encode(vector<uint8_t> &out) const {
+  append_u32(out, bytecode.size());
+  out.insert(out.end(), bytecode.begin(), bytecode.end());
+  append_u32(out, constants.size());
+  for (const Object &constant : constants)
+    encode_object(constant, out);
+  append_u32(out, callees.size());
+  for (const string &callee : callees) {
+    append_u32(out, callee.size());
+    out.insert(out.end(), callee.begin(), callee.end());
+  }
+}
+
+bool Unit::decode(const uint8_t *data, size_t size) {
+  try {
+    MemorySource source(data, size);
+    bytecode.resize(take_u32(source));
+    source.read(bytecode.data(), bytecode.size());
+    constants.resize(take_u32(source));
+    for (Object &constant : constants)
+      constant = decode_object(source);
+    callees.resize(take_u32(source));
+    for (string &callee : callees) {
+      callee.resize(take_u32(source));
+      source.read(reinterpret_cast<uint8_t *>(callee.data()), callee.size());
+    }
+    if (!source.done())
+      return false;
+  } catch (const std::exception &) {
+    return false;
+  }
+
+  // Operands are checked here so that link() can trust them; everything
+  // else is left to the verifier.
+  for (size_t pc = 0; pc < bytecode.size(); pc += inst_length(bytecode[pc])) {
+    if (pc + inst_length(bytecode[pc]) > bytecode.size())
+      return false;
+    uint8_t inst = bytecode[pc];
+    uint32_t operand = inst_length(inst) > 1 ? read_u32(&bytecode[pc + 1]) : 0;
+    if ((inst == PUSH && operand >= constants.size()) ||
+        (inst == CALL && operand >= callees.size()) ||
+        ((inst == JMP || inst == JMP_IF_FALSE) && operand > bytecode.size()))
+      return false;
+  }
+  return true;
+}
+
+uint32_t CodeGenerator::emit(uint8_t inst) {
+  unit->bytecode.push_back(inst);
+  return unit->bytecode.size() - 1;
+}
+
+uint32_t CodeGenerator::emit(uint8_t inst, uint32_t operand) {
+  uint32_t at = emit(inst);
+  append_u32(unit->bytecode, operand);
+  return at;
+}
+
+void CodeGenerator::patch(uint32_t at, uint32_t target) {
+  write_u32(&unit->bytecode[at + 1], target);
+}
+
+// Equal literals share one entry of a unit's constants. `key` tells apart
+// values that print the same, like true and "true".
+uint32_t CodeGenerator::constant(const Object &value, const string &key) {
+  auto [it, inserted] = constants.try_emplace(key, unit->constants.size());
+  if (inserted)
+    unit->constants.push_back(value);
+  return it->second;
+}
+
+void CodeGenerator::push_constant(const Object &value, const string &key) {
+  emit(PUSH, constant(value, key));
+}
+
+// Numbers are looked up by their bits rather than a string key, as sources
+// of generated data are mostly literals.
+void CodeGenerator::push_int(int value) {
+  auto [it, inserted] =
+      int_constants.try_emplace(value, unit->constants.size());
+  if (inserted)
+    unit->constants.push_back(Object(Type::INTEGER, value));
+  emit(PUSH, it->second);
+}
+
+void CodeGenerator::push_float(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  auto [it, inserted] =
+      float_constants.try_emplace(bits, unit->constants.size());
+  if (inserted)
+    unit->constants.push_back(Object(Type::FLOAT, value));
+  emit(PUSH, it->second);
+}
+
+void CodeGenerator::emit_call(string_view name, size_t argc) {
+  auto [it, inserted] =
+      callee_index.try_emplace(name, unit->callees.size());
+  emit(CALL, it->second);
+  unit->bytecode.push_back(argc);
+  if (inserted)
+    unit->callees.emplace_back(name);
+}
+
+void CodeGenerator::generate(const Node *program) {
+  if (!declare(program))
+    return;
+  vector<Unit> units(defined.size());
+  for (size_t i = 0; i < defined.size(); i++)
+    function(defined[i], units[i]);
+  if (errors.empty())
+    link(units);
+}
+
+bool CodeGenerator::declare(const Node *program) {
+  for (const Node *node : program->list) {
+    if (node->kind == NodeKind::IMPORT) {
+      report({node->offset, "imports are not supported yet"});
+    } else if (functions.try_emplace(node->text, FunctionInfo{node})
+                   .second) {
+      defined.push_back(node);
+    } else {
+      report({node->offset,
+              "function '" + string(node->text) + "' is already defined"});
+    }
+  }
+
+  if (!functions.count("main")) {
+    report({0, "no main function"});
+    return false;
+  }
+  return true;
+}
+
+bool CodeGenerator::function(const Node *node, Unit &out) {
+  size_t reported = errors.size();
+  unit = &out;
+  constants.clear();
+  int_constants.clear();
+  float_constants.clear();
+  callee_index.clear();
+  try {
+    body(node);
+  } catch (const CodegenError &error) {
+    report(error);
+  }
+  unit = nullptr;
+  if (errors.size() != reported)
+    return false;
+
+  if (optimizer != nullptr && optimizer->level > 0) {
+    Function ir = lift(out, node->list.size, locals.size());
+    optimizer->optimize(ir);
+    lower(ir, out);
+  }
+  return true;
+}
+
+// Lays out the entry stub and then the units, one after the other, and
+// rewrites their operands to match: constants are merged into one pool,
+// jumps moved by where their unit starts and calls pointed at the callee.
+void CodeGenerator::link(const vector<Unit> &units) {
+  const Node *main = functions.at("main").node;
+  Unit entry;
+  unit = &entry;
+  constants.clear();
+  int_constants.clear();
+  float_constants.clear();
+  callee_index.clear();
+  for (size_t i = 0; i < main->list.size; i++)
+    push_constant(Object(), "null");
+  emit_call("main", main->list.size);
+  emit(HALT);
+  unit = nullptr;
+
+  uint32_t address = entry.bytecode.size();
+  for (size_t i = 0; i < units.size(); i++) {
+    functions.at(defined[i]->text).address = address;
+    address += units[i].bytecode.size();
+  }
+
+  // Units compiled apart repeat their constants, so equal ones, down to
+  // their encoding, share one pool entry.
+  std::unordered_map<string, uint32_t> pooled;
+  size_t total = entry.constants.size();
+  for (const Unit &part : units)
+    total += part.constants.size();
+  pooled.reserve(total);
+  vector<uint8_t> encoded;
+  bytecode.clear();
+  const_pool.clear();
+  for (size_t i = 0; i <= units.size(); i++) {
+    const Unit &part = i == 0 ? entry : units[i - 1];
+    uint32_t base = bytecode.size();
+    vector<uint32_t> remap;
+    for (const Object &value : part.constants) {
+      encoded.clear();
+      encode_object(value, encoded);
+      auto [it, inserted] = pooled.try_emplace(
+          string(encoded.begin(), encoded.end()), const_pool.size());
+      if (inserted)
+        const_pool.push_back(value);
+      remap.push_back(it->second);
+    }
+
+    bytecode.insert(bytecode.end(), part.bytecode.begin(),
+                    part.bytecode.end());
+    for (size_t pc = base; pc < bytecode.size();
+         pc += inst_length(bytecode[pc])) {
+      uint8_t *operand = bytecode.data() + pc + 1;
+      switch (bytecode[pc]) {
+      case PUSH:
+        write_u32(operand, remap[read_u32(operand)]);
+        break;
+      case JMP:
+      case JMP_IF_FALSE:
+        write_u32(operand, base + read_u32(operand));
+        break;
+      case CALL: {
+        auto callee = functions.find(part.callees[read_u32(operand)]);
+        if (callee == functions.end()) {
+          errors.push_back("internal error: call to unknown function '" +
+                           part.callees[read_u32(operand)] + "'");
+          return;
+        }
+        write_u32(operand, callee->second.address);
+        break;
+      }
+      }
+    }
+  }
+
+  Verification result = verify(bytecode, const_pool);
+  if (!result.valid)
+    errors.push_back("internal error: generated bytecode is invalid: " +
+                     result.error);
+}
+
+void CodeGenerator::body(const Node *node) {
+  if (node->list.size > UINT8_MAX)
+    fail(node, "functions take at most 255 parameters");
+
+  locals.clear();
+  for (const Node *param : node->list) {
+    if (!locals.try_emplace(param->text, locals.size()).second)
+      fail(param, "parameter '" + string(param->text) + "' is repeated");
+  }
+  declare_locals(node->right);
+  for (size_t i = node->list.size; i < locals.size(); i++)
+    push_constant(Object(), "null");
+
+  // Errors in one statement do not stop the others from being checked.
+  for (const Node *child : node->right->list) {
+    try {
+      statement(child);
+    } catch (const CodegenError &error) {
+      report(error);
+      loops.clear();
+    }
+  }
+
+  const NodeList &body = node->right->list;
+  if (body.size == 0 || body[body.size - 1]->kind != NodeKind::RETURN) {
+    push_constant(Object(), "null");
+    emit(RET);
+  }
+}
+
+// Every name assigned anywhere in a function is one of its locals.
+void CodeGenerator::declare_locals(const Node *node) {
+  if (node == nullptr)
+    return;
+  switch (node->kind) {
+  case NodeKind::ASSIGN:
+    locals.try_emplace(node->text, locals.size());
+    return;
+  case NodeKind::BLOCK:
+    for (const Node *child : node->list)
+      declare_locals(child);
+    return;
+  case NodeKind::IF:
+    declare_locals(node->right);
+    declare_locals(node->extra);
+    return;
+  case NodeKind::WHILE:
+    declare_locals(node->right);
+    return;
+  default:
+    return;
+  }
+}
+
+void CodeGenerator::statement(const Node *node) {
+  switch (node->kind) {
+  case NodeKind::EXPRESSION:
+    expression(node->left);
+    emit(POP);
+    break;
+  case NodeKind::ASSIGN:
+    expression(node->left);
+    emit(STORE, locals.at(node->text));
+    break;
+  case NodeKind::BLOCK:
+    for (const Node *child : node->list)
+      statement(child);
+    break;
+  case NodeKind::IF: {
+    expression(node->left);
+    uint32_t skip_then = emit(JMP_IF_FALSE, 0);
+    statement(node->right);
+    if (node->extra == nullptr) {
+      patch(skip_then, unit->bytecode.size());
+      break;
+    }
+    uint32_t skip_else = emit(JMP, 0);
+    patch(skip_then, unit->bytecode.size());
+    statement(node->extra);
+    patch(skip_else, unit->bytecode.size());
+    break;
+  }
+  case NodeKind::WHILE: {
+    loops.push_back({static_cast<uint32_t>(unit->bytecode.size()), {}});
+    expression(node->left);
+    uint32_t exit = emit(JMP_IF_FALSE, 0);
+    statement(node->right);
+    emit(JMP, loops.back().start);
+    patch(exit, unit->bytecode.size());
+    for (uint32_t at : loops.back().breaks)
+      patch(at, unit->bytecode.size());
+    loops.pop_back();
+    break;
+  }
+  case NodeKind::BREAK:
+    if (loops.empty())
+      fail(node, "'break' outside of a loop");
+    loops.back().breaks.push_back(emit(JMP, 0));
+    break;
+  case NodeKind::CONTINUE:
+    if (loops.empty())
+      fail(node, "'continue' outside of a loop");
+    emit(JMP, loops.back().start);
+    break;
+  case NodeKind::RETURN:
+    if (node->left != nullptr)
+      expression(node->left);
+    else
+      push_constant(Object(), "null");
+    emit(RET);
+    break;
+  default:
+    fail(node, "expected a statement");
+  }
+}
+
+// Converts the digits of a literal with from_chars, which unlike stoi and
+// stod needs no locale or copy, except to drop the underscores that may
+// separate the digits. Fails unless all of `text` is one number.
+template <typename T, typename... Base>
+static bool parse_number(string_view text, T &value, Base... base) {
+  string digits;
+  if (text.find('_') != string_view::npos) {
+    digits.reserve(text.size());
+    for (char c : text)
+      if (c != '_')
+        digits.push_back(c);
+    text = digits;
+  }
+  const char *end = text.data() + text.size();
+  auto [stop, error] = std::from_chars(text.data(), end, value, base...);
+  return error == std::errc() && stop == end;
+}
+
+void CodeGenerator::literal(const Node *node, bool negate) {
+  string_view text = node->text;
+  auto out_of_range = [&]() {
+    fail(node, "number '" + string(negate ? "-" : "") + string(text) +
+                   "' is out of range");
+  };
+
+  if (node->kind == NodeKind::FLOAT_LITERAL) {
+    double value;
+    if (!parse_number(text, value))
+      out_of_range();
+    value = negate ? -value : value;
+    push_float(value);
+    return;
+  }
+
+  int base = 10;
+  if (text.size() > 2 && text[0] == '0' && (text[1] | 0x20) == 'x')
+    base = 16;
+  else if (text.size() > 2 && text[0] == '0' && (text[1] | 0x20) == 'b')
+    base = 2;
+  uint64_t magnitude;
+  if (!parse_number(base == 10 ? text : text.substr(2), magnitude, base))
+    out_of_range();
+  // Ints are 32 bits. A decimal literal is a value, down to INT_MIN when
+  // negated; hex and binary ones spell out the bits, so 0xffffffff is -1.
+  uint64_t limit = base != 10 ? UINT32_MAX : negate ? 1ull << 31 : INT32_MAX;
+  if (magnitude > limit)
+    out_of_range();
+  uint32_t bits = negate ? 0u - static_cast<uint32_t>(magnitude)
+                         : static_cast<uint32_t>(magnitude);
+  int value = static_cast<int>(bits);
+  push_int(value);
+}
+
+void CodeGenerator::expression(const Node *node) {
+  switch (node->kind) {
+  case NodeKind::INT_LITERAL:
+  case NodeKind::FLOAT_LITERAL:
+    literal(node, false);
+    break;
+  case NodeKind::STRING_LITERAL:
+    push_constant(Object(Type::STRING, String(node->text)),
+                  "s" + string(node->text));
+    break;
+  case NodeKind::BOOL_LITERAL:
+    push_constant(Object(Type::BOOLEAN, node->text == "true"),
+                  string(node->text));
+    break;
+  case NodeKind::LIST_LITERAL:
+    // The empty list in the pool is shared, so the first APPEND copies it
+    // into the arena and the rest grow that copy in place.
+    push_constant(Object(Type::LIST, List()), "[]");
+    for (const Node *element : node->list) {
+      expression(element);
+      emit(APPEND);
+    }
+    break;
+  case NodeKind::NAME: {
+    auto local = locals.find(node->text);
+    if (local == locals.end())
+      fail(node, "unknown name '" + string(node->text) + "'");
+    emit(LOAD, local->second);
+    break;
+  }
+  case NodeKind::UNARY:
+    if (node->op == Op::NEG && (node->left->kind == NodeKind::INT_LITERAL ||
+                                node->left->kind == NodeKind::FLOAT_LITERAL)) {
+      literal(node->left, true);
+    } else {
+      expression(node->left);
+      emit(node->op == Op::NEG       ? NEG
+           : node->op == Op::LOG_NOT ? LOG_NOT
+                                     : BIT_NOT);
+    }
+    break;
+  case NodeKind::BINARY:
+    if (node->op == Op::MOD)
+      fail(node, "'%' is not supported yet");
+    expression(node->left);
+    expression(node->right);
+    emit(typed_inst(binary_inst(node->op), node->left->type,
+                    node->right->type));
+    break;
+  case NodeKind::CALL:
+    call(node);
+    break;
+  case NodeKind::INDEX:
+    expression(node->left);
+    expression(node->right);
+    emit(INDEX);
+    break;
+  case NodeKind::SLICE:
+    expression(node->left);
+    expression(node->right);
+    expression(node->extra);
+    emit(SLICE);
+    break;
+  case NodeKind::MEMBER:
+    fail(node, "member access is not supported yet");
+  default:
+    fail(node, "expected an expression");
+  }
+}
+
+void CodeGenerator::call(const Node *node) {
+  const Node *callee = node->left;
+  if (callee->kind == NodeKind::MEMBER)
+    fail(callee, "member access is not supported yet");
+  if (callee->kind != NodeKind::NAME)
+    fail(callee, "only functions can be called");
+  if (locals.count(callee->text))
+    fail(callee, "'" + string(callee->text) + "' is not a function");
+
+  auto arity_error = [&](size_t expected) {
+    fail(node, "'" + string(callee->text) + "' expects " +
+                   to_string(expected) +
+                   (expected == 1 ? " argument, got " : " arguments, got ") +
+                   to_string(node->list.size));
+  };
+
+  auto function = functions.find(callee->text);
+  if (function != functions.end()) {
+    if (node->list.size != function->second.node->list.size)
+      arity_error(function->second.node->list.size);
+    for (const Node *argument : node->list)
+      expression(argument);
+    emit_call(callee->text, node->list.size);
+    return;
+  }
+
+  for (const Builtin &builtin : builtins) {
+    if (builtin.name != callee->text)
+      continue;
+    if (node->list.size != builtin.argc)
+      arity_error(builtin.argc);
+    for (const Node *argument : node->list)
+      expression(argument);
+    emit(builtin.inst);
+    return;
+  }
+
+  fail(callee, "unknown function '" + string(callee->text) + "'");
+}
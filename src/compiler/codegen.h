@@ -0,0 +1,106 @@
+#ifndef CODEGEN_H
+#define CODEGEN_H
+
+#include "../object.h"
+#include "ast.h"
+#include "tokens.h"
+#include <unordered_map>
+
+class Optimizer;
+
+// The code of one function, compiled on its own so it can be cached and
+// linked into programs it was not compiled with. PUSH operands index
+// `constants`, CALL operands index `callees` and jump targets are offsets
+// from the start of `bytecode`.
+struct Unit {
+  vector<uint8_t> bytecode;
+  vector<Object> constants;
+  vector<string> callees;
+
+  void encode(vector<uint8_t> &out) const;
+  // False if `data` is not an encoded unit.
+  bool decode(const uint8_t *data, size_t size);
+};
+
+// Turns a parsed program into bytecode for the VM. Every function becomes a
+// block of code entered by CALL: its parameters are the first local slots,
+// its other variables the slots after them, pushed as null on entry, and
+// everything is left to RET to drop. The program starts with a stub that
+// calls `main` with a null for each of its parameters and halts with main's
+// result on the stack.
+//
+// generate() does it all at once. Otherwise, declare() the program, compile
+// each of its definitions() into a Unit with function() and link() them, in
+// the order of definitions(); units may come from an earlier compile of a
+// program declaring the same functions.
+class CodeGenerator {
+public:
+  vector<string> errors;
+  vector<uint8_t> bytecode;
+  vector<Object> const_pool;
+
+  // Errors are reported at the row and column `tokens` gives their node.
+  // Functions are run through `optimizer` as they are compiled, if given.
+  explicit CodeGenerator(const TokenList &tokens,
+                         Optimizer *optimizer = nullptr)
+      : tokens(tokens), optimizer(optimizer) {}
+
+  void generate(const Node *program);
+
+  // False if the program has nothing to link, e.g. no main.
+  bool declare(const Node *program);
+  // The functions to compile, one per name, in the order of the source.
+  const vector<const Node *> &definitions() const { return defined; }
+  // False if the function has errors, which are added to `errors`.
+  bool function(const Node *node, Unit &unit);
+  void link(const vector<Unit> &units);
+
+private:
+  struct FunctionInfo {
+    const Node *node;
+    uint32_t address = 0;
+  };
+  struct Loop {
+    uint32_t start;
+    vector<uint32_t> breaks;
+  };
+  struct CodegenError {
+    uint32_t offset;
+    string message;
+  };
+
+  const TokenList &tokens;
+  Optimizer *optimizer;
+  std::unordered_map<string_view, FunctionInfo> functions;
+  vector<const Node *> defined;
+  // The unit being compiled.
+  Unit *unit = nullptr;
+  std::unordered_map<string, uint32_t> constants;
+  std::unordered_map<int, uint32_t> int_constants;
+  std::unordered_map<uint64_t, uint32_t> float_constants;
+  // Where each function called is in the unit's callees.
+  std::unordered_map<string_view, uint32_t> callee_index;
+  std::unordered_map<string_view, uint32_t> locals;
+  vector<Loop> loops;
+
+  [[noreturn]] void fail(const Node *node, string message) const;
+  void report(const CodegenError &error);
+
+  uint32_t emit(uint8_t inst);
+  uint32_t emit(uint8_t inst, uint32_t operand);
+  void patch(uint32_t at, uint32_t target);
+  uint32_t constant(const Object &value, const string &key);
+  void push_constant(const Object &value, const string &key);
+  void push_int(int value);
+  void push_float(double value);
+  void emit_call(string_view name, size_t argc);
+
+  void body(const Node *node);
+  void declare_locals(const Node *node);
+  void statement(const Node *node);
+  void expression(const Node *node);
+  void literal(const Node *node, bool negate);
+  void call(const Node *node);
+};
+
+#endif // CODEGEN_H
@@ -0,0 +1,247 @@
+#include "driver.h"
+#include "../loader.h"
+#include "../vm.h"
+#include "checker.h"
+#include "codegen.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parser.h"
+#include <iostream>
+#include <unistd.h>
+
+using std::cout, std::endl, std::cerr;
+
+static void print_tokens(const TokenList &tokens) {
+  for (size_t i = 0; i < tokens.size(); i++) {
+    cout << tokens.row(i) << ":" << tokens.col(i) << " "
+         << type_to_string(tokens.types[i]) << " ";
+    switch (tokens.types[i]) {
+    case TokenType::KEYWORD:
+    case TokenType::IDENTIFIER:
+    case TokenType::INTEGER:
+    case TokenType::FLOAT:
+      cout << tokens.text(i);
+      break;
+    case TokenType::STRING:
+      cout << tokens.literal(i);
+      break;
+    default:
+      break;
+    }
+    cout << "\n";
+  }
+  cout << endl;
+}
+
+static bool print_errors(const vector<string> &errors) {
+  if (errors.empty())
+    return false;
+  for (const string &error : errors)
+    cerr << error << "\n";
+  cerr << endl;
+  return true;
+}
+
+// `path` with its extension, if it has one, replaced by .bin.
+static string output_path(const string &path) {
+  size_t dot = path.find_last_of('.');
+  size_t slash = path.find_last_of('/');
+  if (dot == string::npos || (slash != string::npos && dot < slash))
+    return path + ".bin";
+  return path.substr(0, dot) + ".bin";
+}
+
+// Writes the program to `path` through a temporary file, so a reader never
+// sees half of it, and hands back its bytes for the cache.
+static bool write_program(const CodeGenerator &generator, const string &path,
+                          vector<uint8_t> &data) {
+  string temporary = path + ".tmp." + to_string(getpid());
+  File out{MAJOR, MINOR, generator.bytecode, generator.const_pool, 0};
+  generate_file(out, temporary);
+  if (read_file(temporary, data) &&
+      rename(temporary.c_str(), path.c_str()) == 0)
+    return true;
+  unlink(temporary.c_str());
+  return false;
+}
+
+// A function's unit depends on its own source and on the declarations of
+// the functions it may call, so it is keyed by both: every signature in
+// the program and the text from the function up to the next definition.
+static Digest unit_key(const Sha256 &signatures, const TokenList &tokens,
+                       const Node *program, size_t index) {
+  const Node *node = program->list[index];
+  uint32_t end = index + 1 < program->list.size
+                     ? program->list[index + 1]->offset
+                     : tokens.source.size();
+  Sha256 hash = signatures;
+  hash.field(tokens.source.substr(node->offset, end - node->offset));
+  return hash.finish();
+}
+
+
+int compile_cached(CompileCache &cache, const MappedFile &file,
+                          const Options &options, const string &path,
+                          TimeReport *report) {
+  Sha256 hash;
+  hash_compiler(hash);
+  // Code optimized differently is cached apart.
+  hash.field("-O" + to_string(options.level));
+  Sha256 signatures = hash;
+  hash.field("program");
+  hash.field(file.contents());
+  Digest program_key = hash.finish();
+
+  vector<uint8_t> data;
+  bool hit;
+  {
+    PhaseTimer timer(report, "cache lookup");
+    hit = cache.load("programs", program_key, data);
+  }
+  if (hit) {
+    if (write_file_atomically(path, data))
+      return 0;
+    cerr << "Could not write " << path << endl;
+    return 1;
+  }
+
+  Lexer lexer(file.contents());
+  {
+    PhaseTimer timer(report, "lexing");
+    lexer.scan(options.threads);
+  }
+  if (print_errors(lexer.errors))
+    return 1;
+  const TokenList &tokens = lexer.token_list;
+
+  Ast ast;
+  Parser parser(tokens, ast);
+  {
+    PhaseTimer timer(report, "parsing");
+    parser.parse();
+  }
+  if (print_errors(parser.errors))
+    return 1;
+
+  Checker checker(tokens);
+  checker.declare(ast.root);
+  Optimizer optimizer(options.level, report);
+  CodeGenerator generator(tokens, &optimizer);
+  if (!generator.declare(ast.root)) {
+    print_errors(generator.errors);
+    return 1;
+  }
+
+  signatures.field("unit");
+  for (const Node *node : ast.root->list) {
+    signatures.field(node->text);
+    for (const Node *param : node->list)
+      signatures.field(type_to_string(param->type));
+    signatures.field(type_to_string(node->type));
+  }
+
+  const vector<const Node *> &definitions = generator.definitions();
+  vector<Unit> units(definitions.size());
+  vector<Digest> keys(definitions.size());
+  vector<bool> cached(definitions.size());
+  for (size_t i = 0, item = 0; i < definitions.size(); i++) {
+    while (ast.root->list[item] != definitions[i])
+      item++;
+    keys[i] = unit_key(signatures, tokens, ast.root, item);
+    cached[i] = cache.load("units", keys[i], data) &&
+                units[i].decode(data.data(), data.size());
+    if (!cached[i]) {
+      PhaseTimer timer(report, "type checking");
+      checker.check_function(ast.root->list[item]);
+    }
+  }
+  if (print_errors(checker.errors))
+    return 1;
+
+  {
+    PhaseTimer timer(report, "code generation");
+    for (size_t i = 0; i < definitions.size(); i++) {
+      if (cached[i] || !generator.function(definitions[i], units[i]))
+        continue;
+      data.clear();
+      units[i].encode(data);
+      cache.store("units", keys[i], data);
+    }
+    if (print_errors(generator.errors))
+      return 1;
+    generator.link(units);
+  }
+  if (print_errors(generator.errors))
+    return 1;
+
+  PhaseTimer timer(report, "writing");
+  if (!write_program(generator, path, data)) {
+    cerr << "Could not write " << path << endl;
+    return 1;
+  }
+  cache.store("programs", program_key, data);
+  cache.evict();
+  return 0;
+}
+
+int compile(const MappedFile &file, const Options &options,
+                   TimeReport *report) {
+  string path = options.output.empty() ? output_path(options.input)
+                                       : options.output;
+  if (!options.tokens_only && !options.run && !options.cache_dir.empty()) {
+    CompileCache cache(options.cache_dir, options.cache_size);
+    return compile_cached(cache, file, options, path, report);
+  }
+
+  Lexer lexer(file.contents());
+  {
+    PhaseTimer timer(report, "lexing");
+    lexer.scan(options.threads);
+  }
+  if (print_errors(lexer.errors))
+    return 1;
+
+  if (options.tokens_only) {
+    print_tokens(lexer.token_list);
+    return 0;
+  }
+
+  Ast ast;
+  Parser parser(lexer.token_list, ast);
+  {
+    PhaseTimer timer(report, "parsing");
+    parser.parse();
+  }
+  if (print_errors(parser.errors))
+    return 1;
+
+  Checker checker(lexer.token_list);
+  {
+    PhaseTimer timer(report, "type checking");
+    checker.check(ast.root);
+  }
+  if (print_errors(checker.errors))
+    return 1;
+
+  Optimizer optimizer(options.level, report);
+  CodeGenerator generator(lexer.token_list, &optimizer);
+  {
+    PhaseTimer timer(report, "code generation");
+    generator.generate(ast.root);
+  }
+  if (print_errors(generator.errors))
+    return 1;
+
+  if (options.run) {
+    VM vm(generator.bytecode, generator.const_pool);
+    vm.run();
+    vm.pop().print();
+    cout << endl;
+    return 0;
+  }
+
+  PhaseTimer timer(report, "writing");
+  File out{MAJOR, MINOR, generator.bytecode, generator.const_pool, 0};
+  generate_file(out, path);
+  return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "cache.h"
+#include "mapped_file.h"
+#include "time_report.h"
+#include <algorithm>
+#include <thread>
+
+// What the command line asks for.
+struct Options {
+  // Large sources are lexed on every core unless -j says otherwise. The
+  // core count is 0 where it cannot be found out, which means one thread.
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  int level = 1;
+  bool time_report = false;
+  bool tokens_only = false;
+  bool run = false;
+  string cache_dir = default_cache_dir();
+  uint64_t cache_size = CACHE_SIZE;
+  string input;
+  string output;
+};
+
+// Compiles `file` as `options` ask: prints its tokens, runs it, or writes
+// the program to -o or next to the input, through the cache unless there
+// is none. Returns the exit status, with errors printed to stderr.
+int compile(const MappedFile &file, const Options &options,
+            TimeReport *report);
+
+// Compiles to `path`, reusing what the cache holds: the whole program if
+// the source is unchanged, else the units of the functions that are.
+int compile_cached(CompileCache &cache, const MappedFile &file,
+                   const Options &options, const string &path,
+                   TimeReport *report);
+
+#endif // DRIVER_H
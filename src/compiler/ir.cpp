@@ -0,0 +1,185 @@
+#include "ir.h"
+#include <algorithm>
+
+static uint32_t read_u32(const uint8_t *at) {
+  return static_cast<uint32_t>(at[0]) | static_cast<uint32_t>(at[1]) << 8 |
+         static_cast<uint32_t>(at[2]) << 16 |
+         static_cast<uint32_t>(at[3]) << 24;
+}
+
+static void append_u32(vector<uint8_t> &out, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    out.push_back(value >> (8 * i));
+}
+
+uint32_t Function::constant(const Object &value) {
+  vector<uint8_t> encoded;
+  encode_object(value, encoded);
+  auto [it, inserted] = constant_index.try_emplace(
+      string(encoded.begin(), encoded.end()), constants.size());
+  if (inserted)
+    constants.push_back(value);
+  return it->second;
+}
+
+bool is_jump(uint16_t op) { return op == JMP || op == JMP_IF_FALSE; }
+
+bool ends_flow(uint16_t op) { return op == JMP || op == RET || op == HALT; }
+
+StackEffect inst_effect(const Inst &inst) {
+  StackEffect effect = {0, 0};
+  if (inst.op != LABEL)
+    stack_effect(inst.op, effect);
+  if (inst.op == CALL)
+    effect.pops = inst.argc;
+  return effect;
+}
+
+Function lift(const Unit &unit, uint32_t params, uint32_t locals) {
+  Function function;
+  function.callees = unit.callees;
+  function.params = params;
+  function.locals = locals;
+  for (const Object &value : unit.constants)
+    function.constant(value);
+
+  const vector<uint8_t> &bytecode = unit.bytecode;
+  std::unordered_map<uint32_t, uint32_t> labels;
+  for (size_t pc = 0; pc < bytecode.size(); pc += inst_length(bytecode[pc]))
+    if (is_jump(bytecode[pc]))
+      labels.try_emplace(read_u32(&bytecode[pc + 1]), labels.size());
+  function.labels = labels.size();
+
+  // The prologue is a PUSH of null for every local after the parameters.
+  size_t prologue = function.locals - params;
+  size_t pc = 0;
+  for (size_t i = 0; i < prologue; i++)
+    pc += inst_length(bytecode[pc]);
+
+  for (; pc <= bytecode.size(); pc += inst_length(bytecode[pc])) {
+    if (auto label = labels.find(pc); label != labels.end())
+      function.code.push_back({LABEL, label->second});
+    if (pc == bytecode.size())
+      break;
+    Inst inst = {bytecode[pc]};
+    if (inst_length(inst.op) > 1)
+      inst.operand = read_u32(&bytecode[pc + 1]);
+    if (is_jump(inst.op))
+      inst.operand = labels.at(inst.operand);
+    else if (inst.op == PUSH)
+      inst.operand = function.constant(unit.constants[inst.operand]);
+    if (inst.op == CALL)
+      inst.argc = bytecode[pc + 5];
+    function.code.push_back(inst);
+  }
+  return function;
+}
+
+void lower(const Function &function, Unit &unit) {
+  unit = Unit();
+  // Only the constants and callees still used are kept.
+  vector<uint32_t> constants(function.constants.size(), UINT32_MAX);
+  vector<uint32_t> callees(function.callees.size(), UINT32_MAX);
+  auto keep = [](vector<uint32_t> &map, uint32_t index, auto &kept,
+                 const auto &all) {
+    if (map[index] == UINT32_MAX) {
+      map[index] = kept.size();
+      kept.push_back(all[index]);
+    }
+    return map[index];
+  };
+
+  // The prologue pushes null for every local after the parameters.
+  if (function.locals > function.params) {
+    auto found = std::find_if(
+        function.constants.begin(), function.constants.end(),
+        [](const Object &value) { return value.type == Type::NULL_TYPE; });
+    uint32_t null = unit.constants.size();
+    if (found == function.constants.end())
+      unit.constants.emplace_back();
+    else
+      null = keep(constants, found - function.constants.begin(),
+                  unit.constants, function.constants);
+    for (size_t i = function.params; i < function.locals; i++) {
+      unit.bytecode.push_back(PUSH);
+      append_u32(unit.bytecode, null);
+    }
+  }
+
+  vector<uint32_t> addresses(function.labels);
+  vector<uint32_t> jumps;
+  for (const Inst &inst : function.code) {
+    if (inst.op == LABEL) {
+      addresses[inst.operand] = unit.bytecode.size();
+      continue;
+    }
+    unit.bytecode.push_back(inst.op);
+    uint32_t operand = inst.operand;
+    if (inst.op == PUSH)
+      operand = keep(constants, operand, unit.constants, function.constants);
+    else if (inst.op == CALL)
+      operand = keep(callees, operand, unit.callees, function.callees);
+    else if (is_jump(inst.op))
+      jumps.push_back(unit.bytecode.size());
+    if (inst_length(inst.op) > 1)
+      append_u32(unit.bytecode, operand);
+    if (inst.op == CALL)
+      unit.bytecode.push_back(inst.argc);
+  }
+  for (uint32_t at : jumps) {
+    uint32_t target = addresses[read_u32(&unit.bytecode[at])];
+    for (int i = 0; i < 4; i++)
+      unit.bytecode[at + i] = target >> (8 * i);
+  }
+}
+
+vector<Block> blocks(const Function &function) {
+  const vector<Inst> &code = function.code;
+  vector<Block> result;
+  vector<uint32_t> label_blocks(function.labels, UINT32_MAX);
+  for (uint32_t i = 0; i < code.size(); i++) {
+    bool leader = i == 0 || code[i].op == LABEL ||
+                  is_jump(code[i - 1].op) || ends_flow(code[i - 1].op);
+    if (leader) {
+      if (!result.empty())
+        result.back().end = i;
+      result.push_back({i, static_cast<uint32_t>(code.size()), {}});
+    }
+    if (code[i].op == LABEL)
+      label_blocks[code[i].operand] = result.size() - 1;
+  }
+
+  for (uint32_t b = 0; b < result.size(); b++) {
+    Block &block = result[b];
+    const Inst &last = code[block.end - 1];
+    if (is_jump(last.op))
+      block.successors.push_back(label_blocks[last.operand]);
+    if (!ends_flow(last.op) && b + 1 < result.size())
+      block.successors.push_back(b + 1);
+  }
+  return result;
+}
+
+vector<uint32_t> tree_starts(const vector<Inst> &code, uint32_t begin,
+                             uint32_t end) {
+  vector<uint32_t> starts(end - begin, OUTSIDE);
+  // Where each value on the stack starts being computed.
+  vector<uint32_t> stack;
+  for (uint32_t i = begin; i < end; i++) {
+    StackEffect effect = inst_effect(code[i]);
+    uint32_t start = i;
+    for (int j = 0; j < effect.pops; j++) {
+      uint32_t operand = stack.empty() ? OUTSIDE : stack.back();
+      if (!stack.empty())
+        stack.pop_back();
+      start = operand == OUTSIDE || start == OUTSIDE
+                  ? OUTSIDE
+                  : std::min(start, operand);
+    }
+    if (effect.pushes == 0)
+      continue;
+    starts[i - begin] = start;
+    stack.push_back(start);
+  }
+  return starts;
+}
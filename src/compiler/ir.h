@@ -0,0 +1,71 @@
+#ifndef IR_H
+#define IR_H
+
+#include "../bytecode.h"
+#include "ast.h"
+#include "codegen.h"
+#include <unordered_map>
+
+// Not an instruction but a place jumps can land: the label named by its
+// operand. Passes add and remove instructions freely, so jumps name labels
+// rather than offsets until lower() lays the code out.
+static constexpr uint16_t LABEL = 0x100;
+
+struct Inst {
+  uint16_t op;
+  uint32_t operand = 0;
+  // The arguments a CALL passes.
+  uint8_t argc = 0;
+};
+
+// A function as the optimizer sees it: the linear code of a Unit, without
+// the prologue pushing its locals, which lower() puts back for as many
+// locals as are left by then. Jumps name labels and CALL operands index
+// `callees`, as in the Unit.
+struct Function {
+  vector<Inst> code;
+  vector<Object> constants;
+  vector<string> callees;
+  uint32_t params = 0;
+  // The local slots, parameters first.
+  uint32_t locals = 0;
+  uint32_t labels = 0;
+
+  // The index of a constant equal to `value`, added if there is none.
+  uint32_t constant(const Object &value);
+  uint32_t label() { return labels++; }
+
+private:
+  std::unordered_map<string, uint32_t> constant_index;
+};
+
+// A run of instructions only entered at its first and only left after its
+// last, by the blocks it lists as successors.
+struct Block {
+  uint32_t begin;
+  uint32_t end;
+  vector<uint32_t> successors;
+};
+
+// Where the code computing a value starts when it does not start within
+// the range looked at.
+static constexpr uint32_t OUTSIDE = UINT32_MAX;
+
+Function lift(const Unit &unit, uint32_t params, uint32_t locals);
+void lower(const Function &function, Unit &unit);
+
+bool is_jump(uint16_t op);
+// Whether control never goes on to the next instruction.
+bool ends_flow(uint16_t op);
+StackEffect inst_effect(const Inst &inst);
+
+// The function's basic blocks, in the order of the code.
+vector<Block> blocks(const Function &function);
+// For every instruction in `code[begin, end)`, indexed from `begin`, where
+// the instructions computing the value it pushes start: its expression
+// tree, which stack code keeps in one piece. OUTSIDE if it pushes nothing
+// or part of the tree is before `begin`.
+vector<uint32_t> tree_starts(const vector<Inst> &code, uint32_t begin,
+                             uint32_t end);
+
+#endif // IR_H
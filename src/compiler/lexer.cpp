@@ -1,245 +1,237 @@
 #include "lexer.h"
-#include <cctype>
+#include "scan.h"
+#include <cstring>
+#include <thread>
 
-bool is_keyword(string s) {
-  const vector<string> keywords = {"fn",    "Int",    "Str",   "Bool",
-                                   "Float", "return", "if",    "else",
-                                   "for",   "while",  "break", "continue"};
-  for (string keyword : keywords) {
-    if (keyword == s)
-      return true;
-  }
-  return false;
+// The C locale's character classes, without a locale lookup per byte.
+static bool is_alpha(char c) { return (c | 0x20) >= 'a' && (c | 0x20) <= 'z'; }
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+static bool is_binary_digit(char c) { return c == '0' || c == '1'; }
+static bool is_hex_digit(char c) {
+  return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
 }
+static bool is_space(char c) { return c == ' ' || (c >= '\t' && c <= '\r'); }
 
-Lexer::Lexer(string source) : source(source) {
-  if (index < source.size()) {
-    current = source[index];
-    if (index + 1 < source.size())
-      next = source[index + 1];
-  }
-}
+Lexer::Lexer(string_view source) : source(source) {}
 
-void Lexer::advance() {
-  if (current == '\n') {
-    col = 1;
-    row++;
-  } else {
-    col++;
-  }
+// Lexes source[begin, size) as if nothing followed it. Only touches its
+// arguments, so ranges can be lexed on several threads at once.
+void Lexer::scan_range(uint32_t begin, uint32_t size, TokenList &token_list,
+                       vector<PendingError> &pending_errors) const {
+  const char *data = source.data();
+  auto at = [&](uint32_t i) { return i < size ? data[i] : 0; };
+  auto error = [&](uint32_t offset, const char *message) {
+    pending_errors.emplace_back(offset, message);
+  };
+  // Decimal digits, which single underscores may separate.
+  auto skip_decimal = [&](uint32_t begin) {
+    uint32_t i = skip_digits(data, begin, size);
+    while (i > begin && at(i) == '_' && is_digit(at(i + 1)))
+      i = skip_digits(data, i + 1, size);
+    return i;
+  };
 
-  if (index + 1 < source.size()) {
-    current = source[index + 1];
-    if (index + 2 < source.size()) {
-      next = source[index + 2];
-    } else {
-      next = 0;
-    }
-  } else {
-    current = 0;
-  }
-
-  index++;
-}
-
-void Lexer::tokenize() {
-  while (current != 0) {
-    int start_row = row;
-    int start_col = col;
-
-    if (isalpha(current)) {
-      string buffer;
-      while (isalnum(current)) {
-        buffer.push_back(current);
-        advance();
-      }
+  uint32_t i = begin;
+  while (i < size) {
+    char current = data[i];
+    uint32_t start = i;
 
-      if (is_keyword(buffer))
-        tokens.push_back(Token(KEYWORD, buffer, start_row, start_col));
-      else
-        tokens.push_back(Token(IDENTIFIER, buffer, start_row, start_col));
-    } else if (isdigit(current)) {
-      string buffer;
-      bool has_dot = false;
-      while (isdigit(current) || (!has_dot && current == '.')) {
-        if (current == '.')
-          has_dot = true;
-        buffer.push_back(current);
-        advance();
+    if (current == '\n') {
+      // Only the last newline of a run is a token.
+      while (at(i + 1) == '\n')
+        i++;
+      token_list.push(TokenType::NEWLINE, i++, 0);
+    } else if (is_space(current)) {
+      i = skip_blanks(data, i, size);
+    } else if (is_alpha(current)) {
+      i = skip_alnum(data, i, size);
+      Keyword keyword = keyword_id(string_view(data + start, i - start));
+      token_list.push(keyword ? TokenType::KEYWORD : TokenType::IDENTIFIER,
+                      start, i - start, keyword);
+    } else if (is_digit(current)) {
+      TokenType type = TokenType::INTEGER;
+      char prefix = at(i + 1) | 0x20;
+      if (current == '0' && (prefix == 'x' || prefix == 'b')) {
+        // Hex and binary literals are always Ints.
+        bool (*is_base_digit)(char) =
+            prefix == 'x' ? is_hex_digit : is_binary_digit;
+        i += 2;
+        while (is_base_digit(at(i)) ||
+               (at(i) == '_' && i > start + 2 && is_base_digit(at(i + 1))))
+          i++;
+        if (i == start + 2)
+          error(start, prefix == 'x' ? "Expected hex digits after 0x"
+                                     : "Expected binary digits after 0b");
+      } else {
+        i = skip_decimal(i);
+        if (at(i) == '.') {
+          type = TokenType::FLOAT;
+          i = skip_decimal(i + 1);
+        }
       }
-
-      if (has_dot)
-        tokens.push_back(Token(FLOAT, buffer, start_row, start_col));
-      else
-        tokens.push_back(Token(INTEGER, buffer, start_row, start_col));
+      token_list.push(type, start, i - start);
     } else if (current == '"') {
-      advance();
-
-      string buffer;
+      start = ++i;
+      // Escapes are checked here but only decoded by TokenList::literal.
       while (true) {
-        if (current == '\\') {
-          advance();
-          switch (current) {
-          case 'b':
-            buffer.push_back('\b');
-            break;
-          case 'n':
-            buffer.push_back('\n');
-            break;
-          case 'r':
-            buffer.push_back('\r');
-            break;
-          case 't':
-            buffer.push_back('\t');
-            break;
-          case '"':
-            buffer.push_back('"');
-            break;
-          case '\\':
-            buffer.push_back('\\');
-            break;
-          default:
-            errors.push_back(to_string(row) + ":" + to_string(col) +
-                             " Unknown escape sequence");
-            break;
-          }
-        } else if (current == '"') {
-          advance();
-          break;
-        } else if (current == '\n') {
-          errors.push_back(to_string(start_row) + ":" + to_string(start_col) +
-                           " Unclosed string");
+        i = skip_string_chars(data, i, size);
+        if (i == size || data[i] == '\n') {
+          error(start - 1, "Unclosed string");
           break;
-        } else {
-          buffer.push_back(current);
         }
-        advance();
+        if (data[i] == '"')
+          break;
+        char escape = at(++i);
+        if (escape == 0 || !strchr("bnrt\"\\", escape))
+          error(i, "Unknown escape sequence");
+        if (i < size)
+          i++;
       }
-      tokens.push_back(Token(STRING, buffer, start_row, start_col));
-    } else if (isspace(current)) {
-      if (current == '\n' && next != '\n')
-        tokens.push_back(Token(NEWLINE, "", start_row, start_col));
-      advance();
+      token_list.push(TokenType::STRING, start, i - start);
+      if (at(i) == '"')
+        i++;
     } else {
-      Type type;
+      TokenType type = TokenType::COMMENT;
+      char next = at(i + 1);
+      // Operators that may be followed by '=' or doubled.
+      auto pair = [&](char second, TokenType both, TokenType single) {
+        if (next != second)
+          return single;
+        i++;
+        return both;
+      };
+
       switch (current) {
       case '(':
-        type = LPAREN;
+        type = TokenType::LPAREN;
         break;
       case ')':
-        type = RPAREN;
+        type = TokenType::RPAREN;
         break;
       case '[':
-        type = LBRACKET;
+        type = TokenType::LBRACKET;
         break;
       case ']':
-        type = RBRACKET;
+        type = TokenType::RBRACKET;
         break;
       case '{':
-        type = LBRACE;
+        type = TokenType::LBRACE;
         break;
       case '}':
-        type = RBRACE;
+        type = TokenType::RBRACE;
         break;
       case ',':
-        type = COMMA;
+        type = TokenType::COMMA;
         break;
       case ':':
-        type = COLON;
+        type = TokenType::COLON;
         break;
       case '+':
-        type = PLUS;
+        type = TokenType::PLUS;
         break;
       case '-':
-        type = MINUS;
+        type = TokenType::MINUS;
         break;
       case '*':
-        type = ASTERISK;
+        type = TokenType::ASTERISK;
         break;
-      case '/': {
+      case '/':
         if (next == '/') {
-          while (current != '\n' && current != 0)
-            advance();
-          type = COMMENT;
+          // A comment takes the newline that ends it with it.
+          const void *end = memchr(data + i, '\n', size - i);
+          i = end ? static_cast<const char *>(end) - data : size;
         } else {
-          type = SLASH;
+          type = TokenType::SLASH;
         }
         break;
-      }
       case '^':
-        type = CARRET;
+        type = TokenType::CARRET;
         break;
       case '~':
-        type = TILDA;
+        type = TokenType::TILDA;
         break;
-      case '!': {
-        if (next == '=') {
-          advance();
-          type = NOT_EQ;
-        } else {
-          type = BANG;
-        }
+      case '!':
+        type = pair('=', TokenType::NOT_EQ, TokenType::BANG);
         break;
-      }
-      case '<': {
-        if (next == '=') {
-          advance();
-          type = LESS_EQ;
-        } else {
-          type = LESS;
-        }
+      case '<':
+        type = pair('=', TokenType::LESS_EQ, TokenType::LESS);
         break;
-      }
-      case '>': {
-        if (next == '=') {
-          advance();
-          type = GREATER_EQ;
-        } else {
-          type = GREATER;
-        }
+      case '>':
+        type = pair('=', TokenType::GREATER_EQ, TokenType::GREATER);
         break;
-      }
-      case '=': {
-        if (next == '=') {
-          advance();
-          type = EQ;
-        } else {
-          type = ASSIGN;
-        }
+      case '=':
+        type = pair('=', TokenType::EQ, TokenType::ASSIGN);
         break;
-      }
       case '%':
-        type = MODULO;
+        type = TokenType::MODULO;
         break;
-      case '&': {
-        if (next == '&') {
-          advance();
-          type = LOG_AND;
-        } else {
-          type = BIT_AND;
-        }
+      case '&':
+        type = pair('&', TokenType::LOG_AND, TokenType::BIT_AND);
         break;
-      }
-      case '|': {
-        if (next == '|') {
-          advance();
-          type = LOG_OR;
-        } else {
-          type = BIT_OR;
-        }
+      case '|':
+        type = pair('|', TokenType::LOG_OR, TokenType::BIT_OR);
         break;
-      }
       case '.':
-        type = DOT;
+        type = TokenType::DOT;
         break;
       default:
-        errors.push_back(to_string(row) + ":" + to_string(col) +
-                         " Unknown token");
+        error(i, "Unknown token");
         break;
       }
-      if (type != COMMENT)
-        tokens.push_back(Token(type, "", start_row, start_col));
-      advance();
+      i++;
+      if (type != TokenType::COMMENT)
+        token_list.push(type, start, i - start);
     }
   }
 }
+
+void Lexer::scan() { scan(1); }
+
+void Lexer::scan(unsigned threads) {
+  token_list.clear();
+  token_list.source = source;
+  if (source.size() > UINT32_MAX) {
+    errors.push_back("1:1 Source too large");
+    return;
+  }
+
+  const uint32_t size = source.size();
+  vector<uint32_t> splits = {0};
+  if (size >= PARALLEL_LEX_MIN) {
+    for (unsigned k = 1; k < threads; k++) {
+      uint32_t split = find_split(source.data(), uint64_t(size) * k / threads,
+                                  size);
+      if (split > splits.back() && split < size)
+        splits.push_back(split);
+    }
+  }
+  splits.push_back(size);
+
+  size_t chunks = splits.size() - 1;
+  vector<TokenList> parts(chunks - 1);
+  vector<vector<PendingError>> part_errors(chunks);
+  vector<std::thread> workers;
+  for (size_t k = 1; k < chunks; k++)
+    workers.emplace_back([&, k] {
+      scan_range(splits[k], splits[k + 1], parts[k - 1], part_errors[k]);
+    });
+  scan_range(0, splits[1], token_list, part_errors[0]);
+  for (auto &worker : workers)
+    worker.join();
+
+  // Offsets are into the whole source, so the parts only need appending.
+  for (const TokenList &part : parts)
+    token_list.append(part);
+  for (const auto &pending : part_errors)
+    for (auto [offset, message] : pending)
+      errors.push_back(to_string(token_list.row_at(offset)) + ":" +
+                       to_string(token_list.col_at(offset)) + " " + message);
+}
+
+void Lexer::tokenize() {
+  scan();
+  tokens.clear();
+  tokens.reserve(token_list.size());
+  for (size_t i = 0; i < token_list.size(); i++)
+    tokens.push_back(token_list.token(i));
+}
@@ -2,28 +2,40 @@
 #define LEXER_H
 
 #include "tokens.h"
+#include <utility>
 #include <vector>
 
+#define PARALLEL_LEX_MIN (1 << 20)
+
 using std::vector;
 
 class Lexer {
 public:
   vector<string> errors;
   vector<Token> tokens;
+  // Filled by scan(). Its windows point into the source.
+  TokenList token_list;
+
+  // Lexes into token_list without allocating per token.
+  void scan();
+  // Like scan(), but a source of at least PARALLEL_LEX_MIN bytes is split
+  // into up to `threads` chunks that are lexed at the same time. The tokens
+  // and errors are the same as scan()'s.
+  void scan(unsigned threads);
+  // Lexes into tokens, each holding its own copy of its text.
   void tokenize();
 
-  Lexer(string source);
+  // The source is not copied and must outlive the lexer and its tokens.
+  Lexer(string_view source);
 
 private:
-  string source;
-  int index = 0;
-  int row = 1;
-  int col = 1;
+  // An error found while lexing, by offset until rows are worked out.
+  using PendingError = std::pair<uint32_t, const char *>;
 
-  char current = 0;
-  char next = 0;
+  string_view source;
 
-  void advance();
+  void scan_range(uint32_t begin, uint32_t end, TokenList &token_list,
+                  vector<PendingError> &pending_errors) const;
 };
 
 #endif
@@ -1,41 +1,82 @@
-#include "lexer.h"
-#include <fstream>
+#include "bench.h"
+#include "driver.h"
+#include "tests.h"
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <sstream>
 
-using std::cout, std::endl, std::cerr, std::ifstream, std::stringstream;
+using std::cout, std::endl, std::cerr;
+
+static int usage(const char *name) {
+  cout << "Usage: " << name << " [-j threads] [-O0 | -O1 | -O2] "
+       << "[-ftime-report] [--tokens | --run | -o out] "
+       << "[--no-cache | --cache-dir dir] [--cache-size MiB] <file>" << endl;
+  return 1;
+}
+
+// The bytes in `text` MiB, if it is a positive whole number of them and the
+// bytes can be counted.
+static bool parse_cache_size(const char *text, uint64_t &bytes) {
+  const char *end = text + std::strlen(text);
+  uint64_t mib;
+  auto [stop, error] = std::from_chars(text, end, mib);
+  if (error != std::errc() || stop != end || mib == 0 || mib > UINT64_MAX >> 20)
+    return false;
+  bytes = mib << 20;
+  return true;
+}
 
 int main(int argc, const char **argv) {
-  if (argc != 2) {
-    cout << "Usage: " << argv[0] << " <file>" << endl;
-    return 1;
+  if (argc == 2 && string(argv[1]) == "bench") {
+    benchmarks();
+    return 0;
   }
-
-  ifstream file(argv[1]);
-  if (!file) {
-    cerr << "Could not open file" << endl;
-    return 1;
+  if (argc == 2 && string(argv[1]) == "test") {
+    tests();
+    return 0;
   }
 
-  stringstream buffer;
-  buffer << file.rdbuf();
-
-  string source(buffer.str());
-
-  Lexer lexer(source);
-  lexer.tokenize();
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    string arg = argv[i];
+    if (arg == "-j" && i + 1 < argc)
+      options.threads = std::atoi(argv[++i]);
+    else if (arg == "-O0" || arg == "-O1" || arg == "-O2")
+      options.level = arg[2] - '0';
+    else if (arg == "-ftime-report")
+      options.time_report = true;
+    else if (arg == "-o" && i + 1 < argc)
+      options.output = argv[++i];
+    else if (arg == "--tokens")
+      options.tokens_only = true;
+    else if (arg == "--run")
+      options.run = true;
+    else if (arg == "--no-cache")
+      options.cache_dir.clear();
+    else if (arg == "--cache-dir" && i + 1 < argc)
+      options.cache_dir = argv[++i];
+    else if (arg == "--cache-size" && i + 1 < argc &&
+             parse_cache_size(argv[i + 1], options.cache_size))
+      i++;
+    else if (options.input.empty() && arg[0] != '-')
+      options.input = arg;
+    else
+      return usage(argv[0]);
+  }
+  if (options.input.empty() || options.threads == 0 ||
+      (options.tokens_only && options.run))
+    return usage(argv[0]);
 
-  if (lexer.errors.size() != 0) {
-    for (auto error : lexer.errors) {
-      cerr << error << "\n";
-    }
-    cerr << endl;
+  MappedFile file(options.input.c_str());
+  if (!file) {
+    cerr << "Could not open file" << endl;
     return 1;
   }
 
-  for (auto token : lexer.tokens) {
-    cout << token.row << ":" << token.col << " " << type_to_string(token.type)
-         << " " << token.literal << "\n";
-  }
-  cout << endl;
+  TimeReport report;
+  int status = compile(file, options, options.time_report ? &report : nullptr);
+  if (options.time_report)
+    report.print(cerr);
+  return status;
 }
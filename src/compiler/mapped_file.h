@@ -0,0 +1,27 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string_view>
+
+// A file mapped read-only into memory. Its contents are read from the page
+// cache as they are used, so a large source is never copied into a buffer
+// and pages already lexed can be dropped by the kernel under pressure.
+class MappedFile {
+public:
+  explicit MappedFile(const char *path);
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  // False if the file could not be opened or mapped.
+  explicit operator bool() const { return opened; }
+  std::string_view contents() const { return {data, size}; }
+
+private:
+  const char *data = nullptr;
+  size_t size = 0;
+  bool opened = false;
+};
+
+#endif // MAPPED_FILE_H
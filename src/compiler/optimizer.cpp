@@ -0,0 +1,1084 @@
+#include "optimizer.h"
+#include <algorithm>
+#include <cmath>
+
+// The passes after short-circuit lowering run again while they change
+// something, as each can open up work for the others, up to this often.
+#define MAX_ROUNDS 4
+// Subexpressions one function may have replaced, bounding the time spent
+// on huge generated functions.
+#define MAX_SUBEXPRESSIONS 256
+
+// helpers {{{
+static bool is_typed_arithmetic(uint16_t op) {
+  switch (op) {
+  case ADD_INT:
+  case SUB_INT:
+  case MUL_INT:
+  case ADD_FLOAT:
+  case SUB_FLOAT:
+  case MUL_FLOAT:
+  case DIV_FLOAT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static bool is_typed_comparison(uint16_t op) {
+  switch (op) {
+  case EQ_INT:
+  case NEQ_INT:
+  case LT_INT:
+  case GT_INT:
+  case LTE_INT:
+  case GTE_INT:
+  case EQ_FLOAT:
+  case NEQ_FLOAT:
+  case LT_FLOAT:
+  case GT_FLOAT:
+  case LTE_FLOAT:
+  case GTE_FLOAT:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// The typed float form of a generic instruction, or HALT if it has none.
+static uint8_t float_inst(uint16_t op) {
+  switch (op) {
+  case ADD:
+    return ADD_FLOAT;
+  case SUB:
+    return SUB_FLOAT;
+  case MUL:
+    return MUL_FLOAT;
+  case DIV:
+    return DIV_FLOAT;
+  case LT:
+    return LT_FLOAT;
+  case GT:
+    return GT_FLOAT;
+  case LTE:
+    return LTE_FLOAT;
+  case GTE:
+    return GTE_FLOAT;
+  default:
+    return HALT;
+  }
+}
+
+static bool is_number(TypeName type) {
+  return type == TypeName::INT || type == TypeName::FLOAT;
+}
+
+static bool is_scalar(TypeName type) {
+  return is_number(type) || type == TypeName::BOOL || type == TypeName::STR;
+}
+
+static TypeName constant_type(const Object &value) {
+  switch (value.type) {
+  case Type::INTEGER:
+    return TypeName::INT;
+  case Type::FLOAT:
+    return TypeName::FLOAT;
+  case Type::BOOLEAN:
+    return TypeName::BOOL;
+  case Type::STRING:
+    return TypeName::STR;
+  default:
+    return TypeName::NONE;
+  }
+}
+
+// What is proven of a value: the type it has, NONE unless all it can be is
+// of one type, and whether the code computing it is safe, having no
+// effects and unable to fail. The types the checker gave parameters and
+// results are no proof, as nothing stops a caller passing or a function
+// returning other types, and the typed instructions picked from them fall
+// back to the generic ones. So types are only proven from constants and
+// what operations on them give.
+struct Fact {
+  TypeName type = TypeName::NONE;
+  bool safe = false;
+};
+
+// What is proven of the value `inst` pushes from what is of its operands,
+// and of the local it loads if it is a LOAD.
+static Fact prove(const Function &function, const Inst &inst,
+                  const Fact *args, TypeName loaded) {
+  const Fact &a = args[0];
+  const Fact &b = args[1];
+  bool numbers = is_number(a.type) && is_number(b.type);
+  bool safe = a.safe && b.safe;
+  if (inst.op == PUSH)
+    return {constant_type(function.constants[inst.operand]), true};
+  if (inst.op == LOAD)
+    return {loaded, true};
+
+  switch (generic_inst(inst.op)) {
+  // Numbers never fail these; anything else may, or be an array.
+  case ADD:
+  case SUB:
+  case MUL:
+    if (!numbers)
+      return {};
+    return {a.type == TypeName::INT && b.type == TypeName::INT
+                ? TypeName::INT
+                : TypeName::FLOAT,
+            safe};
+  case DIV:
+    return numbers ? Fact{TypeName::FLOAT, safe} : Fact{};
+  case LT:
+  case GT:
+  case LTE:
+  case GTE:
+    return numbers ? Fact{TypeName::BOOL, safe} : Fact{};
+  case EQ:
+  case NEQ:
+    return is_scalar(a.type) && is_scalar(b.type)
+               ? Fact{TypeName::BOOL, safe}
+               : Fact{};
+  // These push a Bool or fail.
+  case LOG_AND:
+  case LOG_OR:
+    return {TypeName::BOOL,
+            safe && a.type == TypeName::BOOL && b.type == TypeName::BOOL};
+  case LOG_NOT:
+    return {TypeName::BOOL, a.safe && a.type == TypeName::BOOL};
+  case BIT_AND:
+  case BIT_OR:
+  case XOR:
+    return {TypeName::INT,
+            safe && a.type == TypeName::INT && b.type == TypeName::INT};
+  case BIT_NOT:
+    return {TypeName::INT, a.safe && a.type == TypeName::INT};
+  case NEG:
+    return is_number(a.type) ? Fact{a.type, a.safe} : Fact{};
+  default:
+    return {};
+  }
+}
+
+static bool as_number(const Object &value, double &number) {
+  if (value.is_type<int>())
+    number = value.as<int>();
+  else if (value.is_type<double>())
+    number = value.as<double>();
+  else
+    return false;
+  return true;
+}
+
+// What the VM computes for `op` on constant operands, where that is a
+// scalar it computes without failing. A typed instruction gives what its
+// generic one does.
+static bool fold(uint16_t op, const Object *args, Object &result) {
+  const Object &a = args[0];
+  const Object &b = args[1];
+  double x = 0, y = 0;
+  bool numbers = as_number(a, x) && as_number(b, y);
+  bool ints = a.is_type<int>() && b.is_type<int>();
+  bool bools = a.is_type<bool>() && b.is_type<bool>();
+
+  switch (generic_inst(op)) {
+  case ADD:
+  case SUB:
+  case MUL: {
+    if (!numbers)
+      return false;
+    uint8_t inst = generic_inst(op);
+    if (ints) {
+      // Overflow wraps around, as on the machines the VM runs on.
+      uint32_t p = a.as<int>(), q = b.as<int>();
+      uint32_t r = inst == ADD ? p + q : inst == SUB ? p - q : p * q;
+      result = Object(Type::INTEGER, static_cast<int>(r));
+    } else {
+      double r = inst == ADD ? x + y : inst == SUB ? x - y : x * y;
+      result = Object(Type::FLOAT, r);
+    }
+    return true;
+  }
+  case DIV:
+    if (numbers)
+      result = Object(Type::FLOAT, x / y);
+    return numbers;
+  case LT:
+  case GT:
+  case LTE:
+  case GTE: {
+    if (!numbers)
+      return false;
+    uint8_t inst = generic_inst(op);
+    bool r = inst == LT ? x < y : inst == GT ? x > y : inst == LTE ? x <= y
+                                                                   : x >= y;
+    result = Object(Type::BOOLEAN, r);
+    return true;
+  }
+  case EQ:
+  case NEQ: {
+    auto comparable = [](const Object &value) {
+      return value.type == Type::NULL_TYPE || value.type == Type::INTEGER ||
+             value.type == Type::FLOAT || value.type == Type::BOOLEAN ||
+             value.type == Type::STRING;
+    };
+    // Values of different types are unequal, but two nulls are an error.
+    if (!comparable(a) || !comparable(b) ||
+        (a.type == Type::NULL_TYPE && b.type == Type::NULL_TYPE))
+      return false;
+    bool equal = a.type == b.type && (a.type == Type::STRING
+                                          ? a.as<String>() == b.as<String>()
+                                      : a.type == Type::BOOLEAN
+                                          ? a.as<bool>() == b.as<bool>()
+                                          : x == y);
+    result = Object(Type::BOOLEAN, generic_inst(op) == EQ ? equal : !equal);
+    return true;
+  }
+  case LOG_AND:
+  case LOG_OR:
+    if (bools)
+      result = Object(Type::BOOLEAN, op == LOG_AND
+                                         ? a.as<bool>() && b.as<bool>()
+                                         : a.as<bool>() || b.as<bool>());
+    return bools;
+  case LOG_NOT:
+    if (a.is_type<bool>())
+      result = Object(Type::BOOLEAN, !a.as<bool>());
+    return a.is_type<bool>();
+  case BIT_AND:
+  case BIT_OR:
+  case XOR:
+    if (!ints)
+      return false;
+    result = Object(Type::INTEGER, op == BIT_AND  ? a.as<int>() & b.as<int>()
+                                   : op == BIT_OR ? a.as<int>() | b.as<int>()
+                                                  : a.as<int>() ^ b.as<int>());
+    return true;
+  case BIT_NOT:
+    if (a.is_type<int>())
+      result = Object(Type::INTEGER, ~a.as<int>());
+    return a.is_type<int>();
+  case NEG:
+    if (a.is_type<int>()) {
+      uint32_t bits = a.as<int>();
+      result = Object(Type::INTEGER, static_cast<int>(0u - bits));
+    } else if (a.is_type<double>()) {
+      result = Object(Type::FLOAT, -a.as<double>());
+    }
+    return a.is_type<int>() || a.is_type<double>();
+  default:
+    return false;
+  }
+}
+
+// Code being rebuilt one instruction at a time, knowing where the code
+// computing each value on the stack starts in it, like tree_starts(), and
+// what is proven of the value.
+struct Rebuild {
+  struct Value {
+    uint32_t start;
+    Fact fact;
+  };
+
+  const Function &function;
+  vector<Inst> out;
+  vector<Value> stack;
+
+  explicit Rebuild(const Function &function) : function(function) {}
+
+  // `loaded` is the type of the local a LOAD loads.
+  void emit(const Inst &inst, TypeName loaded = TypeName::NONE) {
+    StackEffect effect = inst_effect(inst);
+    uint32_t start = out.size();
+    Fact args[2];
+    for (int i = effect.pops - 1; i >= 0; i--) {
+      Value operand = stack.empty() ? Value{OUTSIDE, {}} : stack.back();
+      if (!stack.empty())
+        stack.pop_back();
+      if (i < 2)
+        args[i] = operand.fact;
+      start = operand.start == OUTSIDE || start == OUTSIDE
+                  ? OUTSIDE
+                  : std::min(start, operand.start);
+    }
+    out.push_back(inst);
+    if (effect.pushes > 0)
+      stack.push_back({start, prove(function, inst, args, loaded)});
+  }
+
+  // Where the value `depth` below the top starts, OUTSIDE if it was pushed
+  // before the block.
+  uint32_t operand(size_t depth) const {
+    return depth < stack.size() ? stack[stack.size() - 1 - depth].start
+                                : OUTSIDE;
+  }
+
+  // What is proven of the value `depth` below the top.
+  Fact fact(size_t depth) const {
+    return depth < stack.size() ? stack[stack.size() - 1 - depth].fact
+                                : Fact();
+  }
+
+  // Starts a new block; values from the last one are out of reach.
+  void block() { stack.clear(); }
+};
+
+// Runs a block on the types of the locals at its start, leaving their
+// types at its end, and with `loads` records the type each LOAD loads.
+static void type_locals(const Function &function, const Block &block,
+                        vector<TypeName> &locals, vector<TypeName> *loads) {
+  Rebuild code(function);
+  for (uint32_t i = block.begin; i < block.end; i++) {
+    const Inst &inst = function.code[i];
+    TypeName loaded = TypeName::NONE;
+    if (inst.op == LOAD)
+      loaded = locals[inst.operand];
+    else if (inst.op == STORE)
+      locals[inst.operand] = code.fact(0).type;
+    if (loads != nullptr)
+      (*loads)[i] = loaded;
+    code.emit(inst, loaded);
+  }
+}
+
+// The type of the local each LOAD in the function loads, indexed like its
+// code: a type every value stored to the local before has, which makes
+// parameters and locals that may still be null NONE.
+static vector<TypeName> load_types(const Function &function) {
+  vector<Block> graph = blocks(function);
+  vector<TypeName> loads(function.code.size(), TypeName::NONE);
+  vector<vector<TypeName>> in(graph.size(),
+                              vector<TypeName>(function.locals));
+  vector<bool> reached(graph.size());
+  if (graph.empty())
+    return loads;
+
+  reached[0] = true;
+  vector<uint32_t> work = {0};
+  while (!work.empty()) {
+    uint32_t b = work.back();
+    work.pop_back();
+    vector<TypeName> locals = in[b];
+    type_locals(function, graph[b], locals, nullptr);
+    for (uint32_t next : graph[b].successors) {
+      bool changed = !reached[next];
+      for (size_t i = 0; i < locals.size(); i++) {
+        TypeName merged = !reached[next] || in[next][i] == locals[i]
+                              ? locals[i]
+                              : TypeName::NONE;
+        changed |= merged != in[next][i];
+        in[next][i] = merged;
+      }
+      reached[next] = true;
+      if (changed)
+        work.push_back(next);
+    }
+  }
+  for (size_t b = 0; b < graph.size(); b++)
+    if (reached[b])
+      type_locals(function, graph[b], in[b], &loads);
+  return loads;
+}
+// }}}
+
+// Short-circuit lowering {{{
+// Rewrites conditions built with && and || into jumps taken as soon as the
+// outcome is known, so `if a && b` never evaluates `b` when `a` is false.
+// This only happens where skipping `b` can't be told apart from evaluating
+// it: `b` is proven a Bool and safe.
+class ShortCircuit {
+public:
+  ShortCircuit(Function &function, const vector<TypeName> &loads,
+               uint32_t begin, uint32_t end)
+      : function(function), code(function.code), begin(begin),
+        starts(tree_starts(code, begin, end)), facts(end - begin) {
+    Rebuild block(function);
+    for (uint32_t i = begin; i < end; i++) {
+      block.emit(code[i], loads[i]);
+      if (inst_effect(code[i]).pushes > 0)
+        facts[i - begin] = block.fact(0);
+    }
+  }
+
+  uint32_t start(uint32_t root) const { return starts[root - begin]; }
+
+  // Whether the condition ending at `root` has an && or || to lower.
+  bool lowers(uint32_t root) const {
+    while (code[root].op == LOG_NOT && start(root) != root)
+      root--;
+    return (code[root].op == LOG_AND || code[root].op == LOG_OR) &&
+           skippable(root - 1);
+  }
+
+  // Jumps to `target` if the condition ending at `root` is false.
+  void jump_if_false(uint32_t root, uint32_t target, vector<Inst> &out) {
+    uint16_t op = code[root].op;
+    if (op == LOG_NOT)
+      return jump_if_true(root - 1, target, out);
+    if ((op == LOG_AND || op == LOG_OR) && skippable(root - 1)) {
+      uint32_t left = start(root - 1) - 1;
+      if (op == LOG_AND) {
+        jump_if_false(left, target, out);
+        jump_if_false(root - 1, target, out);
+      } else {
+        uint32_t next = function.label();
+        jump_if_true(left, next, out);
+        jump_if_false(root - 1, target, out);
+        out.push_back({LABEL, next});
+      }
+      return;
+    }
+    copy(root, out);
+    out.push_back({JMP_IF_FALSE, target});
+  }
+
+  // Jumps to `target` if the condition ending at `root` is true.
+  void jump_if_true(uint32_t root, uint32_t target, vector<Inst> &out) {
+    uint16_t op = code[root].op;
+    if (op == LOG_NOT)
+      return jump_if_false(root - 1, target, out);
+    uint32_t next = function.label();
+    if ((op == LOG_AND || op == LOG_OR) && skippable(root - 1)) {
+      uint32_t left = start(root - 1) - 1;
+      if (op == LOG_OR) {
+        jump_if_true(left, target, out);
+        jump_if_true(root - 1, target, out);
+        return;
+      }
+      jump_if_false(left, next, out);
+      jump_if_true(root - 1, target, out);
+    } else {
+      copy(root, out);
+      out.push_back({JMP_IF_FALSE, next});
+      out.push_back({JMP, target});
+    }
+    out.push_back({LABEL, next});
+  }
+
+private:
+  Function &function;
+  const vector<Inst> &code;
+  uint32_t begin;
+  vector<uint32_t> starts;
+  vector<Fact> facts;
+
+  void copy(uint32_t root, vector<Inst> &out) const {
+    out.insert(out.end(), code.begin() + start(root), code.begin() + root + 1);
+  }
+
+  bool skippable(uint32_t root) const {
+    const Fact &fact = facts[root - begin];
+    return start(root) != OUTSIDE && fact.type == TypeName::BOOL && fact.safe;
+  }
+};
+
+static bool lower_short_circuits(Function &function) {
+  vector<TypeName> loads = load_types(function);
+  vector<Inst> code;
+  bool changed = false;
+  for (const Block &block : blocks(function)) {
+    const vector<Inst> &old = function.code;
+    const Inst &last = old[block.end - 1];
+    uint32_t condition = block.end - 2;
+    if (last.op != JMP_IF_FALSE || block.end - block.begin < 2) {
+      code.insert(code.end(), old.begin() + block.begin,
+                  old.begin() + block.end);
+      continue;
+    }
+    ShortCircuit lowering(function, loads, block.begin, block.end);
+    if (lowering.start(condition) == OUTSIDE || !lowering.lowers(condition)) {
+      code.insert(code.end(), old.begin() + block.begin,
+                  old.begin() + block.end);
+      continue;
+    }
+    code.insert(code.end(), old.begin() + block.begin,
+                old.begin() + lowering.start(condition));
+    lowering.jump_if_false(condition, last.operand, code);
+    changed = true;
+  }
+  function.code = std::move(code);
+  return changed;
+}
+// }}}
+
+// Constant propagation {{{
+// What is known of a local: the constant it holds, or one of these.
+static constexpr int32_t UNREACHED = -2;
+static constexpr int32_t VARYING = -1;
+
+// Runs a block on what is known of the locals at its start, leaving what
+// is known at its end. With `out`, also writes the block with every load
+// of a known local turned into a PUSH, operations on constants folded and
+// jumps on constant conditions resolved.
+static bool propagate(Function &function, const Block &block,
+                      vector<int32_t> &locals, vector<Inst> *out) {
+  bool changed = false;
+  // What is known of each value on the stack.
+  vector<int32_t> stack;
+  size_t out_begin = out != nullptr ? out->size() : 0;
+  for (uint32_t i = block.begin; i < block.end; i++) {
+    Inst inst = function.code[i];
+    if (inst.op == LOAD && locals[inst.operand] >= 0) {
+      inst = {PUSH, static_cast<uint32_t>(locals[inst.operand])};
+      changed = true;
+    }
+
+    StackEffect effect = inst_effect(inst);
+    int32_t args[2] = {VARYING, VARYING};
+    for (int j = effect.pops - 1; j >= 0; j--) {
+      int32_t arg = stack.empty() ? VARYING : stack.back();
+      if (!stack.empty())
+        stack.pop_back();
+      if (j < 2)
+        args[j] = arg;
+    }
+
+    int32_t value = VARYING;
+    Object result;
+    if (inst.op == PUSH) {
+      value = inst.operand;
+    } else if (inst.op == STORE) {
+      locals[inst.operand] = args[0];
+    } else if (effect.pushes == 1 && (effect.pops == 1 || effect.pops == 2) &&
+               args[0] >= 0 && (effect.pops == 1 || args[1] >= 0)) {
+      Object operands[2] = {function.constants[args[0]],
+                            effect.pops == 2 ? function.constants[args[1]]
+                                             : Object()};
+      if (fold(inst.op, operands, result))
+        value = function.constant(result);
+    }
+    if (effect.pushes > 0)
+      stack.push_back(value);
+    if (out == nullptr)
+      continue;
+
+    // The operands are the last instructions written if those are PUSHes.
+    auto pushed = [&](int count) {
+      if (out->size() - out_begin < static_cast<size_t>(count))
+        return false;
+      for (int j = 1; j <= count; j++)
+        if ((*out)[out->size() - j].op != PUSH)
+          return false;
+      return true;
+    };
+    if (value >= 0 && inst.op != PUSH && pushed(effect.pops)) {
+      out->resize(out->size() - effect.pops);
+      out->push_back({PUSH, static_cast<uint32_t>(value)});
+      changed = true;
+    } else if (inst.op == JMP_IF_FALSE && pushed(1) &&
+               function.constants[out->back().operand].is_type<bool>()) {
+      bool taken = !function.constants[out->back().operand].as<bool>();
+      out->pop_back();
+      if (taken)
+        out->push_back({JMP, inst.operand});
+      changed = true;
+    } else {
+      out->push_back(inst);
+    }
+  }
+  return changed;
+}
+
+static bool propagate_constants(Function &function) {
+  vector<Block> graph = blocks(function);
+  size_t count = function.locals;
+  vector<vector<int32_t>> in(graph.size(), vector<int32_t>(count, UNREACHED));
+  vector<bool> reached(graph.size());
+  if (graph.empty())
+    return false;
+
+  // Parameters come from the caller; the other locals start out null.
+  int32_t null = function.constant(Object());
+  for (size_t i = 0; i < count; i++)
+    in[0][i] = i < function.params ? VARYING : null;
+  reached[0] = true;
+  vector<uint32_t> work = {0};
+  while (!work.empty()) {
+    uint32_t b = work.back();
+    work.pop_back();
+    vector<int32_t> locals = in[b];
+    propagate(function, graph[b], locals, nullptr);
+    for (uint32_t next : graph[b].successors) {
+      bool changed = !reached[next];
+      for (size_t i = 0; i < count; i++) {
+        int32_t merged = !reached[next] || in[next][i] == locals[i]
+                             ? locals[i]
+                             : VARYING;
+        changed |= merged != in[next][i];
+        in[next][i] = merged;
+      }
+      reached[next] = true;
+      if (changed)
+        work.push_back(next);
+    }
+  }
+
+  vector<Inst> code;
+  bool changed = false;
+  for (size_t b = 0; b < graph.size(); b++) {
+    if (reached[b]) {
+      changed |= propagate(function, graph[b], in[b], &code);
+    } else {
+      code.insert(code.end(), function.code.begin() + graph[b].begin,
+                  function.code.begin() + graph[b].end);
+    }
+  }
+  function.code = std::move(code);
+  return changed;
+}
+// }}}
+
+// Strength reduction {{{
+static bool is_zero(const Object &value) {
+  return (value.is_type<int>() && value.as<int>() == 0) ||
+         (value.is_type<double>() && value.as<double>() == 0 &&
+          !std::signbit(value.as<double>()));
+}
+
+static bool is_one(const Object &value) {
+  return (value.is_type<int>() && value.as<int>() == 1) ||
+         (value.is_type<double>() && value.as<double>() == 1);
+}
+
+// Whether dividing by `value` is multiplying by an exact reciprocal.
+static bool has_exact_reciprocal(const Object &value, double &reciprocal) {
+  double number;
+  if (!as_number(value, number) || number == 0 || !std::isfinite(number))
+    return false;
+  int exponent;
+  double mantissa = std::frexp(number, &exponent);
+  if (std::fabs(mantissa) != 0.5 || exponent < -1020 || exponent > 1020)
+    return false;
+  reciprocal = 1 / number;
+  return true;
+}
+
+// Replaces arithmetic with cheaper arithmetic giving the same values:
+// drops adding zero to an Int, subtracting zero and multiplying or dividing
+// by one, turns division of a Float by a power of two into multiplication
+// and, where one operand is proven a Float and the other is an Int
+// constant, makes the constant a Float so the typed instruction can be
+// used. The VM has no shifts, and to an interpreter a multiplication costs
+// what a shift would, so multiplying Ints by powers of two is left alone.
+static bool reduce_strength(Function &function) {
+  vector<TypeName> loads = load_types(function);
+  Rebuild code(function);
+  bool changed = false;
+  for (uint32_t i = 0; i < function.code.size(); i++) {
+    const Inst &inst = function.code[i];
+    if (inst.op == LABEL || (!code.out.empty() &&
+                             (is_jump(code.out.back().op) ||
+                              ends_flow(code.out.back().op))))
+      code.block();
+
+    StackEffect effect = inst_effect(inst);
+    uint32_t left = code.operand(1);
+    uint32_t right = code.operand(0);
+    if (inst.op == LABEL || effect.pops != 2 || effect.pushes != 1 ||
+        left == OUTSIDE || right == OUTSIDE) {
+      code.emit(inst, loads[i]);
+      continue;
+    }
+
+    vector<Inst> &out = code.out;
+    bool right_constant = right == out.size() - 1 && out[right].op == PUSH;
+    bool left_constant = right == left + 1 && out[left].op == PUSH;
+    const Object *constant =
+        right_constant  ? &function.constants[out[right].operand]
+        : left_constant ? &function.constants[out[left].operand]
+                        : nullptr;
+    if (constant == nullptr) {
+      code.emit(inst);
+      continue;
+    }
+
+    // The operand that is not the constant, which an identity leaves.
+    Fact args[2] = {code.fact(1), code.fact(0)};
+    Fact other = args[right_constant ? 0 : 1];
+    Fact result = prove(function, inst, args, TypeName::NONE);
+    uint8_t op = generic_inst(inst.op);
+    // -0.0 + 0 is 0.0, so only Ints are left alone by adding zero.
+    bool adds_zero = op == ADD && other.type == TypeName::INT &&
+                     is_zero(*constant);
+    double reciprocal;
+    bool identity =
+        is_number(other.type) && result.type == other.type &&
+        (right_constant
+             ? adds_zero || (op == SUB && is_zero(*constant)) ||
+                   ((op == MUL || op == DIV) && is_one(*constant))
+             : adds_zero || (op == MUL && is_one(*constant)));
+
+    if (identity && right_constant) {
+      out.pop_back();
+      code.stack.pop_back();
+    } else if (identity) {
+      out.erase(out.begin() + left);
+      code.stack.pop_back();
+      code.stack.pop_back();
+      code.stack.push_back({left, other});
+    } else if (op == DIV && right_constant &&
+               args[0].type == TypeName::FLOAT &&
+               has_exact_reciprocal(*constant, reciprocal)) {
+      out.back().operand =
+          function.constant(Object(Type::FLOAT, reciprocal));
+      code.stack.back().fact.type = TypeName::FLOAT;
+      code.emit({MUL_FLOAT});
+    } else if (float_inst(inst.op) != HALT &&
+               other.type == TypeName::FLOAT && constant->is_type<int>()) {
+      Inst &push = out[right_constant ? right : left];
+      push.operand = function.constant(
+          Object(Type::FLOAT, static_cast<double>(constant->as<int>())));
+      code.stack[code.stack.size() - (right_constant ? 1 : 2)].fact.type =
+          TypeName::FLOAT;
+      code.emit({float_inst(inst.op)});
+    } else {
+      code.emit(inst);
+      continue;
+    }
+    changed = true;
+  }
+  function.code = std::move(code.out);
+  return changed;
+}
+// }}}
+
+// Common subexpression elimination {{{
+// Instructions whose value only depends on their operands, and which can
+// be computed once and reused.
+static bool is_pure(uint16_t op) {
+  switch (op) {
+  case PUSH:
+  case LOAD:
+  case ADD:
+  case SUB:
+  case MUL:
+  case DIV:
+  case EQ:
+  case NEQ:
+  case LT:
+  case GT:
+  case LTE:
+  case GTE:
+  case LOG_AND:
+  case LOG_OR:
+  case LOG_NOT:
+  case BIT_AND:
+  case BIT_OR:
+  case BIT_NOT:
+  case XOR:
+  case NEG:
+  case INDEX:
+  case SLICE:
+  case LEN:
+    return true;
+  default:
+    return is_typed_arithmetic(op) || is_typed_comparison(op);
+  }
+}
+
+// Instructions that may change a list or map in place, which a value
+// computed from it before may no longer match.
+static bool mutates(uint16_t op) {
+  return op == APPEND || op == SORT || op == SET || op == DELETE ||
+         op == CALL;
+}
+
+struct Occurrence {
+  uint32_t start;
+  uint32_t end;
+};
+
+// Finds the expression repeated in one block whose reuse saves the most
+// instructions, computes it once into a new local and loads that instead.
+static bool eliminate_subexpression(Function &function) {
+  const vector<Inst> &code = function.code;
+  vector<Occurrence> best;
+  int best_saving = 0;
+  for (const Block &block : blocks(function)) {
+    vector<uint32_t> starts = tree_starts(code, block.begin, block.end);
+    std::unordered_map<string, vector<Occurrence>> seen;
+    for (uint32_t i = block.begin; i < block.end; i++) {
+      uint32_t start = starts[i - block.begin];
+      if (start == OUTSIDE || start == i)
+        continue;
+      bool pure = true;
+      string key;
+      for (uint32_t j = start; j <= i && pure; j++) {
+        pure = is_pure(code[j].op);
+        key.append(reinterpret_cast<const char *>(&code[j].op),
+                   sizeof(code[j].op));
+        key.append(reinterpret_cast<const char *>(&code[j].operand),
+                   sizeof(code[j].operand));
+      }
+      if (pure)
+        seen[key].push_back({start, i + 1});
+    }
+
+    for (auto &[key, all] : seen) {
+      // Later occurrences are reused while no local the expression loads
+      // is stored to since the first.
+      vector<Occurrence> reused = {all[0]};
+      const Occurrence &first = all[0];
+      for (size_t k = 1; k < all.size(); k++) {
+        if (all[k].start < reused.back().end)
+          continue;
+        bool stored = false;
+        for (uint32_t j = reused.back().end; j < all[k].start && !stored; j++)
+          for (uint32_t l = first.start; l < first.end && !stored; l++)
+            stored = (code[j].op == STORE && code[l].op == LOAD &&
+                      code[j].operand == code[l].operand) ||
+                     mutates(code[j].op);
+        if (stored)
+          break;
+        reused.push_back(all[k]);
+      }
+      // Each reuse saves the expression but a LOAD, and the first pays a
+      // STORE and a LOAD.
+      int size = first.end - first.start;
+      int saving = (size - 1) * static_cast<int>(reused.size() - 1) - 2;
+      if (saving > best_saving) {
+        best_saving = saving;
+        best = std::move(reused);
+      }
+    }
+  }
+  if (best.empty())
+    return false;
+
+  uint32_t local = function.locals++;
+  vector<Inst> out(code.begin(), code.begin() + best[0].end);
+  out.push_back({STORE, local});
+  out.push_back({LOAD, local});
+  for (size_t k = 1; k < best.size(); k++) {
+    out.insert(out.end(), code.begin() + best[k - 1].end,
+               code.begin() + best[k].start);
+    out.push_back({LOAD, local});
+  }
+  out.insert(out.end(), code.begin() + best.back().end, code.end());
+  function.code = std::move(out);
+  return true;
+}
+
+static bool eliminate_common_subexpressions(Function &function) {
+  int replaced = 0;
+  while (replaced < MAX_SUBEXPRESSIONS && eliminate_subexpression(function))
+    replaced++;
+  return replaced > 0;
+}
+// }}}
+
+// Dead code elimination {{{
+static bool remove_unreachable(Function &function) {
+  vector<Block> graph = blocks(function);
+  vector<bool> reached(graph.size());
+  vector<uint32_t> work;
+  if (!graph.empty()) {
+    reached[0] = true;
+    work.push_back(0);
+  }
+  while (!work.empty()) {
+    uint32_t b = work.back();
+    work.pop_back();
+    for (uint32_t next : graph[b].successors)
+      if (!reached[next]) {
+        reached[next] = true;
+        work.push_back(next);
+      }
+  }
+
+  vector<Inst> code;
+  for (size_t b = 0; b < graph.size(); b++)
+    if (reached[b])
+      code.insert(code.end(), function.code.begin() + graph[b].begin,
+                  function.code.begin() + graph[b].end);
+  bool changed = code.size() != function.code.size();
+  function.code = std::move(code);
+  return changed;
+}
+
+// Points jumps to a JMP at its target instead, drops jumps to the next
+// instruction and labels nothing jumps to.
+static bool simplify_jumps(Function &function) {
+  vector<Inst> &code = function.code;
+  vector<uint32_t> positions(function.labels, OUTSIDE);
+  for (uint32_t i = 0; i < code.size(); i++)
+    if (code[i].op == LABEL)
+      positions[code[i].operand] = i;
+  // The first instruction at or after a label.
+  auto target = [&](uint32_t label) {
+    uint32_t i = positions[label];
+    while (i < code.size() && code[i].op == LABEL)
+      i++;
+    return i;
+  };
+
+  bool changed = false;
+  for (Inst &inst : code) {
+    if (!is_jump(inst.op))
+      continue;
+    // Chains of JMPs are followed a bounded number of hops, as they may
+    // loop.
+    for (int hops = 0; hops < 8; hops++) {
+      uint32_t next = target(inst.operand);
+      if (next == code.size() || code[next].op != JMP ||
+          code[next].operand == inst.operand)
+        break;
+      inst.operand = code[next].operand;
+      changed = true;
+    }
+  }
+
+  vector<bool> used(function.labels);
+  vector<Inst> out;
+  for (uint32_t i = 0; i < code.size(); i++) {
+    uint32_t next = i + 1;
+    while (next < code.size() && code[next].op == LABEL)
+      next++;
+    if (code[i].op == JMP && positions[code[i].operand] > i &&
+        target(code[i].operand) == next) {
+      changed = true;
+      continue;
+    }
+    out.push_back(code[i]);
+    if (is_jump(code[i].op))
+      used[code[i].operand] = true;
+  }
+  code.clear();
+  for (const Inst &inst : out) {
+    if (inst.op == LABEL && !used[inst.operand]) {
+      changed = true;
+      continue;
+    }
+    code.push_back(inst);
+  }
+  return changed;
+}
+
+// Turns stores into locals never loaded again into POPs, then drops values
+// computed only to be popped, where computing them has no effect.
+static bool remove_dead_stores(Function &function) {
+  vector<Block> graph = blocks(function);
+  size_t count = function.locals;
+  vector<vector<bool>> used(graph.size(), vector<bool>(count));
+  vector<vector<bool>> defined(graph.size(), vector<bool>(count));
+  for (size_t b = 0; b < graph.size(); b++) {
+    for (uint32_t i = graph[b].begin; i < graph[b].end; i++) {
+      const Inst &inst = function.code[i];
+      if (inst.op == LOAD && !defined[b][inst.operand])
+        used[b][inst.operand] = true;
+      else if (inst.op == STORE)
+        defined[b][inst.operand] = true;
+    }
+  }
+
+  // Locals live on exit from each block, to a fixpoint.
+  vector<vector<bool>> live_out(graph.size(), vector<bool>(count));
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t b = graph.size(); b-- > 0;) {
+      vector<bool> live(count);
+      for (uint32_t next : graph[b].successors)
+        for (size_t i = 0; i < count; i++)
+          if (used[next][i] || (live_out[next][i] && !defined[next][i]))
+            live[i] = true;
+      if (live != live_out[b]) {
+        live_out[b] = std::move(live);
+        changed = true;
+      }
+    }
+  }
+
+  bool changed = false;
+  for (size_t b = 0; b < graph.size(); b++) {
+    vector<bool> live = live_out[b];
+    for (uint32_t i = graph[b].end; i-- > graph[b].begin;) {
+      Inst &inst = function.code[i];
+      if (inst.op == STORE && !live[inst.operand]) {
+        inst = {POP};
+        changed = true;
+      } else if (inst.op == STORE) {
+        live[inst.operand] = false;
+      } else if (inst.op == LOAD) {
+        live[inst.operand] = true;
+      }
+    }
+  }
+
+  vector<TypeName> loads = load_types(function);
+  Rebuild code(function);
+  for (uint32_t i = 0; i < function.code.size(); i++) {
+    const Inst &inst = function.code[i];
+    if (inst.op == LABEL || (!code.out.empty() &&
+                             (is_jump(code.out.back().op) ||
+                              ends_flow(code.out.back().op))))
+      code.block();
+    uint32_t start = code.operand(0);
+    if (inst.op == POP && start != OUTSIDE && code.fact(0).safe &&
+        std::all_of(code.out.begin() + start, code.out.end(),
+                    [](const Inst &inst) { return is_pure(inst.op); })) {
+      code.out.resize(start);
+      code.stack.pop_back();
+      changed = true;
+      continue;
+    }
+    code.emit(inst, loads[i]);
+  }
+  function.code = std::move(code.out);
+  return changed;
+}
+
+// Drops the slots of locals that are neither loaded nor stored any more.
+static bool remove_unused_locals(Function &function) {
+  vector<bool> used(function.locals);
+  for (const Inst &inst : function.code)
+    if (inst.op == LOAD || inst.op == STORE)
+      used[inst.operand] = true;
+
+  vector<uint32_t> slots(function.locals);
+  uint32_t locals = 0;
+  for (uint32_t i = 0; i < function.locals; i++) {
+    slots[i] = locals;
+    if (i < function.params || used[i])
+      locals++;
+  }
+  if (locals == function.locals)
+    return false;
+
+  for (Inst &inst : function.code)
+    if (inst.op == LOAD || inst.op == STORE)
+      inst.operand = slots[inst.operand];
+  function.locals = locals;
+  return true;
+}
+
+static bool eliminate_dead_code(Function &function) {
+  bool changed = remove_unreachable(function);
+  changed |= simplify_jumps(function);
+  changed |= remove_dead_stores(function);
+  changed |= remove_unused_locals(function);
+  return changed;
+}
+// }}}
+
+bool Optimizer::run(const char *pass, bool (*body)(Function &),
+                    Function &function) {
+  PhaseTimer timer(report, pass);
+  return body(function);
+}
+
+void Optimizer::optimize(Function &function) {
+  if (level <= 0)
+    return;
+  run("short-circuit lowering", lower_short_circuits, function);
+  for (int round = 0; round < MAX_ROUNDS; round++) {
+    bool changed = run("constant propagation", propagate_constants, function);
+    changed |= run("strength reduction", reduce_strength, function);
+    if (level >= 2)
+      changed |= run("common subexpressions", eliminate_common_subexpressions,
+                     function);
+    changed |= run("dead code elimination", eliminate_dead_code, function);
+    if (!changed)
+      break;
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef OPTIMIZER_H
+#define OPTIMIZER_H
+
+#include "ir.h"
+#include "time_report.h"
+
+// Rewrites functions into code that does the same with fewer instructions,
+// at a level chosen like a C compiler's -O:
+//
+//   0  leaves the code as generated;
+//   1  lowers && and || in conditions to jumps, propagates and folds
+//      constants, reduces the strength of arithmetic and eliminates dead
+//      code;
+//   2  also eliminates common subexpressions.
+//
+// The rewrites don't rely on the types the checker inferred, which nothing
+// enforces on arguments or results at run time, but on those the optimizer
+// proves from the constants in the code.
+class Optimizer {
+public:
+  const int level;
+
+  explicit Optimizer(int level, TimeReport *report = nullptr)
+      : level(level), report(report) {}
+
+  void optimize(Function &function);
+
+private:
+  TimeReport *report;
+
+  bool run(const char *pass, bool (*body)(Function &), Function &function);
+};
+
+#endif // OPTIMIZER_H
@@ -0,0 +1,449 @@
+#include "parser.h"
+
+// Binding power of a binary operator, 0 for tokens that are not one. Higher
+// binds tighter; everything is left associative.
+static int precedence(TokenType type, Op &op) {
+  switch (type) {
+  case TokenType::LOG_OR:
+    op = Op::LOG_OR;
+    return 1;
+  case TokenType::LOG_AND:
+    op = Op::LOG_AND;
+    return 2;
+  case TokenType::BIT_OR:
+    op = Op::BIT_OR;
+    return 3;
+  case TokenType::CARRET:
+    op = Op::XOR;
+    return 4;
+  case TokenType::BIT_AND:
+    op = Op::BIT_AND;
+    return 5;
+  case TokenType::EQ:
+    op = Op::EQ;
+    return 6;
+  case TokenType::NOT_EQ:
+    op = Op::NEQ;
+    return 6;
+  case TokenType::LESS:
+    op = Op::LT;
+    return 7;
+  case TokenType::LESS_EQ:
+    op = Op::LTE;
+    return 7;
+  case TokenType::GREATER:
+    op = Op::GT;
+    return 7;
+  case TokenType::GREATER_EQ:
+    op = Op::GTE;
+    return 7;
+  case TokenType::PLUS:
+    op = Op::ADD;
+    return 8;
+  case TokenType::MINUS:
+    op = Op::SUB;
+    return 8;
+  case TokenType::ASTERISK:
+    op = Op::MUL;
+    return 9;
+  case TokenType::SLASH:
+    op = Op::DIV;
+    return 9;
+  case TokenType::MODULO:
+    op = Op::MOD;
+    return 9;
+  default:
+    return 0;
+  }
+}
+
+uint32_t Parser::here() const {
+  return at_end() ? tokens.source.size() : tokens.start(pos);
+}
+
+// Comments swallow the newline that ends them, so a token on a later row
+// than the one before it also starts a new statement.
+bool Parser::ends_statement() const {
+  if (at_end() || is(TokenType::NEWLINE) || is_word("end") ||
+      is_keyword(KW_ELSE))
+    return true;
+  return pos > 0 && tokens.row_at(tokens.start(pos)) >
+                        tokens.row_at(tokens.offsets[pos - 1] +
+                                      tokens.lengths[pos - 1]);
+}
+
+void Parser::fail(uint32_t offset, string message) const {
+  throw ParseError{offset, std::move(message)};
+}
+
+void Parser::report(const ParseError &error) {
+  errors.push_back(to_string(tokens.row_at(error.offset)) + ":" +
+                   to_string(tokens.col_at(error.offset)) + " " +
+                   error.message);
+}
+
+void Parser::expect(TokenType type, const char *what) {
+  if (!is(type))
+    fail(here(), string("expected ") + what);
+  pos++;
+}
+
+void Parser::expect_word(string_view word) {
+  if (!is_word(word))
+    fail(here(), "expected '" + string(word) + "'");
+  pos++;
+}
+
+void Parser::end_statement() {
+  if (!ends_statement())
+    fail(here(), "expected the end of the line");
+  skip_newlines();
+}
+
+void Parser::skip_newlines() {
+  while (is(TokenType::NEWLINE))
+    pos++;
+}
+
+void Parser::synchronize() {
+  while (!at_end() && !is(TokenType::NEWLINE))
+    pos++;
+  skip_newlines();
+}
+
+NodeList Parser::take_list(size_t base) {
+  NodeList list = ast.make_list(scratch.data() + base, scratch.size() - base);
+  scratch.resize(base);
+  return list;
+}
+
+void Parser::parse() {
+  Node *program = ast.make(NodeKind::PROGRAM, 0);
+  size_t base = scratch.size();
+  skip_newlines();
+  while (!at_end()) {
+    size_t mark = scratch.size();
+    try {
+      if (is_keyword(KW_FN))
+        scratch.push_back(function());
+      else if (is_word("import"))
+        scratch.push_back(import());
+      else
+        fail(here(), "expected a function or an import");
+    } catch (const ParseError &error) {
+      report(error);
+      scratch.resize(mark);
+      // Skip the rest of the declaration, up to a line that starts another.
+      synchronize();
+      while (!at_end() && !is_keyword(KW_FN) && !is_word("import"))
+        synchronize();
+    }
+  }
+  program->list = take_list(base);
+  ast.root = program;
+}
+
+Node *Parser::import() {
+  Node *node = ast.make(NodeKind::IMPORT, here());
+  pos++;
+  if (!is(TokenType::STRING))
+    fail(here(), "expected the module to import, as a string");
+  node->text = tokens.text(pos++);
+  end_statement();
+  return node;
+}
+
+Node *Parser::function() {
+  Node *node = ast.make(NodeKind::FUNCTION, here());
+  pos++;
+  if (!is(TokenType::IDENTIFIER))
+    fail(here(), "expected the function's name");
+  node->text = tokens.text(pos++);
+
+  expect(TokenType::LPAREN, "'('");
+  size_t base = scratch.size();
+  while (!is(TokenType::RPAREN)) {
+    if (scratch.size() > base)
+      expect(TokenType::COMMA, "',' or ')'");
+    if (!is(TokenType::IDENTIFIER))
+      fail(here(), "expected a parameter name");
+    Node *param = ast.make(NodeKind::PARAM, here());
+    param->text = tokens.text(pos++);
+    expect(TokenType::COLON, "':' and the parameter's type");
+    param->type = type();
+    scratch.push_back(param);
+  }
+  pos++;
+  node->list = take_list(base);
+
+  if (is(TokenType::COLON)) {
+    pos++;
+    node->type = type();
+  }
+  end_statement();
+  node->right = block();
+  expect_word("end");
+  end_statement();
+  return node;
+}
+
+TypeRef Parser::type() {
+  TypeRef result;
+  switch (at_end() ? NO_KEYWORD : tokens.keywords[pos]) {
+  case KW_INT:
+    result.name = TypeName::INT;
+    break;
+  case KW_FLOAT:
+    result.name = TypeName::FLOAT;
+    break;
+  case KW_STR:
+    result.name = TypeName::STR;
+    break;
+  case KW_BOOL:
+    result.name = TypeName::BOOL;
+    break;
+  default:
+    fail(here(), "expected a type");
+  }
+  pos++;
+  while (is(TokenType::LBRACKET)) {
+    pos++;
+    expect(TokenType::RBRACKET, "']'");
+    result.lists++;
+  }
+  return result;
+}
+
+Node *Parser::block() {
+  Node *node = ast.make(NodeKind::BLOCK, here());
+  size_t base = scratch.size();
+  skip_newlines();
+  while (!at_end() && !is_word("end") && !is_keyword(KW_ELSE)) {
+    size_t mark = scratch.size();
+    try {
+      scratch.push_back(statement());
+    } catch (const ParseError &error) {
+      report(error);
+      scratch.resize(mark);
+      synchronize();
+    }
+  }
+  node->list = take_list(base);
+  return node;
+}
+
+Node *Parser::statement() {
+  uint32_t offset = here();
+  Node *node;
+  switch (tokens.keywords[pos]) {
+  case KW_IF:
+    return if_statement();
+  case KW_WHILE:
+    return while_statement();
+  case KW_BREAK:
+  case KW_CONTINUE:
+    node = ast.make(tokens.keywords[pos] == KW_BREAK ? NodeKind::BREAK
+                                                     : NodeKind::CONTINUE,
+                    offset);
+    pos++;
+    break;
+  case KW_RETURN:
+    node = ast.make(NodeKind::RETURN, offset);
+    pos++;
+    if (!ends_statement())
+      node->left = expression();
+    break;
+  case KW_FOR:
+    fail(offset, "for loops are not supported yet");
+  case KW_FN:
+    fail(offset, "functions can only be declared at the top level");
+  default:
+    if (is(TokenType::IDENTIFIER) && pos + 1 < tokens.size() &&
+        tokens.types[pos + 1] == TokenType::ASSIGN) {
+      node = ast.make(NodeKind::ASSIGN, offset);
+      node->text = tokens.text(pos);
+      pos += 2;
+      node->left = expression();
+    } else {
+      node = ast.make(NodeKind::EXPRESSION, offset);
+      node->left = expression();
+    }
+  }
+  end_statement();
+  return node;
+}
+
+// `else if` chains share the `end` of the first `if`, which the innermost
+// one consumes.
+Node *Parser::if_statement() {
+  Node *node = ast.make(NodeKind::IF, here());
+  pos++;
+  node->left = expression();
+  end_statement();
+  node->right = block();
+  if (is_keyword(KW_ELSE)) {
+    pos++;
+    if (is_keyword(KW_IF)) {
+      node->extra = if_statement();
+      return node;
+    }
+    end_statement();
+    node->extra = block();
+  }
+  expect_word("end");
+  end_statement();
+  return node;
+}
+
+Node *Parser::while_statement() {
+  Node *node = ast.make(NodeKind::WHILE, here());
+  pos++;
+  node->left = expression();
+  end_statement();
+  node->right = block();
+  expect_word("end");
+  end_statement();
+  return node;
+}
+
+Node *Parser::expression(int min_precedence) {
+  Node *left = unary();
+  Op op = Op::NONE;
+  int power;
+  while (!at_end() &&
+         (power = precedence(tokens.types[pos], op)) > min_precedence) {
+    Node *node = ast.make(NodeKind::BINARY, here());
+    pos++;
+    node->op = op;
+    node->left = left;
+    node->right = expression(power);
+    left = node;
+  }
+  return left;
+}
+
+Node *Parser::unary() {
+  Op op = Op::NONE;
+  if (is(TokenType::MINUS))
+    op = Op::NEG;
+  else if (is(TokenType::BANG))
+    op = Op::LOG_NOT;
+  else if (is(TokenType::TILDA))
+    op = Op::BIT_NOT;
+  if (op == Op::NONE)
+    return postfix(primary());
+
+  Node *node = ast.make(NodeKind::UNARY, here());
+  pos++;
+  node->op = op;
+  node->left = unary();
+  return node;
+}
+
+Node *Parser::postfix(Node *node) {
+  while (true) {
+    uint32_t offset = here();
+    if (is(TokenType::LPAREN)) {
+      Node *call = ast.make(NodeKind::CALL, node->offset);
+      pos++;
+      size_t base = scratch.size();
+      skip_newlines();
+      while (!is(TokenType::RPAREN)) {
+        if (scratch.size() > base) {
+          expect(TokenType::COMMA, "',' or ')'");
+          skip_newlines();
+        }
+        scratch.push_back(expression());
+        skip_newlines();
+      }
+      pos++;
+      call->left = node;
+      call->list = take_list(base);
+      node = call;
+    } else if (is(TokenType::LBRACKET)) {
+      pos++;
+      Node *index = ast.make(NodeKind::INDEX, offset);
+      index->left = node;
+      index->right = expression();
+      if (is(TokenType::COLON)) {
+        pos++;
+        index->kind = NodeKind::SLICE;
+        index->extra = expression();
+      }
+      expect(TokenType::RBRACKET, "']'");
+      node = index;
+    } else if (is(TokenType::DOT)) {
+      pos++;
+      if (!is(TokenType::IDENTIFIER))
+        fail(here(), "expected a name after '.'");
+      Node *member = ast.make(NodeKind::MEMBER, offset);
+      member->left = node;
+      member->text = tokens.text(pos++);
+      node = member;
+    } else {
+      return node;
+    }
+  }
+}
+
+Node *Parser::primary() {
+  if (at_end())
+    fail(here(), "expected an expression");
+
+  uint32_t offset = here();
+  Node *node;
+  switch (tokens.types[pos]) {
+  case TokenType::INTEGER:
+    node = ast.make(NodeKind::INT_LITERAL, offset);
+    node->text = tokens.text(pos++);
+    return node;
+  case TokenType::FLOAT:
+    node = ast.make(NodeKind::FLOAT_LITERAL, offset);
+    node->text = tokens.text(pos++);
+    return node;
+  case TokenType::STRING:
+    // Only strings with escapes need a decoded copy.
+    node = ast.make(NodeKind::STRING_LITERAL, offset);
+    node->text = tokens.text(pos).find('\\') == string_view::npos
+                     ? tokens.text(pos)
+                     : ast.make_string(tokens.literal(pos));
+    pos++;
+    return node;
+  case TokenType::IDENTIFIER:
+    if (is_word("true") || is_word("false")) {
+      node = ast.make(NodeKind::BOOL_LITERAL, offset);
+    } else if (is_word("end")) {
+      fail(offset, "expected an expression");
+    } else {
+      node = ast.make(NodeKind::NAME, offset);
+    }
+    node->text = tokens.text(pos++);
+    return node;
+  case TokenType::LPAREN:
+    pos++;
+    skip_newlines();
+    node = expression();
+    skip_newlines();
+    expect(TokenType::RPAREN, "')'");
+    return node;
+  case TokenType::LBRACKET: {
+    node = ast.make(NodeKind::LIST_LITERAL, offset);
+    pos++;
+    size_t base = scratch.size();
+    skip_newlines();
+    while (!is(TokenType::RBRACKET)) {
+      if (scratch.size() > base) {
+        expect(TokenType::COMMA, "',' or ']'");
+        skip_newlines();
+      }
+      scratch.push_back(expression());
+      skip_newlines();
+    }
+    pos++;
+    node->list = take_list(base);
+    return node;
+  }
+  default:
+    fail(offset, "expected an expression");
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef PARSER_H
+#define PARSER_H
+
+#include "ast.h"
+#include "tokens.h"
+#include <vector>
+
+using std::vector;
+
+// Builds an Ast out of a token list. Statements are parsed by recursive
+// descent and expressions by precedence climbing: each binary operator has
+// a binding power and a single loop folds the operators that bind at least
+// as tightly as its caller, so no grammar rule exists per precedence level.
+class Parser {
+public:
+  vector<string> errors;
+
+  // The tokens, and the source they point into, must outlive the tree.
+  Parser(const TokenList &tokens, Ast &ast) : tokens(tokens), ast(ast) {}
+
+  // Parses the whole token list into ast.root, a PROGRAM node. A statement
+  // with an error is reported and skipped to the end of its line, so one
+  // pass finds every error.
+  void parse();
+
+private:
+  struct ParseError {
+    uint32_t offset;
+    string message;
+  };
+
+  const TokenList &tokens;
+  Ast &ast;
+  size_t pos = 0;
+  // Children of the lists being parsed. Nested lists push after their
+  // parents' children and pop back before the parents continue.
+  vector<Node *> scratch;
+
+  bool at_end() const { return pos >= tokens.size(); }
+  bool is(TokenType type) const {
+    return !at_end() && tokens.types[pos] == type;
+  }
+  bool is_keyword(Keyword keyword) const {
+    return !at_end() && tokens.keywords[pos] == keyword;
+  }
+  // `end`, `import`, `true` and `false` are lexed as identifiers.
+  bool is_word(string_view word) const {
+    return is(TokenType::IDENTIFIER) && tokens.text(pos) == word;
+  }
+  uint32_t here() const;
+  bool ends_statement() const;
+
+  [[noreturn]] void fail(uint32_t offset, string message) const;
+  void report(const ParseError &error);
+  void expect(TokenType type, const char *what);
+  void expect_word(string_view word);
+  void end_statement();
+  void skip_newlines();
+  void synchronize();
+  NodeList take_list(size_t base);
+
+  Node *function();
+  Node *import();
+  TypeRef type();
+  Node *block();
+  Node *statement();
+  Node *if_statement();
+  Node *while_statement();
+
+  Node *expression(int min_precedence = 0);
+  Node *unary();
+  Node *postfix(Node *node);
+  Node *primary();
+};
+
+#endif // PARSER_H
@@ -0,0 +1,113 @@
+#include "scan.h"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static bool is_blank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+static bool is_digit(char c) { return c >= '0' && c <= '9'; }
+static bool is_alnum(char c) {
+  return is_digit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+}
+static bool is_string_char(char c) {
+  return c != '"' && c != '\\' && c != '\n';
+}
+
+#if defined(__SSE2__)
+// Bytes of `x` in [lo, hi]. SSE2 only compares signed bytes, so the range
+// is shifted to start at 0 and tested with an unsigned minimum.
+static __m128i in_range(__m128i x, char lo, char hi) {
+  __m128i shifted = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+  __m128i width = _mm_set1_epi8(static_cast<char>(hi - lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(shifted, width), shifted);
+}
+
+static __m128i equal(__m128i x, char c) {
+  return _mm_cmpeq_epi8(x, _mm_set1_epi8(c));
+}
+
+// Advances `i` over whole blocks whose bytes all match `match`, stopping at
+// the first byte that does not.
+template <typename Match>
+static size_t skip_blocks(const char *data, size_t i, size_t size,
+                          Match match) {
+  for (; i + 16 <= size; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    uint32_t miss = ~_mm_movemask_epi8(match(x)) & 0xffff;
+    if (miss)
+      return i + __builtin_ctz(miss);
+  }
+  return i;
+}
+#endif
+
+size_t skip_blanks(const char *data, size_t i, size_t size) {
+#if defined(__SSE2__)
+  i = skip_blocks(data, i, size, [](__m128i x) {
+    __m128i controls = in_range(x, '\t', '\r');
+    return _mm_or_si128(equal(x, ' '),
+                        _mm_andnot_si128(equal(x, '\n'), controls));
+  });
+#endif
+  while (i < size && is_blank(data[i]))
+    i++;
+  return i;
+}
+
+size_t skip_alnum(const char *data, size_t i, size_t size) {
+#if defined(__SSE2__)
+  i = skip_blocks(data, i, size, [](__m128i x) {
+    __m128i lower = _mm_or_si128(x, _mm_set1_epi8(0x20));
+    return _mm_or_si128(in_range(x, '0', '9'), in_range(lower, 'a', 'z'));
+  });
+#endif
+  while (i < size && is_alnum(data[i]))
+    i++;
+  return i;
+}
+
+size_t skip_digits(const char *data, size_t i, size_t size) {
+#if defined(__SSE2__)
+  i = skip_blocks(data, i, size,
+                  [](__m128i x) { return in_range(x, '0', '9'); });
+#endif
+  while (i < size && is_digit(data[i]))
+    i++;
+  return i;
+}
+
+size_t skip_string_chars(const char *data, size_t i, size_t size) {
+#if defined(__SSE2__)
+  i = skip_blocks(data, i, size, [](__m128i x) {
+    __m128i stop = _mm_or_si128(_mm_or_si128(equal(x, '"'), equal(x, '\\')),
+                                equal(x, '\n'));
+    return _mm_cmpeq_epi8(stop, _mm_setzero_si128());
+  });
+#endif
+  while (i < size && is_string_char(data[i]))
+    i++;
+  return i;
+}
+
+size_t find_split(const char *data, size_t target, size_t size) {
+  for (size_t i = target < 2 ? 2 : target; i < size; i++) {
+    const void *newline = std::memchr(data + i - 1, '\n', size - i);
+    if (!newline)
+      break;
+    i = static_cast<const char *>(newline) - data + 1;
+    if (data[i - 2] != '\\' && data[i] != '\n')
+      return i;
+  }
+  return size;
+}
+
+void find_line_starts(const char *data, size_t size,
+                      std::vector<uint32_t> &starts) {
+  const char *end = data + size;
+  for (const char *p = data;
+       (p = static_cast<const char *>(std::memchr(p, '\n', end - p)));)
+    starts.push_back(++p - data);
+}
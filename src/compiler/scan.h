@@ -0,0 +1,32 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Block scanners for the lexer. Each returns the first index from `i` on
+// where the run it skips ends, or `size`. Sixteen bytes are classified at
+// a time with SSE2 where available, and the tail is finished one byte at a
+// time. Only ASCII letters and digits count, like isalnum in the C locale.
+
+// Spaces, tabs, carriage returns, vertical tabs and form feeds: whitespace
+// that is not a newline.
+size_t skip_blanks(const char *data, size_t i, size_t size);
+// Letters and digits.
+size_t skip_alnum(const char *data, size_t i, size_t size);
+size_t skip_digits(const char *data, size_t i, size_t size);
+// Anything but the '"', '\\' or '\n' that ends a run of string contents.
+size_t skip_string_chars(const char *data, size_t i, size_t size);
+
+// The first offset from `target` on where lexing can start over without
+// changing any token, or `size`. That is just after a newline, which ends
+// any comment or string, unless a backslash escapes it; the next byte must
+// not be a newline either, since only the last of a run is a token.
+size_t find_split(const char *data, size_t target, size_t size);
+
+// Appends the offset of every byte following a newline to `starts`.
+void find_line_starts(const char *data, size_t size,
+                      std::vector<uint32_t> &starts);
+
+#endif // SCAN_H
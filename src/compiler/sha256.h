@@ -0,0 +1,40 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+using std::string, std::string_view;
+
+struct Digest {
+  uint8_t bytes[32];
+
+  string hex() const;
+};
+
+// SHA-256, fed in pieces. Cache entries are named by the digest of
+// everything that went into them, so a collision would hand out the wrong
+// program; a cryptographic hash makes that a non-issue.
+class Sha256 {
+public:
+  Sha256();
+
+  void update(const void *data, size_t size);
+  void update(string_view data) { update(data.data(), data.size()); }
+  // Feeds the length first, so consecutive fields cannot run into each
+  // other: ("ab", "c") and ("a", "bc") hash differently.
+  void field(string_view data);
+  Digest finish();
+
+private:
+  uint32_t state[8];
+  uint8_t block[64];
+  size_t block_size = 0;
+  uint64_t length = 0;
+
+  void compress(const uint8_t *data);
+};
+
+#endif // SHA256_H
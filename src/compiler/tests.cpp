@@ -0,0 +1,889 @@
+#include "tests.h"
+#include "../loader.h"
+#include "../vm.h"
+#include "cache.h"
+#include "checker.h"
+#include "codegen.h"
+#include "driver.h"
+#include "lexer.h"
+#include "optimizer.h"
+#include "parser.h"
+#include "scan.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <ftw.h>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+struct Result {
+  bool passed;
+  string error;
+};
+
+// test_utils {{{
+void print_test_result(const string &test_name, const string &test,
+                       Result res) {
+  std::cout << "["
+            << (res.passed ? "\x1b[1;32mPASSED\x1b[0m"
+                           : "\x1b[1;31mFAILED\x1b[0m")
+            << "] \x1b[34m" << std::left << std::setw(18) << test_name
+            << "\x1b[0m " << test;
+  if (!res.passed) {
+    std::cout << "\n\t\x1b[33m" << res.error;
+  }
+  std::cout << "\x1b[0m" << std::endl;
+}
+
+// A program compiled at one -O level, or the errors compiling it gave.
+struct Compiled {
+  vector<uint8_t> bytecode;
+  vector<Object> const_pool;
+  string errors;
+};
+
+static Compiled compile(const string &source, int level) {
+  Compiled out;
+  Lexer lexer(source);
+  lexer.scan();
+  Ast ast;
+  Parser parser(lexer.token_list, ast);
+  parser.parse();
+  Checker checker(lexer.token_list);
+  Optimizer optimizer(level);
+  CodeGenerator generator(lexer.token_list, &optimizer);
+  for (auto *errors : {&lexer.errors, &parser.errors, &checker.errors}) {
+    if (out.errors.empty() && !errors->empty())
+      out.errors = errors->front();
+    if (errors == &parser.errors && out.errors.empty())
+      checker.check(ast.root);
+  }
+  if (!out.errors.empty())
+    return out;
+  generator.generate(ast.root);
+  if (!generator.errors.empty())
+    out.errors = generator.errors.front();
+  out.bytecode = generator.bytecode;
+  out.const_pool = generator.const_pool;
+  return out;
+}
+
+// What running the program leaves: its result's encoding, or "error: " and
+// the error the VM printed. The VM exits on a run-time error, so it runs in
+// a child process.
+static string run(const Compiled &program) {
+  if (!program.errors.empty())
+    return "compile error: " + program.errors;
+  int pipe_fds[2];
+  if (pipe(pipe_fds) != 0)
+    return "pipe failed";
+  pid_t child = fork();
+  if (child == 0) {
+    close(pipe_fds[0]);
+    dup2(pipe_fds[1], STDERR_FILENO);
+    VM vm(program.bytecode, program.const_pool);
+    vm.run();
+    vector<uint8_t> encoded;
+    encode_object(vm.pop(), encoded);
+    ssize_t wrote = write(pipe_fds[1], encoded.data(), encoded.size());
+    _exit(wrote == static_cast<ssize_t>(encoded.size()) ? 0 : 1);
+  }
+  close(pipe_fds[1]);
+  string result;
+  char buffer[256];
+  for (ssize_t got; (got = read(pipe_fds[0], buffer, sizeof(buffer))) > 0;)
+    result.append(buffer, got);
+  close(pipe_fds[0]);
+  int status = 0;
+  waitpid(child, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? result
+                                                       : "error: " + result;
+}
+
+static string encoded(const Object &value) {
+  vector<uint8_t> out;
+  encode_object(value, out);
+  return string(out.begin(), out.end());
+}
+
+// Whether the code has `inst`, and if `operand` is given, a PUSH of it
+// right before.
+static bool has_inst(const Compiled &program, uint8_t inst,
+                     const Object *operand = nullptr) {
+  const vector<uint8_t> &code = program.bytecode;
+  for (size_t pc = 0, last = 0; pc < code.size();
+       last = pc, pc += inst_length(code[pc])) {
+    if (code[pc] != inst)
+      continue;
+    if (operand == nullptr)
+      return true;
+    if (pc == 0 || code[last] != PUSH)
+      continue;
+    uint32_t index = code[last + 1] | code[last + 2] << 8 |
+                     code[last + 3] << 16 | code[last + 4] << 24;
+    vector<uint8_t> want, got;
+    encode_object(*operand, want);
+    encode_object(program.const_pool[index], got);
+    if (want == got)
+      return true;
+  }
+  return false;
+}
+// test_utils }}}
+
+// parallel_lex_test {{{
+// A source of at least PARALLEL_LEX_MIN bytes mixing code with what chunk
+// edges must not split: backslash-newlines, strings left unclosed at the
+// end of their line, comments and runs of newlines.
+static string awkward_source() {
+  const char *pieces[] = {
+      "fn f(x: Int): Int\n",  "  y = x * 0x1f + 1_000\n",
+      "  s = \"line\\\n",     "rest\"\n",
+      "  t = \"unclosed\n",   "\n\n\n",
+      "// comment \\\n",      "  return y\\\n",
+      "end\n",                "  z = 3.25 + \"esc\\n\\t\"\n",
+      "\\\n\\\n",             "  q = 1 @ 2\n",
+      "\n",                   "  w = x <= 2 && !(x != 3)\n"};
+  string source;
+  uint64_t state = 7;
+  while (source.size() < PARALLEL_LEX_MIN + (1 << 16)) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    source += pieces[(state >> 33) % std::size(pieces)];
+  }
+  return source;
+}
+
+void parallel_lex_test() {
+  string source = awkward_source();
+  Lexer serial(source);
+  serial.scan(1);
+  const TokenList &expected = serial.token_list;
+
+  for (unsigned threads : {2u, 3u, 4u, 7u, 16u}) {
+    Lexer parallel(source);
+    parallel.scan(threads);
+    const TokenList &got = parallel.token_list;
+    bool same = got.types == expected.types &&
+                got.offsets == expected.offsets &&
+                got.lengths == expected.lengths &&
+                got.keywords == expected.keywords;
+    print_test_result("parallel_lex_test",
+                      std::to_string(threads) +
+                          " threads lex the same tokens as 1",
+                      {same, "token lists differ"});
+    print_test_result("parallel_lex_test",
+                      std::to_string(threads) +
+                          " threads report the same errors as 1",
+                      {!serial.errors.empty() &&
+                           parallel.errors == serial.errors,
+                       "errors differ"});
+  }
+}
+// parallel_lex_test }}}
+
+// lexer_test {{{
+void position_test() {
+  string source = awkward_source();
+  Lexer lexer(source);
+  lexer.scan();
+  const TokenList &tokens = lexer.token_list;
+  // Counts rows and columns a byte at a time up to each token's start.
+  int row = 1, col = 1;
+  size_t wrong = tokens.size(), offset = 0;
+  for (size_t i = 0; i < tokens.size() && wrong == tokens.size(); i++) {
+    for (; offset < tokens.start(i); offset++) {
+      col++;
+      if (source[offset] == '\n')
+        row++, col = 1;
+    }
+    if (tokens.row(i) != row || tokens.col(i) != col)
+      wrong = i;
+  }
+  print_test_result("lexer_test", "rows and columns match a naive count",
+                    {tokens.size() > 0 && wrong == tokens.size(),
+                     "token " + std::to_string(wrong) + " is misplaced"});
+}
+
+void keyword_test() {
+  vector<string> keywords, misses = {"f", "iff", "Integer", "returns", "els",
+                                     "While", "fnn", "continues"};
+  for (int k = KW_FN; k <= KW_CONTINUE; k++) {
+    string word(keyword_to_string(static_cast<Keyword>(k)));
+    keywords.push_back(word);
+    // Same length, first and last byte, so the same slot of the table.
+    string middle = word;
+    if (middle.size() > 2)
+      middle[1] = 'q';
+    string upper = word;
+    upper[0] ^= 0x20;
+    for (const string &miss : {middle, upper, word.substr(0, word.size() - 1),
+                               word + "s", "x" + word})
+      if (std::find(keywords.begin(), keywords.end(), miss) == keywords.end())
+        misses.push_back(miss);
+  }
+  bool hits = true;
+  for (int k = KW_FN; k <= KW_CONTINUE; k++)
+    hits = hits && keyword_id(keywords[k - 1]) == k;
+  string missed;
+  for (const string &miss : misses)
+    if (keyword_id(miss) != NO_KEYWORD)
+      missed = miss;
+  print_test_result("lexer_test", "every keyword is found by its hash",
+                    {hits, "a keyword was not found"});
+  print_test_result("lexer_test", "near misses of keywords are identifiers",
+                    {missed.empty(), "'" + missed + "' was a keyword"});
+
+  // The lexer tells them apart the same way.
+  string source;
+  for (const vector<string> *words : {&keywords, &misses})
+    for (const string &word : *words)
+      source += word + " ";
+  Lexer lexer(source);
+  lexer.scan();
+  const TokenList &tokens = lexer.token_list;
+  bool lexed = tokens.size() == keywords.size() + misses.size();
+  for (size_t i = 0; lexed && i < tokens.size(); i++) {
+    Keyword keyword = i < keywords.size() ? static_cast<Keyword>(i + 1)
+                                          : NO_KEYWORD;
+    lexed = tokens.types[i] == (keyword ? TokenType::KEYWORD
+                                        : TokenType::IDENTIFIER) &&
+            tokens.keywords[i] == keyword;
+  }
+  print_test_result("lexer_test", "the lexer tells keywords from near misses",
+                    {lexed, "a token has the wrong type"});
+}
+
+// A block scanner, what it skips a byte at a time, bytes it runs over and
+// bytes that must stop it.
+struct Scanner {
+  const char *name;
+  size_t (*skip)(const char *data, size_t i, size_t size);
+  bool (*runs)(unsigned char c);
+  string run, stops;
+};
+
+void scan_test() {
+  using namespace std::string_literals;
+  Scanner scanners[] = {
+      {"skip_blanks", skip_blanks,
+       [](unsigned char c) {
+         return c == ' ' || (c >= '\t' && c <= '\r' && c != '\n');
+       },
+       " \t\r\v\f", "\n\b\x0e!a\x80\xa0"},
+      {"skip_alnum", skip_alnum,
+       [](unsigned char c) { return std::isalnum(c) != 0; }, "azAZ09mQ5",
+       "/:@[`{_ \x80\xc1\xe1"},
+      {"skip_digits", skip_digits,
+       [](unsigned char c) { return std::isdigit(c) != 0; }, "0123456789",
+       "/:a \x80\xb0"},
+      {"skip_string_chars", skip_string_chars,
+       [](unsigned char c) { return c != '"' && c != '\\' && c != '\n'; },
+       "a \t\x7f\x80\xff!#[]'"s, "\"\\\n"},
+  };
+  for (const Scanner &scanner : scanners) {
+    // Runs of each length up to past two blocks, starting at each offset
+    // in a block, ended by each stop byte or by the end of the buffer.
+    string wrong;
+    for (size_t start = 0; start < 17 && wrong.empty(); start++)
+      for (size_t length = 0; length < 40 && wrong.empty(); length++)
+        for (size_t stop = 0; stop <= scanner.stops.size(); stop++) {
+          string buffer(start, scanner.stops[0]);
+          for (size_t i = 0; i < length; i++)
+            buffer += scanner.run[(start + i) % scanner.run.size()];
+          if (stop < scanner.stops.size())
+            buffer += scanner.stops[stop] + scanner.run + scanner.run;
+          size_t expected = start;
+          while (expected < buffer.size() && scanner.runs(buffer[expected]))
+            expected++;
+          if (scanner.skip(buffer.data(), start, buffer.size()) != expected) {
+            wrong = "a run of " + std::to_string(length) + " from " +
+                    std::to_string(start);
+            break;
+          }
+        }
+    print_test_result("lexer_test",
+                      string(scanner.name) + " matches a byte-wise scan",
+                      {wrong.empty(), wrong + " ends elsewhere"});
+  }
+}
+// lexer_test }}}
+
+// optimizer_test {{{
+void optimizer_equivalence_test() {
+  const char *programs[][2] = {
+      {"loops and folding",
+       "fn g(n: Int): Int\n"
+       "  total = 0\n"
+       "  i = 0\n"
+       "  unused = 5\n"
+       "  while i < n\n"
+       "    j = i * 2 + 1\n"
+       "    if i < 3 && j > 2 || i == 7\n"
+       "      total = total + j * j + j * j\n"
+       "    end\n"
+       "    i = i + 1\n"
+       "  end\n"
+       "  z = 3 * 4 - 20 + 2\n"
+       "  if z < 0\n"
+       "    total = total + z\n"
+       "  end\n"
+       "  return total\n"
+       "end\n"
+       "fn main(): Int\n"
+       "  return g(12) + g(0)\n"
+       "end\n"},
+      {"float arithmetic",
+       "fn f(x: Float, n: Int): Float\n"
+       "  a = x / 4\n"
+       "  b = a * 1.0 - 0.0\n"
+       "  d = 2 * x + 3\n"
+       "  y = x * x + x * x + x * x\n"
+       "  if n + 0 > 3 && 1 * n < 100 && !(x < 0.0)\n"
+       "    return y + d + b\n"
+       "  end\n"
+       "  if n == 1 || x > 2.5\n"
+       "    return y / 3\n"
+       "  end\n"
+       "  return -0.0 + b\n"
+       "end\n"
+       "fn main(): Float\n"
+       "  return f(1.5, 5) + f(3.0, 1) + f(-1.0, 200) + f(0.25, 0)\n"
+       "end\n"},
+      {"conditions",
+       "fn k(a: Bool, b: Bool): Int\n"
+       "  r = 0\n"
+       "  if a && b\n"
+       "    r = r + 1\n"
+       "  end\n"
+       "  if a || b\n"
+       "    r = r + 10\n"
+       "  end\n"
+       "  if !(a && !b)\n"
+       "    r = r + 100\n"
+       "  end\n"
+       "  if !a || !b && a\n"
+       "    r = r + 1000\n"
+       "  end\n"
+       "  return r\n"
+       "end\n"
+       "fn main(): Int\n"
+       "  return k(true, true) + 2 * k(true, false) + 3 * k(false, true)"
+       " + 5 * k(false, false)\n"
+       "end\n"},
+      {"lists and strings",
+       "fn h(s: Str, l: Int[]): Int\n"
+       "  n = 0\n"
+       "  i = 0\n"
+       "  while i < len(l)\n"
+       "    if l[i] > 2 && l[i] < 9\n"
+       "      n = n + l[i] + l[i] + l[i]\n"
+       "    end\n"
+       "    l = append(l, 0)\n"
+       "    if len(l) > 8\n"
+       "      break\n"
+       "    end\n"
+       "    i = i + 1\n"
+       "  end\n"
+       "  if s == \"ab\" && s != \"x\"\n"
+       "    n = n + 1000\n"
+       "  end\n"
+       "  return n + len(l)\n"
+       "end\n"
+       "fn main(): Int\n"
+       "  return h(\"ab\", [1, 3, 5, 9, 4]) + h(\"q\", [])\n"
+       "end\n"},
+      // Declared types are not checked at run time, so `x` is an Int in
+      // scale and a Str in twice, and neither may be taken for a Float.
+      {"arguments of other types than declared",
+       "fn any(b: Bool)\n"
+       "  if b\n"
+       "    return 2\n"
+       "  end\n"
+       "  return \"ab\"\n"
+       "end\n"
+       "fn scale(x: Float): Float\n"
+       "  return x + 1\n"
+       "end\n"
+       "fn twice(x: Float): Float\n"
+       "  return x * 2\n"
+       "end\n"
+       "fn main(): Bool\n"
+       "  return scale(any(true)) == 3 && len(twice(any(false))) == 4\n"
+       "end\n"},
+      {"failing arguments of other types than declared",
+       "fn any(b: Bool)\n"
+       "  if b\n"
+       "    return 2\n"
+       "  end\n"
+       "  return \"ab\"\n"
+       "end\n"
+       "fn f(y: Int, a: Bool): Int\n"
+       "  if a || y > 2\n"
+       "    return y * 1 + 0\n"
+       "  end\n"
+       "  return 0\n"
+       "end\n"
+       "fn main(): Int\n"
+       "  return f(any(false), true)\n"
+       "end\n"},
+      {"run-time error",
+       "fn main(): Int\n"
+       "  x = 0\n"
+       "  if x == 0 || [1][x + 1] > 0\n"
+       "    return [1][x + 2]\n"
+       "  end\n"
+       "  return 1\n"
+       "end\n"},
+  };
+
+  for (auto [name, source] : programs) {
+    Compiled unoptimized = compile(source, 0);
+    string expected = run(unoptimized);
+    string got = run(compile(source, 2));
+    print_test_result("optimizer_test",
+                      string(name) + ": same result at -O0 and -O2",
+                      {unoptimized.errors.empty() && got == expected,
+                       unoptimized.errors.empty()
+                           ? "results differ"
+                           : "does not compile: " + unoptimized.errors});
+  }
+}
+
+// The rewrites need operands of types proven from constants: `x` is a Float
+// and `i` an Int in every loop below whatever the arguments are.
+void optimizer_rewrite_test() {
+  const Object quarter(FLOAT, 0.25);
+  Compiled divide = compile("fn f(n: Int): Float\n"
+                            "  x = 1.0\n"
+                            "  i = 0\n"
+                            "  while i < n\n"
+                            "    x = x / 4\n"
+                            "    i = i + 1\n"
+                            "  end\n"
+                            "  return x\n"
+                            "end\n"
+                            "fn main(): Float\n"
+                            "  return f(2)\n"
+                            "end\n",
+                            1);
+  print_test_result("optimizer_test", "x / 4 becomes x * 0.25",
+                    {has_inst(divide, MUL_FLOAT, &quarter) &&
+                         !has_inst(divide, DIV) && !has_inst(divide, DIV_FLOAT),
+                     "no MUL_FLOAT by 0.25 in place of the division"});
+
+  // x + 0.0 is -0.0 + 0.0 = 0.0 for x = -0.0, so only x - 0.0 is x.
+  const Object zero(FLOAT, 0.0);
+  Compiled identities = compile("fn f(n: Int): Float\n"
+                                "  x = -1.5\n"
+                                "  i = 0\n"
+                                "  while i < n\n"
+                                "    x = (x - 0.0) * (x + 0.0)\n"
+                                "    i = i + 1\n"
+                                "  end\n"
+                                "  return x\n"
+                                "end\n"
+                                "fn main(): Float\n"
+                                "  return f(2)\n"
+                                "end\n",
+                                1);
+  print_test_result("optimizer_test", "x - 0.0 is dropped, x + 0.0 is kept",
+                    {!has_inst(identities, SUB_FLOAT) &&
+                         has_inst(identities, ADD_FLOAT, &zero),
+                     "wrong float identities removed"});
+
+  // Nothing proves the type of a parameter.
+  const Object one(FLOAT, 1.0);
+  Compiled parameter = compile("fn f(x: Float): Float\n"
+                               "  return (x + 1) * 1.0 - 0.0\n"
+                               "end\n"
+                               "fn main(): Float\n"
+                               "  return f(2.0)\n"
+                               "end\n",
+                               1);
+  print_test_result("optimizer_test",
+                    "a Float parameter's operations are left alone",
+                    {!has_inst(parameter, ADD_FLOAT, &one) &&
+                         has_inst(parameter, MUL_FLOAT) &&
+                         has_inst(parameter, SUB_FLOAT),
+                     "rewritten on the declared type"});
+
+  Compiled safe = compile("fn f(a: Bool, n: Int): Int\n"
+                          "  r = 0\n"
+                          "  i = 0\n"
+                          "  while i < n\n"
+                          "    if a || i > 2\n"
+                          "      r = r + 1\n"
+                          "    end\n"
+                          "    i = i + 1\n"
+                          "  end\n"
+                          "  return r\n"
+                          "end\n"
+                          "fn main(): Int\n"
+                          "  return f(false, 5)\n"
+                          "end\n",
+                          1);
+  print_test_result("optimizer_test",
+                    "a || i > 2 skips the comparison when a is true",
+                    {!has_inst(safe, LOG_OR) && run(safe) == run(compile(
+                                                    "fn main(): Int\n"
+                                                    "  return 2\n"
+                                                    "end\n",
+                                                    0)),
+                     "LOG_OR left in or wrong result"});
+
+  // Indexing may fail, so it must still run when a is true.
+  Compiled unsafe = compile("fn f(a: Bool, y: Int): Int\n"
+                            "  if a || [1][y] > 0\n"
+                            "    return 1\n"
+                            "  end\n"
+                            "  return 0\n"
+                            "end\n"
+                            "fn main(): Int\n"
+                            "  return f(true, 5)\n"
+                            "end\n",
+                            1);
+  print_test_result("optimizer_test", "a || [1][y] > 0 still indexes",
+                    {has_inst(unsafe, LOG_OR) &&
+                         run(unsafe).rfind("error: ", 0) == 0,
+                     "the index was skipped"});
+}
+// optimizer_test }}}
+
+// checker_test {{{
+void typed_emission_test() {
+  Compiled loop = compile("fn main(): Int\n"
+                          "  i = 0\n"
+                          "  s = 0\n"
+                          "  while i < 10\n"
+                          "    s = s + i\n"
+                          "    i = i + 1\n"
+                          "  end\n"
+                          "  return s\n"
+                          "end\n",
+                          0);
+  print_test_result("checker_test", "a loop-carried Int emits ADD_INT, LT_INT",
+                    {has_inst(loop, ADD_INT) && has_inst(loop, LT_INT) &&
+                         !has_inst(loop, ADD) && !has_inst(loop, LT) &&
+                         run(loop) == encoded(Object(INTEGER, 45)),
+                     "generic instructions or a wrong result"});
+  Compiled mixed = compile("fn main(): Int\n"
+                           "  x = 1\n"
+                           "  if false\n"
+                           "    x = \"a\"\n"
+                           "  end\n"
+                           "  return x + 2\n"
+                           "end\n",
+                           0);
+  print_test_result("checker_test", "an Int and Str variable stays generic",
+                    {has_inst(mixed, ADD) && !has_inst(mixed, ADD_INT) &&
+                         run(mixed) == encoded(Object(INTEGER, 3)),
+                     "a typed instruction or a wrong result"});
+}
+
+void checker_error_test() {
+  std::pair<const char *, const char *> cases[] = {
+      {"fn f(p: Int): Int\n"
+       "  return p\n"
+       "end\n"
+       "fn main(): Int\n"
+       "  return f(1.5)\n"
+       "end\n",
+       "5:12 argument 1 of 'f' is Float, but 'p' is declared Int"},
+      {"fn main(): Int\n"
+       "  return \"a\"\n"
+       "end\n",
+       "2:3 'main' returns Str, but is declared to return Int"},
+      {"fn main(): Int\n"
+       "  if 1\n"
+       "    return 1\n"
+       "  end\n"
+       "  return 0\n"
+       "end\n",
+       "2:6 condition is Int, not Bool"},
+  };
+  for (auto [source, error] : cases) {
+    string errors = compile(source, 0).errors;
+    print_test_result("checker_test", error,
+                      {errors == error, "got '" + errors + "'"});
+  }
+}
+// checker_test }}}
+
+// codegen_test {{{
+void negation_test() {
+  const char *floats = "fn neg(x: Float): Float\n"
+                       "  return -x\n"
+                       "end\n"
+                       "fn main(): Float\n"
+                       "  return 1.0 / neg(0.0)\n"
+                       "end\n";
+  const char *ints = "fn neg(x: Int): Int\n"
+                     "  return -x\n"
+                     "end\n"
+                     "fn main(): Bool\n"
+                     "  return neg(-2147483648) == -2147483648\n"
+                     "end\n";
+  for (int level : {0, 1}) {
+    string at = " at -O" + std::to_string(level);
+    print_test_result("codegen_test", "1.0 / -x is -inf for x = 0.0" + at,
+                      {run(compile(floats, level)) ==
+                           encoded(Object(FLOAT, -INFINITY)),
+                       "the sign of zero was lost"});
+    print_test_result("codegen_test", "-x wraps for x = INT_MIN" + at,
+                      {run(compile(ints, level)) ==
+                           encoded(Object(BOOLEAN, true)),
+                       "wrong result"});
+  }
+}
+
+void literal_test() {
+  auto program = [](const string &literal) {
+    return compile("fn main(): Int\n  return " + literal + "\nend\n", 0);
+  };
+  std::pair<const char *, int> values[] = {
+      {"0xff", 255},
+      {"0b101", 5},
+      {"1_000_000", 1000000},
+      {"2147483647", INT32_MAX},
+      {"-2147483648", INT32_MIN},
+      {"0xffffffff", -1},
+  };
+  for (auto [literal, value] : values) {
+    string result = run(program(literal));
+    print_test_result("codegen_test",
+                      string(literal) + " is " + std::to_string(value),
+                      {result == encoded(Object(INTEGER, value)),
+                       "got '" + result + "'"});
+  }
+  for (const char *literal : {"2147483648", "0x1_0000_0000"}) {
+    string errors = program(literal).errors;
+    print_test_result("codegen_test", string(literal) + " is out of range",
+                      {errors.find("number '" + string(literal) +
+                                   "' is out of range") != string::npos,
+                       "got '" + errors + "'"});
+  }
+}
+// codegen_test }}}
+
+// cache_test {{{
+// The files in one kind of entry of a cache, with their inode numbers: an
+// entry that is written again gets a new inode.
+static std::map<string, ino_t> cache_entries(const string &dir,
+                                             const char *kind) {
+  std::map<string, ino_t> entries;
+  string subdir = dir + "/" + kind;
+  DIR *listing = opendir(subdir.c_str());
+  if (listing == nullptr)
+    return entries;
+  while (dirent *file = readdir(listing))
+    if (file->d_name[0] != '.')
+      entries[file->d_name] = file->d_ino;
+  closedir(listing);
+  return entries;
+}
+
+// Whether every entry of `before` is still in `after`, unchanged, and
+// `after` has `added` more.
+static bool kept(const std::map<string, ino_t> &before,
+                 const std::map<string, ino_t> &after, size_t added) {
+  return after.size() == before.size() + added &&
+         std::all_of(before.begin(), before.end(), [&](const auto &entry) {
+           auto found = after.find(entry.first);
+           return found != after.end() && found->second == entry.second;
+         });
+}
+
+static void write_text(const string &path, const string &text) {
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << text;
+}
+
+static void set_mtime(const string &path, time_t seconds) {
+  timespec times[2] = {{seconds, 0}, {seconds, 0}};
+  utimensat(AT_FDCWD, path.c_str(), times, 0);
+}
+
+static void remove_tree(const string &dir) {
+  nftw(
+      dir.c_str(),
+      [](const char *path, const struct stat *, int, FTW *) {
+        return remove(path);
+      },
+      16, FTW_DEPTH | FTW_PHYS);
+}
+
+void cache_reuse_test(const string &dir) {
+  string cache_dir = dir + "/cache";
+  // Compiles `source` through the cache and runs it.
+  auto build = [&](const string &source, int level) {
+    write_text(dir + "/main.clrt", source);
+    MappedFile file((dir + "/main.clrt").c_str());
+    Options options;
+    options.level = level;
+    CompileCache cache(cache_dir);
+    if (compile_cached(cache, file, options, dir + "/main.bin", nullptr) != 0)
+      return string("compile error");
+    File program = load_from_file(dir + "/main.bin");
+    return run({program.bytecode, program.const_pool, ""});
+  };
+  const string callers = "fn twice(x: Int): Int\n"
+                         "  return scale(x) + scale(x)\n"
+                         "end\n"
+                         "fn main(): Int\n"
+                         "  return twice(5)\n"
+                         "end\n";
+  const string source = "fn scale(x: Int): Int\n"
+                        "  return x * 2\n"
+                        "end\n" +
+                        callers;
+  const string edited = "fn scale(x: Int): Int\n"
+                        "  return x * 3\n"
+                        "end\n" +
+                        callers;
+  const string redeclared = "fn scale(x: Int)\n"
+                            "  return x * 3\n"
+                            "end\n" +
+                            callers;
+
+  string result = build(source, 1);
+  auto programs = cache_entries(cache_dir, "programs");
+  auto units = cache_entries(cache_dir, "units");
+  print_test_result("cache_test", "a first compile stores every unit",
+                    {result == encoded(Object(INTEGER, 20)) &&
+                         programs.size() == 1 && units.size() == 3,
+                     "wrong result or entries"});
+
+  result = build(source, 1);
+  print_test_result("cache_test", "an unchanged program is reused whole",
+                    {result == encoded(Object(INTEGER, 20)) &&
+                         kept(programs, cache_entries(cache_dir, "programs"),
+                              0) &&
+                         kept(units, cache_entries(cache_dir, "units"), 0),
+                     "an entry was written again"});
+
+  result = build(edited, 1);
+  auto edited_units = cache_entries(cache_dir, "units");
+  print_test_result("cache_test", "editing one function only recompiles it",
+                    {result == encoded(Object(INTEGER, 30)) &&
+                         kept(units, edited_units, 1),
+                     "wrong result or units recompiled"});
+
+  result = build(redeclared, 1);
+  auto redeclared_units = cache_entries(cache_dir, "units");
+  print_test_result("cache_test",
+                    "changing a signature recompiles every function",
+                    {result == encoded(Object(INTEGER, 30)) &&
+                         kept(edited_units, redeclared_units, 3),
+                     "wrong result or units reused"});
+
+  result = build(redeclared, 2);
+  print_test_result("cache_test", "another -O level recompiles every function",
+                    {result == encoded(Object(INTEGER, 30)) &&
+                         kept(redeclared_units,
+                              cache_entries(cache_dir, "units"), 3),
+                     "wrong result or units reused"});
+}
+
+void cache_eviction_test(const string &dir) {
+  string cache_dir = dir + "/small";
+  CompileCache cache(cache_dir, 1000);
+  vector<Digest> keys;
+  for (int i = 0; i < 10; i++) {
+    Sha256 hash;
+    hash.field(std::to_string(i));
+    keys.push_back(hash.finish());
+    cache.store("units", keys.back(), vector<uint8_t>(200, i));
+    // Last used one after the other, the first longest ago.
+    set_mtime(cache_dir + "/units/" + keys.back().hex(), 1000000 + i);
+  }
+  vector<uint8_t> data;
+  cache.load("units", keys[0], data);
+
+  string stale = cache_dir + "/units/" + keys[0].hex() + ".tmp.1.0";
+  string fresh = cache_dir + "/units/" + keys[0].hex() + ".tmp.1.1";
+  write_text(stale, "left by a compiler that died");
+  write_text(fresh, "still being written");
+  set_mtime(stale, time(nullptr) - 2 * 60 * 60);
+  cache.evict();
+
+  auto left = cache_entries(cache_dir, "units");
+  // 10 entries of 200 bytes outgrow 1000, so down to 900: the 4 used last.
+  bool lru = left.size() == 5;
+  for (int i : {0, 7, 8, 9})
+    lru = lru && left.count(keys[i].hex());
+  print_test_result("cache_test", "evicts the least recently used to 90%",
+                    {lru, "wrong entries evicted"});
+  print_test_result("cache_test", "deletes stale temporary files only",
+                    {!left.count(keys[0].hex() + ".tmp.1.0") &&
+                         left.count(keys[0].hex() + ".tmp.1.1"),
+                     "wrong temporary files deleted"});
+}
+
+void unit_decode_test() {
+  Unit unit;
+  unit.bytecode = {PUSH, 0, 0, 0, 0, CALL, 0, 0, 0, 0, 1, RET};
+  unit.constants = {Object(INTEGER, 7)};
+  unit.callees = {"f"};
+  vector<uint8_t> data;
+  unit.encode(data);
+
+  Unit decoded;
+  print_test_result("cache_test", "a unit decodes to what was encoded",
+                    {decoded.decode(data.data(), data.size()) &&
+                         decoded.bytecode == unit.bytecode &&
+                         decoded.callees == unit.callees &&
+                         decoded.constants.size() == 1,
+                     "decoded unit differs"});
+
+  vector<uint8_t> trailing = data;
+  trailing.push_back(0);
+  // The bytecode's PUSH operand, right after its length.
+  vector<uint8_t> bad_constant = data;
+  bad_constant[5] = 1;
+  vector<uint8_t> bad_callee = data;
+  bad_callee[10] = 1;
+  bool rejected = true;
+  for (size_t size = 0; size < data.size(); size++)
+    rejected = rejected && !decoded.decode(data.data(), size);
+  for (const auto *corrupt : {&trailing, &bad_constant, &bad_callee})
+    rejected = rejected && !decoded.decode(corrupt->data(), corrupt->size());
+  print_test_result("cache_test", "corrupt units are rejected",
+                    {rejected, "a corrupt unit decoded"});
+}
+
+void cache_test() {
+  char dir[] = "/tmp/clarity-cache-test-XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    print_test_result("cache_test", "temporary directory",
+                      {false, "mkdtemp failed"});
+    return;
+  }
+  cache_reuse_test(dir);
+  cache_eviction_test(dir);
+  remove_tree(dir);
+  unit_decode_test();
+}
+// cache_test }}}
+
+// tests {{{
+void tests() {
+  parallel_lex_test();
+  position_test();
+  keyword_test();
+  scan_test();
+  optimizer_equivalence_test();
+  optimizer_rewrite_test();
+  typed_emission_test();
+  checker_error_test();
+  negation_test();
+  literal_test();
+  cache_test();
+}
+// tests }}}
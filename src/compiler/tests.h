@@ -0,0 +1,6 @@
+#ifndef COMPILER_TESTS_H
+#define COMPILER_TESTS_H
+
+void tests();
+
+#endif // COMPILER_TESTS_H
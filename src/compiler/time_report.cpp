@@ -0,0 +1,46 @@
+#include "time_report.h"
+#include <iomanip>
+
+void TimeReport::charge(const std::pair<size_t, Clock::time_point> &phase,
+                        Clock::time_point now) {
+  std::chrono::duration<double, std::milli> elapsed = now - phase.second;
+  phases[phase.first].second += elapsed.count();
+}
+
+void TimeReport::start(const char *phase) {
+  Clock::time_point now = Clock::now();
+  if (!running.empty())
+    charge(running.back(), now);
+
+  size_t index = 0;
+  while (index < phases.size() && phases[index].first != phase)
+    index++;
+  if (index == phases.size())
+    phases.emplace_back(phase, 0.0);
+  running.emplace_back(index, Clock::now());
+}
+
+void TimeReport::stop() {
+  Clock::time_point now = Clock::now();
+  charge(running.back(), now);
+  running.pop_back();
+  if (!running.empty())
+    running.back().second = now;
+}
+
+void TimeReport::print(std::ostream &out) const {
+  double total = 0;
+  for (const auto &phase : phases)
+    total += phase.second;
+
+  std::ios::fmtflags flags = out.flags();
+  out << "\nExecution times (ms)\n" << std::fixed;
+  for (const auto &[name, ms] : phases)
+    out << " " << std::left << std::setw(26) << name << ": " << std::right
+        << std::setprecision(3) << std::setw(9) << ms << " ("
+        << std::setprecision(0) << std::setw(3)
+        << (total > 0 ? 100 * ms / total : 0) << "%)\n";
+  out << " " << std::left << std::setw(26) << "TOTAL" << ": " << std::right
+      << std::setprecision(3) << std::setw(9) << total << "\n";
+  out.flags(flags);
+}
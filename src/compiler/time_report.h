@@ -0,0 +1,51 @@
+#ifndef TIME_REPORT_H
+#define TIME_REPORT_H
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// The time a compile spends in each of its phases, printed after it like
+// GCC's -ftime-report. A phase that starts while another runs pauses it,
+// so each phase counts only its own time and the phases add up to the
+// whole. Phases add up every time they run, as the optimizer's passes do
+// once for every function, and are listed in the order they first ran.
+class TimeReport {
+public:
+  void start(const char *phase);
+  void stop();
+  void print(std::ostream &out) const;
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  std::vector<std::pair<std::string, double>> phases;
+  // The phases running, innermost last, and since when.
+  std::vector<std::pair<size_t, Clock::time_point>> running;
+
+  void charge(const std::pair<size_t, Clock::time_point> &phase,
+              Clock::time_point now);
+};
+
+// Times one run of `phase` of `report`, if there is one, for as long as it
+// lives.
+class PhaseTimer {
+public:
+  PhaseTimer(TimeReport *report, const char *phase) : report(report) {
+    if (report != nullptr)
+      report->start(phase);
+  }
+  ~PhaseTimer() {
+    if (report != nullptr)
+      report->stop();
+  }
+  PhaseTimer(const PhaseTimer &) = delete;
+  PhaseTimer &operator=(const PhaseTimer &) = delete;
+
+private:
+  TimeReport *report;
+};
+
+#endif // TIME_REPORT_H
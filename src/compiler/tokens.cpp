@@ -1,76 +1,216 @@
 #include "tokens.h"
+#include "scan.h"
+#include <algorithm>
+#include <array>
 
-string type_to_string(Type type) {
+string type_to_string(TokenType type) {
   switch (type) {
-  case DOT:
+  case TokenType::DOT:
     return "dot";
-  case NEWLINE:
+  case TokenType::NEWLINE:
     return "newline";
-  case KEYWORD:
+  case TokenType::KEYWORD:
     return "keyword";
-  case IDENTIFIER:
+  case TokenType::IDENTIFIER:
     return "identifier";
-  case INTEGER:
+  case TokenType::INTEGER:
     return "integer";
-  case FLOAT:
+  case TokenType::FLOAT:
     return "float";
-  case STRING:
+  case TokenType::STRING:
     return "string";
-  case LPAREN:
+  case TokenType::LPAREN:
     return "lparen";
-  case RPAREN:
+  case TokenType::RPAREN:
     return "rparen";
-  case LBRACKET:
+  case TokenType::LBRACKET:
     return "lbracket";
-  case RBRACKET:
+  case TokenType::RBRACKET:
     return "rbracket";
-  case LBRACE:
+  case TokenType::LBRACE:
     return "lbrace";
-  case RBRACE:
+  case TokenType::RBRACE:
     return "rbrace";
-  case COMMA:
+  case TokenType::COMMA:
     return "comma";
-  case COLON:
+  case TokenType::COLON:
     return "colon";
-  case PLUS:
+  case TokenType::PLUS:
     return "plus";
-  case MINUS:
+  case TokenType::MINUS:
     return "minus";
-  case ASTERISK:
+  case TokenType::ASTERISK:
     return "asterisk";
-  case SLASH:
+  case TokenType::SLASH:
     return "slash";
-  case CARRET:
+  case TokenType::CARRET:
     return "carret";
-  case TILDA:
+  case TokenType::TILDA:
     return "tilda";
-  case BANG:
+  case TokenType::BANG:
     return "bang";
-  case NOT_EQ:
+  case TokenType::NOT_EQ:
     return "not_eq";
-  case LESS:
+  case TokenType::LESS:
     return "less";
-  case LESS_EQ:
+  case TokenType::LESS_EQ:
     return "less_eq";
-  case GREATER:
+  case TokenType::GREATER:
     return "greater";
-  case GREATER_EQ:
+  case TokenType::GREATER_EQ:
     return "greater_eq";
-  case ASSIGN:
+  case TokenType::ASSIGN:
     return "assign";
-  case EQ:
+  case TokenType::EQ:
     return "eq";
-  case MODULO:
+  case TokenType::MODULO:
     return "modulo";
-  case BIT_AND:
+  case TokenType::BIT_AND:
     return "bit_and";
-  case LOG_AND:
+  case TokenType::LOG_AND:
     return "log_and";
-  case BIT_OR:
+  case TokenType::BIT_OR:
     return "bit_or";
-  case LOG_OR:
+  case TokenType::LOG_OR:
     return "log_or";
-  case COMMENT:
+  case TokenType::COMMENT:
     return "comment";
   }
+  return "unknown";
+}
+
+string TokenList::literal(size_t i) const {
+  switch (types[i]) {
+  case TokenType::KEYWORD:
+  case TokenType::IDENTIFIER:
+  case TokenType::INTEGER:
+  case TokenType::FLOAT:
+    return string(text(i));
+  case TokenType::STRING:
+    break;
+  default:
+    return "";
+  }
+
+  string_view raw = text(i);
+  string buffer;
+  buffer.reserve(raw.size());
+  for (size_t j = 0; j < raw.size(); j++) {
+    if (raw[j] != '\\') {
+      buffer.push_back(raw[j]);
+      continue;
+    }
+    if (++j == raw.size())
+      break;
+    // The lexer reported unknown escapes; they decode to nothing.
+    switch (raw[j]) {
+    case 'b':
+      buffer.push_back('\b');
+      break;
+    case 'n':
+      buffer.push_back('\n');
+      break;
+    case 'r':
+      buffer.push_back('\r');
+      break;
+    case 't':
+      buffer.push_back('\t');
+      break;
+    case '"':
+      buffer.push_back('"');
+      break;
+    case '\\':
+      buffer.push_back('\\');
+      break;
+    }
+  }
+  return buffer;
+}
+
+Token TokenList::token(size_t i) const {
+  Token token(types[i], literal(i), row(i), col(i));
+  token.keyword = keywords[i];
+  return token;
+}
+
+void TokenList::append(const TokenList &other) {
+  types.insert(types.end(), other.types.begin(), other.types.end());
+  offsets.insert(offsets.end(), other.offsets.begin(), other.offsets.end());
+  lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+  keywords.insert(keywords.end(), other.keywords.begin(),
+                  other.keywords.end());
+}
+
+void TokenList::clear() {
+  types.clear();
+  offsets.clear();
+  lengths.clear();
+  keywords.clear();
+  line_starts.clear();
+}
+
+const vector<uint32_t> &TokenList::lines() const {
+  if (line_starts.empty()) {
+    line_starts.push_back(0);
+    find_line_starts(source.data(), source.size(), line_starts);
+  }
+  return line_starts;
+}
+
+int TokenList::row_at(uint32_t offset) const {
+  const vector<uint32_t> &starts = lines();
+  return std::upper_bound(starts.begin(), starts.end(), offset) -
+         starts.begin();
+}
+
+int TokenList::col_at(uint32_t offset) const {
+  return offset - lines()[row_at(offset) - 1] + 1;
+}
+
+static constexpr string_view keyword_names[] = {
+    "",   "fn",   "Int", "Str",   "Bool",  "Float",   "return",
+    "if", "else", "for", "while", "break", "continue"};
+static constexpr size_t keyword_count =
+    sizeof(keyword_names) / sizeof(keyword_names[0]);
+
+// Length, first and last character are enough to tell the keywords apart.
+// The multiplier was searched for so that no two keywords collide, which
+// the static_assert below checks whenever the list changes.
+static constexpr size_t keyword_hash(string_view word) {
+  return (word.size() + static_cast<uint8_t>(word.front()) +
+          12 * static_cast<uint8_t>(word.back())) &
+         31;
+}
+
+static constexpr std::array<Keyword, 32> keyword_table = [] {
+  std::array<Keyword, 32> table{};
+  for (size_t i = 1; i < keyword_count; i++)
+    table[keyword_hash(keyword_names[i])] = static_cast<Keyword>(i);
+  return table;
+}();
+
+static constexpr bool keyword_table_is_perfect() {
+  for (size_t i = 1; i < keyword_count; i++)
+    if (keyword_table[keyword_hash(keyword_names[i])] != i)
+      return false;
+  return true;
+}
+static_assert(keyword_table_is_perfect(), "keyword hash has collisions");
+
+static constexpr size_t max_keyword_size = [] {
+  size_t size = 0;
+  for (string_view name : keyword_names)
+    size = name.size() > size ? name.size() : size;
+  return size;
+}();
+
+Keyword keyword_id(string_view word) {
+  if (word.size() < 2 || word.size() > max_keyword_size)
+    return NO_KEYWORD;
+  Keyword keyword = keyword_table[keyword_hash(word)];
+  return keyword_names[keyword] == word ? keyword : NO_KEYWORD;
+}
+
+string_view keyword_to_string(Keyword keyword) {
+  return keyword_names[keyword];
 }
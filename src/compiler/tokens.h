@@ -1,11 +1,14 @@
 #ifndef TOKENS_H
 #define TOKENS_H
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <vector>
 
-using std::string, std::to_string;
+using std::string, std::string_view, std::to_string, std::vector;
 
-enum Type {
+enum class TokenType : uint8_t {
   DOT,
   NEWLINE,
   KEYWORD,
@@ -43,16 +46,87 @@ enum Type {
   COMMENT,
 };
 
+enum Keyword : uint8_t {
+  NO_KEYWORD,
+  KW_FN,
+  KW_INT,
+  KW_STR,
+  KW_BOOL,
+  KW_FLOAT,
+  KW_RETURN,
+  KW_IF,
+  KW_ELSE,
+  KW_FOR,
+  KW_WHILE,
+  KW_BREAK,
+  KW_CONTINUE,
+};
+
 struct Token {
-  Type type;
+  TokenType type;
   string literal;
   int row;
   int col;
+  Keyword keyword = NO_KEYWORD;
 
-  Token(Type type, string literal, int row, int col)
+  Token(TokenType type, string literal, int row, int col)
       : type(type), literal(literal), row(row), col(col) {}
 };
 
-string type_to_string(Type type);
+// Tokens of one source buffer in structure-of-arrays form. A token is its
+// type and a window of the source, so lexing allocates nothing per token.
+// The window of a string literal is its contents without the quotes, and
+// escape sequences in it are only decoded by literal(). Rows and columns
+// are worked out from the newlines in the source when first asked for.
+struct TokenList {
+  string_view source;
+  vector<TokenType> types;
+  vector<uint32_t> offsets;
+  vector<uint32_t> lengths;
+  // Which keyword each KEYWORD token is, NO_KEYWORD for other tokens.
+  vector<Keyword> keywords;
+
+  size_t size() const { return types.size(); }
+  string_view text(size_t i) const {
+    return source.substr(offsets[i], lengths[i]);
+  }
+  // Offset of the token's first byte, the opening quote of a string.
+  uint32_t start(size_t i) const {
+    return offsets[i] - (types[i] == TokenType::STRING);
+  }
+  int row(size_t i) const { return row_at(start(i)); }
+  int col(size_t i) const { return col_at(start(i)); }
+  int row_at(uint32_t offset) const;
+  int col_at(uint32_t offset) const;
+
+  // The token's text as the old Token::literal has it: string literals are
+  // unescaped, and punctuation and newlines are empty.
+  string literal(size_t i) const;
+  Token token(size_t i) const;
+
+  void push(TokenType type, uint32_t offset, uint32_t length,
+            Keyword keyword = NO_KEYWORD) {
+    types.push_back(type);
+    offsets.push_back(offset);
+    lengths.push_back(length);
+    keywords.push_back(keyword);
+  }
+  // Appends the tokens of `other`, which lexed a later part of the same
+  // source.
+  void append(const TokenList &other);
+  void clear();
+
+private:
+  // Offset of the first byte of each line, empty until first needed.
+  mutable vector<uint32_t> line_starts;
+  const vector<uint32_t> &lines() const;
+};
+
+string type_to_string(TokenType type);
+
+// The keyword spelled `word`, or NO_KEYWORD. Looks in a perfect hash table,
+// so it costs one comparison whatever the word is.
+Keyword keyword_id(string_view word);
+string_view keyword_to_string(Keyword keyword);
 
 #endif
@@ -1,12 +1,18 @@
 #include "loader.h"
+#include "bytecode.h"
+#include "lz.h"
 #include "object.h"
+#include <algorithm>
 #include <fstream>
 #include <ios>
 #include <iostream>
+#include <exception>
 #include <stdexcept>
+#include <thread>
+#include <unordered_map>
 
 using std::ifstream, std::ios, std::streamsize, std::cerr, std::endl,
-    std::ofstream;
+    std::ofstream, std::string_view;
 
 uint32_t bytes_to_uint(vector<uint8_t> &bytes, size_t offset) {
   if (offset + 3 >= bytes.size())
@@ -18,13 +24,74 @@ uint32_t bytes_to_uint(vector<uint8_t> &bytes, size_t offset) {
 }
 
 bool check_header(vector<uint8_t> &bytes) {
-  if (bytes.size() < 28)
+  if (bytes.size() < LEGACY_HEADER_SIZE)
     return false;
 
   return bytes[0] == 0xc1 && bytes[1] == 0xa7 && bytes[2] == 0x00 &&
          bytes[3] == 0x00;
 }
 
+// Entries per decoding chunk. Pools smaller than two chunks are decoded on
+// the calling thread.
+#define POOL_CHUNK 4096
+
+// Decodes an uncompressed constant pool. A pre-scan records where every
+// POOL_CHUNK-th entry starts, then contiguous runs of chunks are decoded on
+// up to `threads` threads (0 picks the hardware concurrency) straight into
+// their final slots, so the result is the same as decoding serially.
+vector<Object> decode_const_pool(const uint8_t *data, size_t size,
+                                 unsigned threads) {
+  vector<size_t> chunk_starts;
+  size_t count = 0;
+  for (size_t pos = 0; pos < size; count++) {
+    if (count % POOL_CHUNK == 0)
+      chunk_starts.push_back(pos);
+    pos = skip_object(data, size, pos);
+  }
+  chunk_starts.push_back(size);
+
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  size_t chunks = chunk_starts.size() - 1;
+  if (threads > chunks)
+    threads = chunks;
+
+  vector<Object> pool(count);
+  if (threads <= 1 || chunks < 2) {
+    MemorySource source(data, size);
+    for (auto &obj : pool)
+      obj = decode_object(source);
+    return pool;
+  }
+
+  vector<std::thread> workers;
+  vector<std::exception_ptr> errors(threads);
+  for (unsigned t = 0; t < threads; t++) {
+    size_t first = chunks * t / threads;
+    size_t last = chunks * (t + 1) / threads;
+
+    workers.emplace_back([&, t, first, last] {
+      try {
+        MemorySource source(data + chunk_starts[first],
+                            chunk_starts[last] - chunk_starts[first]);
+        size_t end = last * POOL_CHUNK < count ? last * POOL_CHUNK : count;
+        for (size_t i = first * POOL_CHUNK; i < end; i++)
+          pool[i] = decode_object(source);
+      } catch (...) {
+        errors[t] = std::current_exception();
+      }
+    });
+  }
+
+  for (auto &worker : workers)
+    worker.join();
+  for (auto &error : errors)
+    if (error)
+      std::rethrow_exception(error);
+
+  return pool;
+}
+
 File load_from_file(string path) {
   ifstream file(path, ios::binary | ios::ate);
   if (!file.is_open())
@@ -51,92 +118,290 @@ File load_from_file(string path) {
   uint32_t const_pool_offset = bytes_to_uint(buffer, 16);
   uint32_t const_pool_size = bytes_to_uint(buffer, 20);
 
-  vector<uint8_t> bytecode_slice(buffer.begin() + bytecode_offset,
-                                 buffer.begin() + bytecode_offset +
-                                     bytecode_size);
-  const vector<uint8_t> bytecode = bytecode_slice;
+  // Files written before section flags existed have a 28 byte header.
+  uint32_t flags = 0;
+  uint32_t bytecode_raw_size = bytecode_size;
+  uint32_t const_pool_raw_size = const_pool_size;
+  if (bytecode_offset >= HEADER_SIZE) {
+    flags = bytes_to_uint(buffer, 28);
+    bytecode_raw_size = bytes_to_uint(buffer, 32);
+    const_pool_raw_size = bytes_to_uint(buffer, 36);
+  }
 
-  vector<uint8_t> const_pool_slice(buffer.begin() + const_pool_offset,
-                                   buffer.begin() + const_pool_offset +
-                                       const_pool_size);
+  if (static_cast<uint64_t>(bytecode_offset) + bytecode_size > buffer.size() ||
+      static_cast<uint64_t>(const_pool_offset) + const_pool_size >
+          buffer.size())
+    throw std::runtime_error("Invalid clarity file: section out of bounds");
+
+  // A stored section is its own raw bytes, and a compressed one cannot
+  // expand past what its longest matches allow, so a raw size from a
+  // corrupt header is caught before it is allocated.
+  auto check_raw_size = [&](uint32_t flag, uint32_t size, uint32_t raw_size) {
+    bool valid = flags & flag ? raw_size <= static_cast<uint64_t>(size) *
+                                               LZ_MAX_EXPANSION
+                              : raw_size == size;
+    if (!valid)
+      throw std::runtime_error("Invalid clarity file: bad section size");
+  };
+  check_raw_size(COMPRESS_BYTECODE, bytecode_size, bytecode_raw_size);
+  check_raw_size(COMPRESS_CONST_POOL, const_pool_size, const_pool_raw_size);
+
+  vector<uint8_t> bytecode_data(bytecode_raw_size);
+  if (flags & COMPRESS_BYTECODE)
+    lz_decompress(buffer.data() + bytecode_offset, bytecode_size,
+                  bytecode_data.data(), bytecode_raw_size);
+  else
+    std::copy(buffer.begin() + bytecode_offset,
+              buffer.begin() + bytecode_offset + bytecode_size,
+              bytecode_data.begin());
 
   vector<Object> const_pool_decoded;
 
-  try {
-    while (const_pool_slice.size() > 0)
-      const_pool_decoded.push_back(decode_object(const_pool_slice));
-  } catch (const std::exception &e) {
-    throw e;
+  // Compressed pools can only be read front to back, so they are always
+  // decoded serially.
+  if (flags & COMPRESS_CONST_POOL) {
+    LzSource source(buffer.data() + const_pool_offset, const_pool_size,
+                    const_pool_raw_size);
+    while (!source.done())
+      const_pool_decoded.push_back(decode_object(source));
+  } else {
+    const_pool_decoded =
+        decode_const_pool(buffer.data() + const_pool_offset, const_pool_size);
   }
 
-  const vector<Object> const_pool = const_pool_decoded;
-
-  File file_data = {major_version, minor_version, bytecode, const_pool, pc};
+  File file_data = {major_version, minor_version, std::move(bytecode_data),
+                    std::move(const_pool_decoded), pc};
 
   file.close();
 
   return file_data;
 }
 
-void generate_file(File file, string out) {
-  vector<char> file_data;
-  vector<uint8_t> const_pool;
+#define WRITE_BUFFER (64 * 1024)
+
+// Buffered file output that can go back and patch header fields once the
+// sections after them have been written.
+class FileWriter {
+public:
+  FileWriter(const string &path) : file(path, ios::binary) {
+    if (!file.is_open())
+      throw std::runtime_error("Failed to open output file");
+    buffer.reserve(WRITE_BUFFER);
+  }
+
+  void write(const void *data, size_t size) {
+    const char *bytes = static_cast<const char *>(data);
+    if (buffer.size() + size > WRITE_BUFFER) {
+      flush();
+      if (size > WRITE_BUFFER) {
+        file.write(bytes, size);
+        written += size;
+        return;
+      }
+    }
+    buffer.insert(buffer.end(), bytes, bytes + size);
+  }
+
+  template <typename T> void write_value(const T &value) {
+    write(&value, sizeof(value));
+  }
+
+  void patch(size_t pos, uint32_t value) {
+    flush();
+    file.seekp(pos);
+    file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+    file.seekp(0, ios::end);
+  }
+
+  size_t position() const { return written + buffer.size(); }
+
+  void close() {
+    flush();
+    if (!file)
+      throw std::runtime_error("Failed to write output file");
+    file.close();
+  }
+
+private:
+  ofstream file;
+  vector<char> buffer;
+  size_t written = 0;
+
+  void flush() {
+    file.write(buffer.data(), buffer.size());
+    written += buffer.size();
+    buffer.clear();
+  }
+};
+
+struct PoolLayout {
+  vector<uint32_t> remap;  // original index -> index in the written pool
+  vector<uint32_t> unique; // original indices of the constants to write
+  uint32_t size = 0;       // encoded size of the written pool
+};
+
+// Finds every distinct constant, comparing encodings so 7 and 7.0 stay
+// apart. Only hashes are kept between iterations; candidates with a matching
+// hash are encoded again to confirm the match.
+static PoolLayout layout_const_pool(const vector<Object> &pool) {
+  PoolLayout layout;
+  layout.remap.resize(pool.size());
+
+  std::unordered_multimap<size_t, uint32_t> seen;
+  vector<uint8_t> encoded;
+  vector<uint8_t> candidate;
+
+  for (size_t i = 0; i < pool.size(); i++) {
+    encoded.clear();
+    encode_object(pool[i], encoded);
+    size_t hash = std::hash<string_view>{}(string_view(
+        reinterpret_cast<const char *>(encoded.data()), encoded.size()));
+
+    uint32_t index = layout.unique.size();
+    auto range = seen.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+      candidate.clear();
+      encode_object(pool[layout.unique[it->second]], candidate);
+      if (candidate == encoded) {
+        index = it->second;
+        break;
+      }
+    }
+
+    if (index == layout.unique.size()) {
+      seen.emplace(hash, index);
+      layout.unique.push_back(i);
+      layout.size += encoded.size();
+    }
+    layout.remap[i] = index;
+  }
+
+  return layout;
+}
+
+// Passes the bytecode to `emit` in runs, with PUSH operands pointed at the
+// deduplicated pool. Out of range operands are left alone so the VM can
+// report them.
+template <typename Emit>
+static void remap_bytecode(const vector<uint8_t> &bytecode,
+                           const vector<uint32_t> &remap, Emit emit) {
+  size_t run = 0;
+  size_t pc = 0;
+
+  for (; pc < bytecode.size(); pc += inst_length(bytecode[pc])) {
+    if (bytecode[pc] != PUSH || pc + 4 >= bytecode.size())
+      continue;
+
+    uint32_t index = static_cast<uint32_t>(bytecode[pc + 1]) |
+                     (static_cast<uint32_t>(bytecode[pc + 2]) << 8) |
+                     (static_cast<uint32_t>(bytecode[pc + 3]) << 16) |
+                     (static_cast<uint32_t>(bytecode[pc + 4]) << 24);
+    if (index >= remap.size())
+      continue;
+
+    uint32_t target = remap[index];
+    uint8_t inst[5] = {
+        PUSH,
+        static_cast<uint8_t>(target),
+        static_cast<uint8_t>(target >> 8),
+        static_cast<uint8_t>(target >> 16),
+        static_cast<uint8_t>(target >> 24),
+    };
+    emit(bytecode.data() + run, pc - run);
+    emit(inst, sizeof(inst));
+    run = pc + sizeof(inst);
+  }
+
+  if (run < bytecode.size())
+    emit(bytecode.data() + run, bytecode.size() - run);
+}
+
+// Replaces `section` with its compressed form unless that does not save any
+// space. Returns whether the section was compressed.
+static bool compress_section(vector<uint8_t> &section) {
+  vector<uint8_t> compressed;
+  lz_compress(section.data(), section.size(), compressed);
+  if (compressed.size() >= section.size())
+    return false;
+
+  section.swap(compressed);
+  return true;
+}
+
+// Writes the file in one pass. Uncompressed sections are encoded straight
+// into the output buffer; a compressed section is assembled in memory first
+// because the codec needs all of it. Section sizes and flags are patched
+// into the header at the end.
+void generate_file(const File &file, const string &out, uint32_t flags) {
+  PoolLayout layout;
 
   try {
-    for (auto obj : file.const_pool)
-      encode_object(obj, const_pool);
+    layout = layout_const_pool(file.const_pool);
   } catch (const std::exception &e) {
     cerr << e.what() << endl;
     exit(1);
   }
 
+  FileWriter writer(out);
+
   uint32_t magic_number = 0xa7c1;
-  uint32_t bytecode_offset = sizeof(magic_number) + sizeof(file.major_version) +
-                             sizeof(file.minor_version) + 5 * sizeof(uint32_t);
-  uint32_t bytecode_size = file.bytecode.size();
-  uint32_t const_pool_offset = bytecode_offset + bytecode_size;
-  uint32_t const_pool_size = const_pool.size();
-
-  file_data.insert(
-      file_data.end(), reinterpret_cast<const char *>(&magic_number),
-      reinterpret_cast<const char *>(&magic_number) + sizeof(magic_number));
-
-  file_data.insert(file_data.end(),
-                   reinterpret_cast<const char *>(&file.major_version),
-                   reinterpret_cast<const char *>(&file.major_version) +
-                       sizeof(file.major_version));
-
-  file_data.insert(file_data.end(),
-                   reinterpret_cast<const char *>(&file.minor_version),
-                   reinterpret_cast<const char *>(&file.minor_version) +
-                       sizeof(file.minor_version));
-
-  file_data.insert(file_data.end(),
-                   reinterpret_cast<const char *>(&bytecode_offset),
-                   reinterpret_cast<const char *>(&bytecode_offset) +
-                       sizeof(bytecode_offset));
-
-  file_data.insert(
-      file_data.end(), reinterpret_cast<const char *>(&bytecode_size),
-      reinterpret_cast<const char *>(&bytecode_size) + sizeof(bytecode_size));
-
-  file_data.insert(file_data.end(),
-                   reinterpret_cast<const char *>(&const_pool_offset),
-                   reinterpret_cast<const char *>(&const_pool_offset) +
-                       sizeof(const_pool_offset));
-
-  file_data.insert(file_data.end(),
-                   reinterpret_cast<const char *>(&const_pool_size),
-                   reinterpret_cast<const char *>(&const_pool_size) +
-                       sizeof(const_pool_size));
-
-  file_data.insert(file_data.end(), reinterpret_cast<const char *>(&file.pc),
-                   reinterpret_cast<const char *>(&file.pc) + sizeof(file.pc));
-
-  file_data.insert(file_data.end(), file.bytecode.begin(), file.bytecode.end());
-  file_data.insert(file_data.end(), const_pool.begin(), const_pool.end());
-
-  ofstream out_file(out, ios::binary);
-  out_file.write(file_data.data(), file_data.size());
-  out_file.close();
+  uint32_t bytecode_raw_size = file.bytecode.size();
+  uint32_t const_pool_raw_size = layout.size;
+  uint32_t placeholder = 0;
+
+  writer.write_value(magic_number);
+  writer.write_value(file.major_version);
+  writer.write_value(file.minor_version);
+  writer.write_value(static_cast<uint32_t>(HEADER_SIZE));
+  writer.write_value(placeholder); // bytecode size
+  writer.write_value(placeholder); // const pool offset
+  writer.write_value(placeholder); // const pool size
+  writer.write_value(file.pc);
+  writer.write_value(placeholder); // flags
+  writer.write_value(bytecode_raw_size);
+  writer.write_value(const_pool_raw_size);
+
+  if (flags & COMPRESS_BYTECODE) {
+    vector<uint8_t> bytecode;
+    bytecode.reserve(bytecode_raw_size);
+    remap_bytecode(file.bytecode, layout.remap,
+                   [&](const uint8_t *data, size_t size) {
+                     bytecode.insert(bytecode.end(), data, data + size);
+                   });
+    if (!compress_section(bytecode))
+      flags &= ~COMPRESS_BYTECODE;
+    writer.write(bytecode.data(), bytecode.size());
+  } else {
+    remap_bytecode(
+        file.bytecode, layout.remap,
+        [&](const uint8_t *data, size_t size) { writer.write(data, size); });
+  }
+
+  uint32_t bytecode_size = writer.position() - HEADER_SIZE;
+  uint32_t const_pool_offset = writer.position();
+
+  if (flags & COMPRESS_CONST_POOL) {
+    vector<uint8_t> const_pool;
+    const_pool.reserve(const_pool_raw_size);
+    for (uint32_t index : layout.unique)
+      encode_object(file.const_pool[index], const_pool);
+    if (!compress_section(const_pool))
+      flags &= ~COMPRESS_CONST_POOL;
+    writer.write(const_pool.data(), const_pool.size());
+  } else {
+    vector<uint8_t> encoded;
+    for (uint32_t index : layout.unique) {
+      encoded.clear();
+      encode_object(file.const_pool[index], encoded);
+      writer.write(encoded.data(), encoded.size());
+    }
+  }
+
+  uint32_t const_pool_size = writer.position() - const_pool_offset;
+
+  writer.patch(12, bytecode_size);
+  writer.patch(16, const_pool_offset);
+  writer.patch(20, const_pool_size);
+  writer.patch(28, flags);
+  writer.close();
 }
@@ -8,6 +8,15 @@
 
 using std::string, std::vector;
 
+#define LEGACY_HEADER_SIZE 28
+#define HEADER_SIZE 40
+
+// Per-section flags stored in the file header.
+enum {
+  COMPRESS_BYTECODE = 1 << 0,
+  COMPRESS_CONST_POOL = 1 << 1,
+};
+
 struct File {
   unsigned short major_version;
   unsigned short minor_version;
@@ -17,6 +26,8 @@ struct File {
 };
 
 File load_from_file(string path);
-void generate_file(File file, string out);
+vector<Object> decode_const_pool(const uint8_t *data, size_t size,
+                                 unsigned threads = 0);
+void generate_file(const File &file, const string &out, uint32_t flags = 0);
 
 #endif
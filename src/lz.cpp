@@ -0,0 +1,217 @@
+#include "lz.h"
+#include <cstring>
+#include <stdexcept>
+
+#define HASH_BITS 16
+
+static uint32_t read32(const uint8_t *p) {
+  uint32_t value;
+  std::memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+static uint32_t hash32(uint32_t value) {
+  return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+static void write_length(size_t length, vector<uint8_t> &out) {
+  while (length >= 255) {
+    out.push_back(255);
+    length -= 255;
+  }
+  out.push_back(static_cast<uint8_t>(length));
+}
+
+static void write_sequence(const uint8_t *literals, size_t literal_count,
+                           size_t offset, size_t match_length,
+                           vector<uint8_t> &out) {
+  size_t extra = match_length - LZ_MIN_MATCH;
+  uint8_t token = (literal_count < 15 ? literal_count : 15) << 4;
+  if (match_length != 0)
+    token |= extra < 15 ? extra : 15;
+  out.push_back(token);
+
+  if (literal_count >= 15)
+    write_length(literal_count - 15, out);
+  out.insert(out.end(), literals, literals + literal_count);
+
+  if (match_length == 0)
+    return;
+
+  out.push_back(offset & 0xff);
+  out.push_back((offset >> 8) & 0xff);
+  if (extra >= 15)
+    write_length(extra - 15, out);
+}
+
+void lz_compress(const uint8_t *data, size_t size, vector<uint8_t> &out) {
+  // Positions are stored off by one so zero can mean "empty".
+  vector<uint32_t> table(1 << HASH_BITS, 0);
+  size_t anchor = 0;
+  size_t i = 0;
+
+  while (i + LZ_MIN_MATCH <= size) {
+    uint32_t sequence = read32(data + i);
+    uint32_t &slot = table[hash32(sequence)];
+    size_t candidate = slot;
+    slot = i + 1;
+
+    if (candidate == 0 || i - (candidate - 1) > LZ_WINDOW ||
+        read32(data + candidate - 1) != sequence) {
+      i++;
+      continue;
+    }
+    candidate--;
+
+    size_t length = LZ_MIN_MATCH;
+    while (i + length < size && data[candidate + length] == data[i + length])
+      length++;
+
+    write_sequence(data + anchor, i - anchor, i - candidate, length, out);
+    i += length;
+    anchor = i;
+  }
+
+  if (anchor < size)
+    write_sequence(data + anchor, size - anchor, 0, 0, out);
+}
+
+static size_t read_length(const uint8_t *&in, const uint8_t *in_end) {
+  size_t length = 0;
+  uint8_t byte;
+  do {
+    if (in == in_end)
+      throw std::runtime_error("Corrupt compressed data");
+    byte = *in++;
+    length += byte;
+  } while (byte == 255);
+  return length;
+}
+
+void lz_decompress(const uint8_t *data, size_t size, uint8_t *out,
+                   size_t raw_size) {
+  const uint8_t *in = data;
+  const uint8_t *in_end = data + size;
+  size_t pos = 0;
+
+  while (in < in_end) {
+    uint8_t token = *in++;
+
+    size_t literal_count = token >> 4;
+    if (literal_count == 15)
+      literal_count += read_length(in, in_end);
+    if (literal_count > static_cast<size_t>(in_end - in) ||
+        literal_count > raw_size - pos)
+      throw std::runtime_error("Corrupt compressed data");
+    std::memcpy(out + pos, in, literal_count);
+    in += literal_count;
+    pos += literal_count;
+
+    if (in == in_end)
+      break;
+
+    if (in_end - in < 2)
+      throw std::runtime_error("Corrupt compressed data");
+    size_t offset = in[0] | (in[1] << 8);
+    in += 2;
+
+    size_t length = (token & 0x0f) + LZ_MIN_MATCH;
+    if ((token & 0x0f) == 15)
+      length += read_length(in, in_end);
+    if (offset == 0 || offset > pos || length > raw_size - pos)
+      throw std::runtime_error("Corrupt compressed data");
+
+    // Matches may overlap their own output, so copy forwards byte by byte.
+    for (size_t i = 0; i < length; i++, pos++)
+      out[pos] = out[pos - offset];
+  }
+
+  if (pos != raw_size)
+    throw std::runtime_error("Corrupt compressed data");
+}
+
+LzSource::LzSource(const uint8_t *data, size_t size, size_t raw_size)
+    : in(data), in_end(data + size), raw_size(raw_size),
+      window(2 * (LZ_WINDOW + 1)) {}
+
+bool LzSource::done() { return head == tail && produced == raw_size; }
+
+void LzSource::read(uint8_t *out, size_t size) {
+  while (size > 0) {
+    if (head == tail) {
+      fill();
+      if (head == tail)
+        throw std::runtime_error("Unexpected end of data");
+    }
+
+    size_t count = tail - head < size ? tail - head : size;
+    std::memcpy(out, window.data() + head, count);
+    head += count;
+    out += count;
+    size -= count;
+  }
+}
+
+void LzSource::fill() {
+  // Slide the buffer once it is full, keeping the last LZ_WINDOW bytes around
+  // as match history.
+  if (tail == window.size()) {
+    size_t drop = tail - (LZ_WINDOW + 1);
+    std::memmove(window.data(), window.data() + drop, tail - drop);
+    head -= drop;
+    tail -= drop;
+  }
+
+  size_t start = tail;
+  while (tail < window.size()) {
+    if (literals > 0) {
+      size_t count = window.size() - tail;
+      if (count > literals)
+        count = literals;
+      if (count > static_cast<size_t>(in_end - in))
+        throw std::runtime_error("Corrupt compressed data");
+      std::memcpy(window.data() + tail, in, count);
+      in += count;
+      tail += count;
+      literals -= count;
+      continue;
+    }
+
+    if (match > 0) {
+      for (; match > 0 && tail < window.size(); match--, tail++)
+        window[tail] = window[tail - offset];
+      continue;
+    }
+
+    if (match_pending) {
+      if (in == in_end)
+        break;
+      if (in_end - in < 2)
+        throw std::runtime_error("Corrupt compressed data");
+      offset = in[0] | (in[1] << 8);
+      in += 2;
+
+      match = match_nibble + LZ_MIN_MATCH;
+      if (match_nibble == 15)
+        match += read_length(in, in_end);
+      if (offset == 0 || offset > tail)
+        throw std::runtime_error("Corrupt compressed data");
+      match_pending = false;
+      continue;
+    }
+
+    if (in == in_end)
+      break;
+
+    uint8_t token = *in++;
+    literals = token >> 4;
+    if (literals == 15)
+      literals += read_length(in, in_end);
+    match_nibble = token & 0x0f;
+    match_pending = true;
+  }
+
+  produced += tail - start;
+  if (produced > raw_size)
+    throw std::runtime_error("Corrupt compressed data");
+}
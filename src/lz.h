@@ -0,0 +1,58 @@
+#ifndef LZ_H
+#define LZ_H
+
+#include "stream.h"
+#include <cstdint>
+#include <vector>
+
+using std::vector;
+
+// Byte oriented LZ77 codec used for compressed file sections.
+//
+// A block is a series of sequences. Every sequence starts with a token whose
+// high nibble is the literal count and low nibble the match length minus
+// LZ_MIN_MATCH, a nibble of 15 being continued by 255-saturated extension
+// bytes. The literals follow, then a little endian 16-bit match offset and
+// the match length extension. The last sequence of a block carries only
+// literals.
+
+#define LZ_MIN_MATCH 4
+#define LZ_WINDOW 65535
+// No compressed byte stands for more than a 255 byte extension of a match.
+#define LZ_MAX_EXPANSION 255
+
+void lz_compress(const uint8_t *data, size_t size, vector<uint8_t> &out);
+void lz_decompress(const uint8_t *data, size_t size, uint8_t *out,
+                   size_t raw_size);
+
+// Decompresses a block on demand, keeping only the match window in memory.
+class LzSource : public ByteSource {
+public:
+  LzSource(const uint8_t *data, size_t size, size_t raw_size);
+
+  void read(uint8_t *out, size_t size) override;
+  bool done() override;
+  size_t remaining() const override {
+    return raw_size - (produced - (tail - head));
+  }
+
+private:
+  const uint8_t *in;
+  const uint8_t *in_end;
+  size_t raw_size;
+  size_t produced = 0;
+
+  vector<uint8_t> window;
+  size_t head = 0;
+  size_t tail = 0;
+
+  size_t literals = 0;
+  size_t match = 0;
+  size_t offset = 0;
+  uint8_t match_nibble = 0;
+  bool match_pending = false;
+
+  void fill();
+};
+
+#endif // LZ_H
@@ -1,6 +1,13 @@
+#include "bench.h"
 #include "tests.h"
+#include <string>
+
+int main(int argc, const char **argv) {
+  if (argc > 1 && std::string(argv[1]) == "bench") {
+    benchmarks();
+    return 0;
+  }
 
-int main() {
   tests();
   return 0;
 }
@@ -0,0 +1,224 @@
+#include "map.h"
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+// Bit i is set when control byte i of the group equals `byte`.
+static uint32_t match_byte(const int8_t *group, int8_t byte) {
+#if defined(__SSE2__)
+  __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(group));
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(byte)));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < MAP_GROUP; i++)
+    if (group[i] == byte)
+      mask |= 1u << i;
+  return mask;
+#endif
+}
+
+// Bit i is set when slot i of the group is EMPTY or DELETED, the only
+// control bytes with their sign bit set.
+static uint32_t match_free(const int8_t *group) {
+#if defined(__SSE2__)
+  return _mm_movemask_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(group)));
+#else
+  uint32_t mask = 0;
+  for (int i = 0; i < MAP_GROUP; i++)
+    if (group[i] < 0)
+      mask |= 1u << i;
+  return mask;
+#endif
+}
+
+// Finalizer of MurmurHash3, so keys that differ in a single bit, like
+// consecutive integers, spread over the whole table.
+static uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+bool MapTable::is_hashable(const Object &key) {
+  switch (key.type) {
+  case INTEGER:
+  case STRING:
+  case BOOLEAN:
+    return true;
+  case FLOAT:
+    return !std::isnan(key.as<double>());
+  default:
+    return false;
+  }
+}
+
+uint64_t MapTable::hash(const Object &key) {
+  uint64_t type = static_cast<uint64_t>(key.type) << 56;
+  switch (key.type) {
+  case INTEGER:
+    return mix(static_cast<uint64_t>(key.as<int>()) ^ type);
+  case FLOAT: {
+    // 0.0 and -0.0 are equal, so they must hash the same.
+    double value = key.as<double>() == 0 ? 0.0 : key.as<double>();
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return mix(bits ^ type);
+  }
+  case STRING:
+    return mix(std::hash<string_view>()(key.as<String>().str()) ^ type);
+  case BOOLEAN:
+    return mix(static_cast<uint64_t>(key.as<bool>()) ^ type);
+  default:
+    return 0;
+  }
+}
+
+static bool keys_equal(const Object &a, const Object &b) {
+  if (a.type != b.type)
+    return false;
+  switch (a.type) {
+  case INTEGER:
+    return a.as<int>() == b.as<int>();
+  case FLOAT:
+    return a.as<double>() == b.as<double>();
+  case STRING:
+    return a.as<String>() == b.as<String>();
+  case BOOLEAN:
+    return a.as<bool>() == b.as<bool>();
+  default:
+    return false;
+  }
+}
+
+size_t MapTable::find_slot(const Object &key, uint64_t hash) const {
+  if (ctrl.empty())
+    return NOT_FOUND;
+
+  size_t mask = ctrl.size() / MAP_GROUP - 1;
+  size_t group = (hash >> 7) & mask;
+  int8_t h2 = hash & 0x7f;
+  for (size_t step = 1;; step++) {
+    const int8_t *bytes = ctrl.data() + group * MAP_GROUP;
+    for (uint32_t match = match_byte(bytes, h2); match; match &= match - 1) {
+      size_t slot = group * MAP_GROUP + __builtin_ctz(match);
+      if (keys_equal(slots[slot].key, key))
+        return slot;
+    }
+    // A key is never stored past a group that still has an EMPTY slot.
+    if (match_byte(bytes, EMPTY) || step > mask)
+      return NOT_FOUND;
+    group = (group + step) & mask;
+  }
+}
+
+const Object *MapTable::find(const Object &key) const {
+  size_t slot = find_slot(key, hash(key));
+  return slot == NOT_FOUND ? nullptr : &slots[slot].value;
+}
+
+void MapTable::set(Object key, Object value) {
+  uint64_t h = hash(key);
+  size_t slot = find_slot(key, h);
+  if (slot != NOT_FOUND) {
+    slots[slot].value = std::move(value);
+    return;
+  }
+
+  // Keep at least 1/8 of the slots EMPTY so probes stay short. Tombstones
+  // count against that too, and are dropped by rehashing at the same size
+  // when the table is not actually full.
+  if ((count + tombstones + 1) * 8 > capacity() * 7) {
+    size_t capacity = this->capacity() == 0 ? MAP_GROUP : this->capacity();
+    rehash((count + 1) * 16 > capacity * 7 ? capacity * 2 : capacity);
+  }
+  insert(std::move(key), std::move(value), h);
+}
+
+void MapTable::insert(Object key, Object value, uint64_t hash) {
+  size_t mask = ctrl.size() / MAP_GROUP - 1;
+  size_t group = (hash >> 7) & mask;
+  uint32_t free;
+  for (size_t step = 1;
+       !(free = match_free(ctrl.data() + group * MAP_GROUP)); step++)
+    group = (group + step) & mask;
+
+  size_t slot = group * MAP_GROUP + __builtin_ctz(free);
+  if (ctrl[slot] == DELETED)
+    tombstones--;
+  ctrl[slot] = hash & 0x7f;
+  slots[slot] = {std::move(key), std::move(value)};
+  count++;
+}
+
+bool MapTable::erase(const Object &key) {
+  size_t slot = find_slot(key, hash(key));
+  if (slot == NOT_FOUND)
+    return false;
+
+  ctrl[slot] = DELETED;
+  slots[slot] = {};
+  count--;
+  tombstones++;
+  return true;
+}
+
+void MapTable::rehash(size_t capacity) {
+  std::pmr::vector<int8_t> old_ctrl(capacity, EMPTY, resource());
+  std::pmr::vector<Entry> old_slots(capacity, resource());
+  old_ctrl.swap(ctrl);
+  old_slots.swap(slots);
+  count = 0;
+  tombstones = 0;
+
+  for (size_t i = 0; i < old_ctrl.size(); i++) {
+    if (old_ctrl[i] >= 0) {
+      uint64_t h = hash(old_slots[i].key);
+      insert(std::move(old_slots[i].key), std::move(old_slots[i].value), h);
+    }
+  }
+}
+
+Map::Map() : data(std::make_shared<MapTable>()) {}
+
+Map::Map(MapTable table)
+    : data(std::allocate_shared<MapTable>(
+          std::pmr::polymorphic_allocator<MapTable>(table.resource()),
+          std::move(table))) {}
+
+size_t Map::size() const { return data->size(); }
+
+const Object *Map::find(const Object &key) const { return data->find(key); }
+
+std::pmr::memory_resource *Map::resource() const { return data->resource(); }
+
+MapTable &Map::mutate(std::pmr::memory_resource *resource) {
+  if (is_shared() || data->resource() != resource)
+    *this = Map(data->copy(resource, [](const Object &obj) { return obj; }));
+  return *data;
+}
+
+void Map::print() const {
+  cout << "{";
+  bool first = true;
+  for (size_t i = 0; i < data->capacity(); i++) {
+    if (!data->is_full(i))
+      continue;
+    if (!first)
+      cout << ", ";
+    data->entry(i).key.print();
+    cout << ": ";
+    data->entry(i).value.print();
+    first = false;
+  }
+  cout << "}";
+}
@@ -0,0 +1,76 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include "object.h"
+#include <cstdint>
+#include <memory_resource>
+
+#define MAP_GROUP 16
+
+// Open addressing hash table in the Swiss table layout. Every slot has a
+// control byte holding EMPTY, DELETED or the low 7 bits of its key's hash.
+// Lookups scan the control bytes a group of MAP_GROUP slots at a time (one
+// SSE2 comparison where available) and only compare keys whose 7 bits match,
+// so a probe usually touches one group and one key. The capacity is a power
+// of two number of groups, probed in triangular order so every group is
+// visited.
+class MapTable {
+public:
+  struct Entry {
+    Object key;
+    Object value;
+  };
+
+  static constexpr int8_t EMPTY = -128;
+  static constexpr int8_t DELETED = -2;
+
+  explicit MapTable(std::pmr::memory_resource *resource =
+                        std::pmr::get_default_resource())
+      : ctrl(resource), slots(resource) {}
+
+  size_t size() const { return count; }
+  size_t capacity() const { return ctrl.size(); }
+  bool is_full(size_t slot) const { return ctrl[slot] >= 0; }
+  const Entry &entry(size_t slot) const { return slots[slot]; }
+  std::pmr::memory_resource *resource() const {
+    return ctrl.get_allocator().resource();
+  }
+
+  // Integers, non-NaN floats, strings and booleans can be keys. Keys of
+  // different types never match, like EQ.
+  static bool is_hashable(const Object &key);
+  static uint64_t hash(const Object &key);
+
+  const Object *find(const Object &key) const;
+  void set(Object key, Object value);
+  bool erase(const Object &key);
+
+  // A copy in `resource` with every key and value passed through `f`, which
+  // must keep keys equal to what they were. The slot layout is copied as it
+  // is, so nothing is rehashed.
+  template <typename F>
+  MapTable copy(std::pmr::memory_resource *resource, F f) const {
+    MapTable result(resource);
+    result.ctrl.assign(ctrl.begin(), ctrl.end());
+    result.slots.resize(slots.size());
+    for (size_t i = 0; i < slots.size(); i++)
+      if (is_full(i))
+        result.slots[i] = {f(slots[i].key), f(slots[i].value)};
+    result.count = count;
+    result.tombstones = tombstones;
+    return result;
+  }
+
+private:
+  size_t find_slot(const Object &key, uint64_t hash) const;
+  // Puts a key that is not in the table yet into its first free slot.
+  void insert(Object key, Object value, uint64_t hash);
+  void rehash(size_t capacity);
+
+  std::pmr::vector<int8_t> ctrl;
+  std::pmr::vector<Entry> slots;
+  size_t count = 0;
+  size_t tombstones = 0;
+};
+
+#endif // MAP_H
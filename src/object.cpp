@@ -1,7 +1,80 @@
 #include "object.h"
+#include "map.h"
 #include <cstring>
 
-using std::memcpy;
+String StringTable::intern(const String &str) {
+  // Inline strings compare by value without touching the heap anyway. A
+  // string another table interned is looked up like any other, as interned
+  // strings on different buffers compare unequal.
+  if (str.is_inline())
+    return str;
+
+  auto it = table.find(str.str());
+  if (it == table.end()) {
+    // A substring gets a buffer of its own rather than pinning its parent.
+    shared_ptr<StringData> data = str.data;
+    if (str.offset != 0 || str.length != data->size())
+      data = std::make_shared<StringData>(str.str());
+    it = table.emplace(*data, data).first;
+  }
+
+  return String(it->second, 0, it->second->size(), true);
+}
+
+String String::concat(const String &left, string_view right,
+                      std::pmr::memory_resource *resource) {
+  size_t size = left.size() + right.size();
+
+  if (size <= SSO_CAPACITY) {
+    char buffer[SSO_CAPACITY];
+    std::memcpy(buffer, left.str().data(), left.size());
+    std::memcpy(buffer + left.size(), right.data(), right.size());
+    return String(string_view(buffer, size));
+  }
+
+  // Every other string on this buffer ends before its end, so bytes
+  // added past the end are invisible to them. std::string::append copes with
+  // `right` pointing into the buffer itself.
+  if (!left.is_inline() && !left.interned && left.resource() == resource &&
+      left.offset + left.length == left.data->size()) {
+    left.data->append(right);
+    return String(left.data, left.offset, size, false);
+  }
+
+  StringData result(resource);
+  result.reserve(size);
+  result.append(left.str()).append(right);
+  return String(std::move(result));
+}
+
+String String::substr(size_t pos, size_t size) const {
+  if (size <= SSO_CAPACITY)
+    return String(str().substr(pos, size));
+  return String(data, offset + pos, size,
+                interned && pos == 0 && size == length);
+}
+
+Object intern_object(const Object &obj, StringTable &table) {
+  if (obj.is_type<String>())
+    return Object(STRING, table.intern(obj.as<String>()));
+
+  if (obj.is_type<List>()) {
+    ListData list;
+    list.reserve(obj.as<List>().size());
+    for (const auto &elem : obj.as<List>())
+      list.push_back(intern_object(elem, table));
+    return Object(obj.type, List(std::move(list)));
+  }
+
+  if (obj.is_type<Map>())
+    return Object(obj.type, Map(obj.as<Map>().table().copy(
+                                std::pmr::get_default_resource(),
+                                [&](const Object &elem) {
+                                  return intern_object(elem, table);
+                                })));
+
+  return obj;
+}
 
 string type_to_string(Type type) {
   switch (type) {
@@ -17,10 +90,42 @@ string type_to_string(Type type) {
     return "NULL_TYPE";
   case LIST:
     return "LIST";
+  case INT_ARRAY:
+    return "INT_ARRAY";
+  case FLOAT_ARRAY:
+    return "FLOAT_ARRAY";
+  case MAP:
+    return "MAP";
   }
   return "UNKNOWN";
 }
 
+// Arrays are a length followed by their elements as raw 8 byte values.
+template <typename T>
+static void encode_array(const Array<T> &array, vector<uint8_t> &bytecode) {
+  uint32_t length = array.size();
+  bytecode.insert(bytecode.end(), reinterpret_cast<const char *>(&length),
+                  reinterpret_cast<const char *>(&length) + sizeof(uint32_t));
+  bytecode.insert(bytecode.end(), reinterpret_cast<const char *>(array.begin()),
+                  reinterpret_cast<const char *>(array.end()));
+}
+
+// Throws unless the source still holds `count` bytes.
+static void need(const ByteSource &source, size_t count) {
+  if (count > source.remaining())
+    throw std::runtime_error("Unexpected end of data");
+}
+
+template <typename T> static Array<T> decode_array(ByteSource &source) {
+  uint32_t length;
+  source.read(reinterpret_cast<uint8_t *>(&length), sizeof(uint32_t));
+
+  need(source, static_cast<size_t>(length) * sizeof(T));
+  typename Array<T>::Data elems(length);
+  source.read(reinterpret_cast<uint8_t *>(elems.data()), length * sizeof(T));
+  return Array<T>(std::move(elems));
+}
+
 void encode_object(const Object &obj, vector<uint8_t> &bytecode) {
   bytecode.push_back(static_cast<uint8_t>(obj.type));
 
@@ -38,7 +143,7 @@ void encode_object(const Object &obj, vector<uint8_t> &bytecode) {
         reinterpret_cast<const char *>(&obj.as<double>()) + sizeof(double));
     break;
   case STRING: {
-    const string &str = obj.as<string>();
+    string_view str = obj.as<String>().str();
     uint32_t length = str.length();
     bytecode.insert(bytecode.end(), reinterpret_cast<const char *>(&length),
                     reinterpret_cast<const char *>(&length) + sizeof(uint32_t));
@@ -49,7 +154,7 @@ void encode_object(const Object &obj, vector<uint8_t> &bytecode) {
     bytecode.push_back(obj.as<bool>() ? 1 : 0);
     break;
   case LIST: {
-    const vector<Object> &list = obj.as<vector<Object>>();
+    const List &list = obj.as<List>();
     uint32_t length = list.size();
     bytecode.insert(bytecode.end(), reinterpret_cast<const char *>(&length),
                     reinterpret_cast<const char *>(&length) + sizeof(uint32_t));
@@ -57,50 +162,154 @@ void encode_object(const Object &obj, vector<uint8_t> &bytecode) {
       encode_object(elem, bytecode);
     break;
   }
+  case INT_ARRAY:
+    encode_array(obj.as<IntArray>(), bytecode);
+    break;
+  case FLOAT_ARRAY:
+    encode_array(obj.as<FloatArray>(), bytecode);
+    break;
+  case MAP: {
+    const MapTable &table = obj.as<Map>().table();
+    uint32_t length = table.size();
+    bytecode.insert(bytecode.end(), reinterpret_cast<const char *>(&length),
+                    reinterpret_cast<const char *>(&length) + sizeof(uint32_t));
+    for (size_t i = 0; i < table.capacity(); i++) {
+      if (table.is_full(i)) {
+        encode_object(table.entry(i).key, bytecode);
+        encode_object(table.entry(i).value, bytecode);
+      }
+    }
+    break;
+  }
   }
 }
 
 Object decode_object(std::vector<uint8_t> &bytecode) {
-  Type type = static_cast<Type>(bytecode[0]);
-  bytecode.erase(bytecode.begin());
+  MemorySource source(bytecode.data(), bytecode.size());
+  Object obj = decode_object(source);
+  bytecode.erase(bytecode.begin(), bytecode.begin() + source.position());
+  return obj;
+}
+
+// Returns the offset just past the object encoded at `pos` without decoding
+// it.
+size_t skip_object(const uint8_t *data, size_t size, size_t pos) {
+  auto need = [&](size_t count) {
+    if (count > size - pos)
+      throw std::runtime_error("Unexpected end of data");
+  };
+
+  need(1);
+  Type type = static_cast<Type>(data[pos++]);
+
+  switch (type) {
+  case INTEGER:
+    need(sizeof(int));
+    return pos + sizeof(int);
+  case FLOAT:
+    need(sizeof(double));
+    return pos + sizeof(double);
+  case STRING: {
+    uint32_t length;
+    need(sizeof(uint32_t));
+    std::memcpy(&length, data + pos, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    need(length);
+    return pos + length;
+  }
+  case BOOLEAN:
+    need(1);
+    return pos + 1;
+  case LIST: {
+    uint32_t length;
+    need(sizeof(uint32_t));
+    std::memcpy(&length, data + pos, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    for (size_t i = 0; i < length; i++)
+      pos = skip_object(data, size, pos);
+    return pos;
+  }
+  case INT_ARRAY:
+  case FLOAT_ARRAY: {
+    uint32_t length;
+    need(sizeof(uint32_t));
+    std::memcpy(&length, data + pos, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    need(static_cast<size_t>(length) * 8);
+    return pos + static_cast<size_t>(length) * 8;
+  }
+  case MAP: {
+    uint32_t length;
+    need(sizeof(uint32_t));
+    std::memcpy(&length, data + pos, sizeof(uint32_t));
+    pos += sizeof(uint32_t);
+    for (size_t i = 0; i < 2 * static_cast<size_t>(length); i++)
+      pos = skip_object(data, size, pos);
+    return pos;
+  }
+  case NULL_TYPE:
+    return pos;
+  }
+
+  throw std::runtime_error("Unknown object type");
+}
+
+Object decode_object(ByteSource &source) {
+  uint8_t tag;
+  source.read(&tag, 1);
+  Type type = static_cast<Type>(tag);
 
   switch (type) {
   case INTEGER: {
     int value;
-    std::memcpy(&value, bytecode.data(), sizeof(int));
-    bytecode.erase(bytecode.begin(), bytecode.begin() + sizeof(int));
+    source.read(reinterpret_cast<uint8_t *>(&value), sizeof(int));
     return Object(INTEGER, value);
   }
   case FLOAT: {
     double value;
-    std::memcpy(&value, bytecode.data(), sizeof(double));
-    bytecode.erase(bytecode.begin(), bytecode.begin() + sizeof(double));
+    source.read(reinterpret_cast<uint8_t *>(&value), sizeof(double));
     return Object(FLOAT, value);
   }
   case STRING: {
     uint32_t length;
-    std::memcpy(&length, bytecode.data(), sizeof(uint32_t));
-    bytecode.erase(bytecode.begin(), bytecode.begin() + sizeof(uint32_t));
+    source.read(reinterpret_cast<uint8_t *>(&length), sizeof(uint32_t));
 
-    std::string str(bytecode.begin(), bytecode.begin() + length);
-    bytecode.erase(bytecode.begin(), bytecode.begin() + length);
-    return Object(STRING, str);
+    need(source, length);
+    StringData str(length, '\0');
+    source.read(reinterpret_cast<uint8_t *>(str.data()), length);
+    return Object(STRING, String(std::move(str)));
   }
   case BOOLEAN: {
-    bool value = bytecode[0] != 0;
-    bytecode.erase(bytecode.begin());
-    return Object(BOOLEAN, value);
+    uint8_t value;
+    source.read(&value, 1);
+    return Object(BOOLEAN, value != 0);
   }
   case LIST: {
     uint32_t length;
-    std::memcpy(&length, bytecode.data(), sizeof(uint32_t));
-    bytecode.erase(bytecode.begin(), bytecode.begin() + sizeof(uint32_t));
+    source.read(reinterpret_cast<uint8_t *>(&length), sizeof(uint32_t));
+
+    ListData list;
+    for (size_t i = 0; i < length; ++i) {
+      list.push_back(decode_object(source));
+    }
+    return Object(LIST, List(std::move(list)));
+  }
+  case INT_ARRAY:
+    return Object(INT_ARRAY, decode_array<int64_t>(source));
+  case FLOAT_ARRAY:
+    return Object(FLOAT_ARRAY, decode_array<double>(source));
+  case MAP: {
+    uint32_t length;
+    source.read(reinterpret_cast<uint8_t *>(&length), sizeof(uint32_t));
 
-    std::vector<Object> list;
+    MapTable table;
     for (size_t i = 0; i < length; ++i) {
-      list.push_back(decode_object(bytecode));
+      Object key = decode_object(source);
+      if (!MapTable::is_hashable(key))
+        throw std::runtime_error("Invalid MAP key");
+      table.set(std::move(key), decode_object(source));
     }
-    return Object(LIST, list);
+    return Object(MAP, Map(std::move(table)));
   }
   case NULL_TYPE:
     return Object();
@@ -1,12 +1,19 @@
 #ifndef OBJECT_H
 #define OBJECT_H
 
+#include "stream.h"
 #include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <memory_resource>
+#include <string_view>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
-using std::string, std::vector, std::monostate, std::get, std::cout;
+using std::string, std::vector, std::monostate, std::get, std::cout,
+    std::shared_ptr, std::string_view;
 
 enum Type {
   NULL_TYPE,
@@ -15,15 +22,303 @@ enum Type {
   STRING,
   BOOLEAN,
   LIST,
+  INT_ARRAY,
+  FLOAT_ARRAY,
+  MAP,
+};
+
+using StringData = std::pmr::string;
+
+#define SSO_CAPACITY 15
+
+// Immutable string value. Strings of up to SSO_CAPACITY bytes are stored
+// inline with their length and never allocate. Longer ones are a reference
+// counted buffer plus the window of it this value covers, so copies and
+// substrings share one buffer and concat() can append to the end of a buffer
+// without disturbing the strings that already use it. Strings that went
+// through a StringTable can be compared by pointer alone. A heap buffer and
+// its reference count live in the memory resource the StringData was built
+// with.
+class String {
+public:
+  String() : small_size(0) {}
+  String(const char *str) : String(string_view(str)) {}
+  String(const string &str) : String(string_view(str)) {}
+  String(string_view str);
+  String(StringData str);
+
+  String(const String &other);
+  String(String &&other) noexcept;
+  String &operator=(const String &other);
+  String &operator=(String &&other) noexcept;
+  ~String();
+
+  // `left` followed by `right`. Appends in place when `left` ends its buffer
+  // and that buffer lives in `resource`, otherwise the result is a new
+  // buffer of exactly the right size.
+  static String concat(const String &left, string_view right,
+                       std::pmr::memory_resource *resource);
+
+  string_view str() const {
+    return is_inline() ? string_view(small, small_size)
+                       : string_view(data->data() + offset, length);
+  }
+  size_t size() const { return is_inline() ? small_size : length; }
+  bool is_inline() const { return small_size != HEAP; }
+  bool is_interned() const { return interned; }
+  const void *identity() const { return is_inline() ? nullptr : data.get(); }
+  std::pmr::memory_resource *resource() const {
+    return is_inline() ? nullptr : data->get_allocator().resource();
+  }
+
+  // The whole buffer this string is a window of, and where the window starts.
+  string_view buffer() const {
+    return is_inline() ? str() : string_view(*data);
+  }
+  size_t buffer_offset() const { return is_inline() ? 0 : offset; }
+
+  // `size` bytes starting at `pos`, sharing this string's buffer unless the
+  // result fits inline. The caller checks the bounds.
+  String substr(size_t pos, size_t size) const;
+
+  bool operator==(const String &other) const {
+    if (is_inline() && other.is_inline())
+      return small_size == other.small_size &&
+             std::memcmp(small, other.small, small_size) == 0;
+    if (is_inline() != other.is_inline() || length != other.length)
+      return false;
+    if (data == other.data && offset == other.offset)
+      return true;
+    if (interned && other.interned)
+      return false;
+    return str() == other.str();
+  }
+  bool operator!=(const String &other) const { return !(*this == other); }
+
+private:
+  friend class StringTable;
+
+  static constexpr uint8_t HEAP = 0xff;
+
+  String(shared_ptr<StringData> shared, uint32_t offset, uint32_t length,
+         bool interned)
+      : interned(interned), offset(offset), length(length) {
+    new (&data) shared_ptr<StringData>(std::move(shared));
+  }
+
+  union {
+    char small[SSO_CAPACITY];
+    shared_ptr<StringData> data;
+  };
+  uint8_t small_size = HEAP;
+  bool interned = false;
+  uint32_t offset = 0;
+  uint32_t length = 0;
+};
+
+inline String::String(string_view str) {
+  if (str.size() <= SSO_CAPACITY) {
+    std::memcpy(small, str.data(), str.size());
+    small_size = str.size();
+  } else {
+    new (&data) shared_ptr<StringData>(std::make_shared<StringData>(str));
+    length = str.size();
+  }
+}
+
+inline String::String(StringData str) {
+  if (str.size() <= SSO_CAPACITY) {
+    std::memcpy(small, str.data(), str.size());
+    small_size = str.size();
+  } else {
+    length = str.size();
+    new (&data) shared_ptr<StringData>(std::allocate_shared<StringData>(
+        std::pmr::polymorphic_allocator<StringData>(str.get_allocator()),
+        std::move(str)));
+  }
+}
+
+inline String::String(const String &other)
+    : small_size(other.small_size), interned(other.interned) {
+  if (other.is_inline()) {
+    std::memcpy(small, other.small, small_size);
+  } else {
+    new (&data) shared_ptr<StringData>(other.data);
+    offset = other.offset;
+    length = other.length;
+  }
+}
+
+inline String::String(String &&other) noexcept
+    : small_size(other.small_size), interned(other.interned) {
+  if (other.is_inline()) {
+    std::memcpy(small, other.small, small_size);
+  } else {
+    new (&data) shared_ptr<StringData>(std::move(other.data));
+    offset = other.offset;
+    length = other.length;
+  }
+}
+
+inline String &String::operator=(const String &other) {
+  if (this != &other) {
+    this->~String();
+    new (this) String(other);
+  }
+  return *this;
+}
+
+inline String &String::operator=(String &&other) noexcept {
+  if (this != &other) {
+    this->~String();
+    new (this) String(std::move(other));
+  }
+  return *this;
+}
+
+inline String::~String() {
+  if (!is_inline())
+    data.~shared_ptr();
+}
+
+// Keeps exactly one copy of every string passed to intern().
+class StringTable {
+public:
+  String intern(const String &str);
+  size_t size() const { return table.size(); }
+
+private:
+  std::unordered_map<string_view, shared_ptr<StringData>> table;
+};
+
+struct Object;
+using ListData = std::pmr::vector<Object>;
+
+// Reference counted list. Copies share their elements; mutate() first gives
+// the list a private copy when the elements are shared (copy-on-write). A
+// slice is a window onto another list's elements and keeps them alive.
+class List {
+public:
+  List();
+  List(std::initializer_list<Object> elems);
+  List(ListData elems);
+
+  size_t size() const { return is_view() ? length : data->size(); }
+  const Object &operator[](size_t index) const {
+    return (*data)[offset + index];
+  }
+  ListData::const_iterator begin() const { return data->begin() + offset; }
+  ListData::const_iterator end() const { return begin() + size(); }
+
+  // The elements of the list this one is a window of, and where it starts.
+  const ListData &buffer() const { return *data; }
+  size_t buffer_offset() const { return offset; }
+  bool is_view() const { return length != WHOLE; }
+
+  // `size` elements starting at `pos`, sharing this list's elements. The
+  // caller checks the bounds.
+  List slice(size_t pos, size_t size) const;
+
+  bool is_shared() const { return data.use_count() > 1; }
+  const void *identity() const { return data.get(); }
+  std::pmr::memory_resource *resource() const {
+    return data->get_allocator().resource();
+  }
+
+  // A shared list, a slice or a list living in another memory resource is
+  // copied into `resource` before being handed out.
+  ListData &mutate(std::pmr::memory_resource *resource =
+                       std::pmr::get_default_resource());
+
+private:
+  static constexpr uint32_t WHOLE = UINT32_MAX;
+
+  shared_ptr<ListData> data;
+  uint32_t offset = 0;
+  uint32_t length = WHOLE; // WHOLE unless this is a slice
+};
+
+// Reference counted array of unboxed numbers stored contiguously. Element
+// types are checked once for the whole array rather than per element; copies
+// share their storage and mutate() copies it first when it is shared or
+// lives in another memory resource, like List.
+template <typename T> class Array {
+public:
+  using Data = std::pmr::vector<T>;
+
+  Array() : data(std::make_shared<Data>()) {}
+  Array(std::initializer_list<T> elems)
+      : data(std::make_shared<Data>(elems)) {}
+  Array(Data elems)
+      : data(std::allocate_shared<Data>(
+            std::pmr::polymorphic_allocator<Data>(elems.get_allocator()),
+            std::move(elems))) {}
+
+  size_t size() const { return data->size(); }
+  const T &operator[](size_t index) const { return (*data)[index]; }
+  const T *begin() const { return data->data(); }
+  const T *end() const { return data->data() + data->size(); }
+
+  bool is_shared() const { return data.use_count() > 1; }
+  const void *identity() const { return data.get(); }
+  std::pmr::memory_resource *resource() const {
+    return data->get_allocator().resource();
+  }
+
+  Data &mutate(std::pmr::memory_resource *resource =
+                   std::pmr::get_default_resource()) {
+    if (is_shared() || this->resource() != resource)
+      data = std::allocate_shared<Data>(
+          std::pmr::polymorphic_allocator<Data>(resource), *data);
+    return *data;
+  }
+
+private:
+  shared_ptr<Data> data;
+};
+
+using IntArray = Array<int64_t>;
+using FloatArray = Array<double>;
+
+class MapTable;
+
+// Reference counted hash map from numbers, strings and booleans to any
+// value, shared and copied on write like List. The table itself is a
+// MapTable (map.h).
+class Map {
+public:
+  Map();
+  Map(MapTable table);
+
+  size_t size() const;
+  // The value stored under `key`, or null when there is none.
+  const Object *find(const Object &key) const;
+  const MapTable &table() const { return *data; }
+
+  bool is_shared() const { return data.use_count() > 1; }
+  const void *identity() const { return data.get(); }
+  std::pmr::memory_resource *resource() const;
+
+  // A shared map or a map living in another memory resource is copied into
+  // `resource` before being handed out.
+  MapTable &mutate(std::pmr::memory_resource *resource =
+                       std::pmr::get_default_resource());
+  void print() const;
+
+private:
+  shared_ptr<MapTable> data;
 };
 
 struct Object {
   Type type;
-  std::variant<monostate, int, double, string, bool, vector<Object>> value;
+  std::variant<monostate, int, double, String, bool, List, IntArray,
+               FloatArray, Map>
+      value;
 
   Object() : type(Type::NULL_TYPE), value(monostate{}) {}
 
-  template <typename T> Object(Type type, T val) : type(type), value(val) {}
+  template <typename T>
+  Object(Type type, T val) : type(type), value(std::move(val)) {}
 
   void print() const {
     switch (type) {
@@ -37,7 +332,7 @@ struct Object {
       cout << as<double>();
       break;
     case STRING:
-      cout << as<string>();
+      cout << as<String>().str();
       break;
     case BOOLEAN: {
       if (as<bool>())
@@ -47,7 +342,7 @@ struct Object {
       break;
     }
     case LIST: {
-      vector<Object> list = as<vector<Object>>();
+      const List &list = as<List>();
       cout << "[";
       for (size_t i = 0; i < list.size(); i++) {
         if (i != 0)
@@ -57,9 +352,28 @@ struct Object {
       cout << "]";
       break;
     }
+    case INT_ARRAY:
+      print_array(as<IntArray>());
+      break;
+    case FLOAT_ARRAY:
+      print_array(as<FloatArray>());
+      break;
+    case MAP:
+      as<Map>().print();
+      break;
     }
   }
 
+  template <typename T> static void print_array(const Array<T> &array) {
+    cout << "[";
+    for (size_t i = 0; i < array.size(); i++) {
+      if (i != 0)
+        cout << ", ";
+      cout << array[i];
+    }
+    cout << "]";
+  }
+
   template <typename T> bool is_type() const {
     return std::holds_alternative<T>(value);
   }
@@ -69,8 +383,42 @@ struct Object {
   template <typename T> const T &as() const { return get<T>(value); }
 };
 
+inline List::List() : data(std::make_shared<ListData>()) {}
+
+inline List::List(std::initializer_list<Object> elems)
+    : data(std::make_shared<ListData>(elems)) {}
+
+inline List::List(ListData elems)
+    : data(std::allocate_shared<ListData>(
+          std::pmr::polymorphic_allocator<ListData>(elems.get_allocator()),
+          std::move(elems))) {}
+
+inline List List::slice(size_t pos, size_t size) const {
+  List result = *this;
+  result.offset = offset + pos;
+  result.length =
+      result.offset == 0 && size == data->size() ? WHOLE : size;
+  return result;
+}
+
+inline ListData &List::mutate(std::pmr::memory_resource *resource) {
+  if (is_view()) {
+    data = std::allocate_shared<ListData>(
+        std::pmr::polymorphic_allocator<ListData>(resource), begin(), end());
+    offset = 0;
+    length = WHOLE;
+  } else if (is_shared() || this->resource() != resource) {
+    data = std::allocate_shared<ListData>(
+        std::pmr::polymorphic_allocator<ListData>(resource), *data);
+  }
+  return *data;
+}
+
 string type_to_string(Type type);
 void encode_object(const Object &obj, vector<uint8_t> &bytecode);
 Object decode_object(vector<uint8_t> &bytecode);
+Object decode_object(ByteSource &source);
+size_t skip_object(const uint8_t *data, size_t size, size_t pos);
+Object intern_object(const Object &obj, StringTable &table);
 
 #endif // OBJECT_H
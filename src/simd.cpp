@@ -0,0 +1,520 @@
+#include "simd.h"
+#include "bytecode.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <emmintrin.h>
+#endif
+
+static SimdLevel detect_level() {
+#if defined(__x86_64__)
+  if (__builtin_cpu_supports("avx2"))
+    return SIMD_AVX2;
+  return SIMD_SSE2;
+#else
+  return SIMD_SCALAR;
+#endif
+}
+
+static SimdLevel &current_level() {
+  static SimdLevel level = simd_supported();
+  return level;
+}
+
+SimdLevel simd_supported() {
+  static SimdLevel supported = detect_level();
+  return supported;
+}
+
+SimdLevel simd_level() { return current_level(); }
+
+void set_simd_level(SimdLevel level) {
+  current_level() = level < simd_supported() ? level : simd_supported();
+}
+
+const char *simd_level_name(SimdLevel level) {
+  switch (level) {
+  case SIMD_SCALAR:
+    return "scalar";
+  case SIMD_SSE2:
+    return "sse2";
+  case SIMD_AVX2:
+    return "avx2";
+  }
+  return "unknown";
+}
+
+static std::runtime_error unsupported(uint8_t op) {
+  return std::runtime_error("Unsupported array operation " +
+                            inst_to_string(op) + ".");
+}
+
+// scalar {{{
+template <typename T, typename R, typename F>
+static void scalar_loop(Operand<T> a, Operand<T> b, R *out, size_t start,
+                        size_t n, F f) {
+  for (size_t i = start; i < n; i++)
+    out[i] = f(a.at(i), b.at(i));
+}
+
+// Integer arithmetic goes through uint64_t so overflow wraps instead of
+// being undefined.
+static void scalar_arith(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                         int64_t *out, size_t start, size_t n) {
+  switch (op) {
+  case ADD:
+    scalar_loop(a, b, out, start, n, [](int64_t x, int64_t y) {
+      return static_cast<int64_t>(static_cast<uint64_t>(x) +
+                                  static_cast<uint64_t>(y));
+    });
+    break;
+  case SUB:
+    scalar_loop(a, b, out, start, n, [](int64_t x, int64_t y) {
+      return static_cast<int64_t>(static_cast<uint64_t>(x) -
+                                  static_cast<uint64_t>(y));
+    });
+    break;
+  case MUL:
+    scalar_loop(a, b, out, start, n, [](int64_t x, int64_t y) {
+      return static_cast<int64_t>(static_cast<uint64_t>(x) *
+                                  static_cast<uint64_t>(y));
+    });
+    break;
+  default:
+    throw unsupported(op);
+  }
+}
+
+static void scalar_arith(uint8_t op, Operand<double> a, Operand<double> b,
+                         double *out, size_t start, size_t n) {
+  switch (op) {
+  case ADD:
+    scalar_loop(a, b, out, start, n, [](double x, double y) { return x + y; });
+    break;
+  case SUB:
+    scalar_loop(a, b, out, start, n, [](double x, double y) { return x - y; });
+    break;
+  case MUL:
+    scalar_loop(a, b, out, start, n, [](double x, double y) { return x * y; });
+    break;
+  case DIV:
+    scalar_loop(a, b, out, start, n, [](double x, double y) { return x / y; });
+    break;
+  default:
+    throw unsupported(op);
+  }
+}
+
+template <typename T>
+static void scalar_compare(uint8_t op, Operand<T> a, Operand<T> b,
+                           int64_t *out, size_t start, size_t n) {
+  switch (op) {
+  case EQ:
+    scalar_loop(a, b, out, start, n,
+                [](T x, T y) -> int64_t { return x == y; });
+    break;
+  case NEQ:
+    scalar_loop(a, b, out, start, n,
+                [](T x, T y) -> int64_t { return x != y; });
+    break;
+  case LT:
+    scalar_loop(a, b, out, start, n,
+                [](T x, T y) -> int64_t { return x < y; });
+    break;
+  case GT:
+    scalar_loop(a, b, out, start, n,
+                [](T x, T y) -> int64_t { return x > y; });
+    break;
+  case LTE:
+    scalar_loop(a, b, out, start, n,
+                [](T x, T y) -> int64_t { return x <= y; });
+    break;
+  case GTE:
+    scalar_loop(a, b, out, start, n,
+                [](T x, T y) -> int64_t { return x >= y; });
+    break;
+  default:
+    throw unsupported(op);
+  }
+}
+// scalar }}}
+
+// sse2 {{{
+#if defined(__x86_64__)
+static inline __m128i load(const int64_t *p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+static inline __m128d load(const double *p) { return _mm_loadu_pd(p); }
+static inline __m128i splat(int64_t value) { return _mm_set1_epi64x(value); }
+static inline __m128d splat(double value) { return _mm_set1_pd(value); }
+
+template <bool broadcast_a, bool broadcast_b, typename T, typename Body>
+static size_t vector_loop(Operand<T> a, Operand<T> b, size_t n, Body body) {
+  using V = decltype(load(a.data));
+  constexpr size_t lanes = sizeof(V) / sizeof(T);
+  V x = broadcast_a ? splat(a.data[0]) : V();
+  V y = broadcast_b ? splat(b.data[0]) : V();
+
+  size_t i = 0;
+  for (; i + lanes <= n; i += lanes)
+    body(i, broadcast_a ? x : load(a.data + i),
+         broadcast_b ? y : load(b.data + i));
+  return i;
+}
+
+// Picks the loop for the operands' broadcast pattern. Two broadcast
+// operands are left to the scalar loop.
+template <typename T, typename Body>
+static size_t each_vector(Operand<T> a, Operand<T> b, size_t n, Body body) {
+  if (a.broadcast && b.broadcast)
+    return 0;
+  if (a.broadcast)
+    return vector_loop<true, false>(a, b, n, body);
+  if (b.broadcast)
+    return vector_loop<false, true>(a, b, n, body);
+  return vector_loop<false, false>(a, b, n, body);
+}
+
+// SSE2 has no 64-bit multiply, so integer MUL stays scalar.
+size_t sse2_arith(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                  int64_t *out, size_t n) {
+  auto store = [out](size_t i, __m128i r) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), r);
+  };
+  switch (op) {
+  case ADD:
+    return each_vector(a, b, n, [&](size_t i, __m128i x, __m128i y) {
+      store(i, _mm_add_epi64(x, y));
+    });
+  case SUB:
+    return each_vector(a, b, n, [&](size_t i, __m128i x, __m128i y) {
+      store(i, _mm_sub_epi64(x, y));
+    });
+  default:
+    return 0;
+  }
+}
+
+size_t sse2_arith(uint8_t op, Operand<double> a, Operand<double> b,
+                  double *out, size_t n) {
+  switch (op) {
+  case ADD:
+    return each_vector(a, b, n, [&](size_t i, __m128d x, __m128d y) {
+      _mm_storeu_pd(out + i, _mm_add_pd(x, y));
+    });
+  case SUB:
+    return each_vector(a, b, n, [&](size_t i, __m128d x, __m128d y) {
+      _mm_storeu_pd(out + i, _mm_sub_pd(x, y));
+    });
+  case MUL:
+    return each_vector(a, b, n, [&](size_t i, __m128d x, __m128d y) {
+      _mm_storeu_pd(out + i, _mm_mul_pd(x, y));
+    });
+  case DIV:
+    return each_vector(a, b, n, [&](size_t i, __m128d x, __m128d y) {
+      _mm_storeu_pd(out + i, _mm_div_pd(x, y));
+    });
+  default:
+    return 0;
+  }
+}
+
+// A comparison sets every bit of a lane that holds, so masking with 1 turns
+// it into the 0 or 1 stored in the result.
+size_t sse2_compare(uint8_t op, Operand<double> a, Operand<double> b,
+                    int64_t *out, size_t n) {
+  __m128i one = _mm_set1_epi64x(1);
+  auto store = [out, one](size_t i, __m128d mask) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                     _mm_and_si128(_mm_castpd_si128(mask), one));
+  };
+  switch (op) {
+  case EQ:
+    return each_vector(a, b, n, [&](size_t i, __m128d x, __m128d y) {
+      store(i, _mm_cmpeq_pd(x, y));
+    });
+  case NEQ:
+    return each_vector(a, b, n, [&](size_t i, __m128d x, __m128d y) {
+      store(i, _mm_cmpneq_pd(x, y));
+    });
+  case LT:
+    return each_vector(a, b, n, [&](size_t i, __m128d x, __m128d y) {
+      store(i, _mm_cmplt_pd(x, y));
+    });
+  case GT:
+    return each_vector(a, b, n, [&](size_t i, __m128d x, __m128d y) {
+      store(i, _mm_cmpgt_pd(x, y));
+    });
+  case LTE:
+    return each_vector(a, b, n, [&](size_t i, __m128d x, __m128d y) {
+      store(i, _mm_cmple_pd(x, y));
+    });
+  case GTE:
+    return each_vector(a, b, n, [&](size_t i, __m128d x, __m128d y) {
+      store(i, _mm_cmpge_pd(x, y));
+    });
+  default:
+    return 0;
+  }
+}
+
+template <typename T, typename V> static T lane_sum(V v) {
+  alignas(16) T lanes[sizeof(V) / sizeof(T)];
+  std::memcpy(lanes, &v, sizeof(V));
+  T sum = 0;
+  for (T lane : lanes)
+    sum += lane;
+  return sum;
+}
+
+size_t sse2_sum(const int64_t *data, size_t n, int64_t &acc) {
+  __m128i sum = _mm_setzero_si128();
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    sum = _mm_add_epi64(sum, load(data + i));
+  acc += lane_sum<int64_t>(sum);
+  return i;
+}
+
+size_t sse2_sum(const double *data, size_t n, double &acc) {
+  __m128d sum = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    sum = _mm_add_pd(sum, load(data + i));
+  acc += lane_sum<double>(sum);
+  return i;
+}
+
+size_t sse2_dot(const double *a, const double *b, size_t n, double &acc) {
+  __m128d sum = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    sum = _mm_add_pd(sum, _mm_mul_pd(load(a + i), load(b + i)));
+  acc += lane_sum<double>(sum);
+  return i;
+}
+
+// minpd and maxpd return their second operand when either is NaN, so NaN
+// elements never reach the accumulator and are tracked separately.
+template <bool is_min>
+static size_t sse2_min_max(const double *data, size_t n, double &acc) {
+  __m128d best = _mm_set1_pd(acc);
+  __m128d nan = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128d x = load(data + i);
+    best = is_min ? _mm_min_pd(x, best) : _mm_max_pd(x, best);
+    nan = _mm_or_pd(nan, _mm_cmpunord_pd(x, x));
+  }
+
+  alignas(16) double lanes[2];
+  _mm_store_pd(lanes, best);
+  acc = is_min ? std::fmin(lanes[0], lanes[1]) : std::fmax(lanes[0], lanes[1]);
+  if (_mm_movemask_pd(nan) != 0)
+    acc = std::numeric_limits<double>::quiet_NaN();
+  return i;
+}
+
+size_t sse2_min(const double *data, size_t n, double &acc) {
+  return sse2_min_max<true>(data, n, acc);
+}
+
+size_t sse2_max(const double *data, size_t n, double &acc) {
+  return sse2_min_max<false>(data, n, acc);
+}
+
+// A lane that compares true is all ones, or -1, so subtracting the mask
+// counts it.
+size_t sse2_count_if(const double *data, size_t n, size_t &acc) {
+  __m128i count = _mm_setzero_si128();
+  __m128d zero = _mm_setzero_pd();
+  size_t i = 0;
+  for (; i + 2 <= n; i += 2)
+    count = _mm_sub_epi64(
+        count, _mm_castpd_si128(_mm_cmpneq_pd(load(data + i), zero)));
+  acc += lane_sum<int64_t>(count);
+  return i;
+}
+#endif
+// sse2 }}}
+
+void simd_arith(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                int64_t *out, size_t n) {
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_arith(op, a, b, out, n);
+  else if (simd_level() == SIMD_SSE2)
+    done = sse2_arith(op, a, b, out, n);
+#endif
+  scalar_arith(op, a, b, out, done, n);
+}
+
+void simd_arith(uint8_t op, Operand<double> a, Operand<double> b, double *out,
+                size_t n) {
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_arith(op, a, b, out, n);
+  else if (simd_level() == SIMD_SSE2)
+    done = sse2_arith(op, a, b, out, n);
+#endif
+  scalar_arith(op, a, b, out, done, n);
+}
+
+// SSE2 has no 64-bit integer comparisons, so those need AVX2.
+void simd_compare(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                  int64_t *out, size_t n) {
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_compare(op, a, b, out, n);
+#endif
+  scalar_compare(op, a, b, out, done, n);
+}
+
+void simd_compare(uint8_t op, Operand<double> a, Operand<double> b,
+                  int64_t *out, size_t n) {
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_compare(op, a, b, out, n);
+  else if (simd_level() == SIMD_SSE2)
+    done = sse2_compare(op, a, b, out, n);
+#endif
+  scalar_compare(op, a, b, out, done, n);
+}
+
+// reductions {{{
+int64_t simd_sum(const int64_t *data, size_t n) {
+  int64_t acc = 0;
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_sum(data, n, acc);
+  else if (simd_level() == SIMD_SSE2)
+    done = sse2_sum(data, n, acc);
+#endif
+  uint64_t sum = acc;
+  for (size_t i = done; i < n; i++)
+    sum += static_cast<uint64_t>(data[i]);
+  return static_cast<int64_t>(sum);
+}
+
+double simd_sum(const double *data, size_t n) {
+  double acc = 0;
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_sum(data, n, acc);
+  else if (simd_level() == SIMD_SSE2)
+    done = sse2_sum(data, n, acc);
+#endif
+  for (size_t i = done; i < n; i++)
+    acc += data[i];
+  return acc;
+}
+
+int64_t simd_min(const int64_t *data, size_t n) {
+  int64_t acc = std::numeric_limits<int64_t>::max();
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_min(data, n, acc);
+#endif
+  for (size_t i = done; i < n; i++)
+    acc = data[i] < acc ? data[i] : acc;
+  return acc;
+}
+
+int64_t simd_max(const int64_t *data, size_t n) {
+  int64_t acc = std::numeric_limits<int64_t>::min();
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_max(data, n, acc);
+#endif
+  for (size_t i = done; i < n; i++)
+    acc = data[i] > acc ? data[i] : acc;
+  return acc;
+}
+
+double simd_min(const double *data, size_t n) {
+  double acc = std::numeric_limits<double>::infinity();
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_min(data, n, acc);
+  else if (simd_level() == SIMD_SSE2)
+    done = sse2_min(data, n, acc);
+#endif
+  for (size_t i = done; i < n && !std::isnan(acc); i++)
+    acc = std::isnan(data[i]) || data[i] < acc ? data[i] : acc;
+  return acc;
+}
+
+double simd_max(const double *data, size_t n) {
+  double acc = -std::numeric_limits<double>::infinity();
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_max(data, n, acc);
+  else if (simd_level() == SIMD_SSE2)
+    done = sse2_max(data, n, acc);
+#endif
+  for (size_t i = done; i < n && !std::isnan(acc); i++)
+    acc = std::isnan(data[i]) || data[i] > acc ? data[i] : acc;
+  return acc;
+}
+
+// Neither SSE2 nor AVX2 multiplies 64-bit integers, so this is scalar.
+int64_t simd_dot(const int64_t *a, const int64_t *b, size_t n) {
+  uint64_t sum = 0;
+  for (size_t i = 0; i < n; i++)
+    sum += static_cast<uint64_t>(a[i]) * static_cast<uint64_t>(b[i]);
+  return static_cast<int64_t>(sum);
+}
+
+double simd_dot(const double *a, const double *b, size_t n) {
+  double acc = 0;
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_dot(a, b, n, acc);
+  else if (simd_level() == SIMD_SSE2)
+    done = sse2_dot(a, b, n, acc);
+#endif
+  for (size_t i = done; i < n; i++)
+    acc += a[i] * b[i];
+  return acc;
+}
+
+size_t simd_count_if(const int64_t *data, size_t n) {
+  size_t acc = 0;
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_count_if(data, n, acc);
+#endif
+  for (size_t i = done; i < n; i++)
+    acc += data[i] != 0;
+  return acc;
+}
+
+size_t simd_count_if(const double *data, size_t n) {
+  size_t acc = 0;
+  size_t done = 0;
+#if defined(__x86_64__)
+  if (simd_level() == SIMD_AVX2)
+    done = avx2_count_if(data, n, acc);
+  else if (simd_level() == SIMD_SSE2)
+    done = sse2_count_if(data, n, acc);
+#endif
+  for (size_t i = done; i < n; i++)
+    acc += data[i] != 0;
+  return acc;
+}
+// reductions }}}
@@ -0,0 +1,93 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum SimdLevel {
+  SIMD_SCALAR,
+  SIMD_SSE2,
+  SIMD_AVX2,
+};
+
+// The level the kernels below run at, initially the best one the CPU
+// supports. set_simd_level() never goes above that.
+SimdLevel simd_level();
+SimdLevel simd_supported();
+void set_simd_level(SimdLevel level);
+const char *simd_level_name(SimdLevel level);
+
+// One side of an element-wise operation: an array, or a single value
+// repeated for every element when `broadcast` is set.
+template <typename T> struct Operand {
+  const T *data;
+  bool broadcast;
+
+  T at(size_t index) const { return data[broadcast ? 0 : index]; }
+};
+
+// `a op b` for each of the `n` elements of `out`, where `op` is the ADD, SUB,
+// MUL or DIV instruction (DIV for floats only). Integers wrap on overflow.
+void simd_arith(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                int64_t *out, size_t n);
+void simd_arith(uint8_t op, Operand<double> a, Operand<double> b, double *out,
+                size_t n);
+
+// Element-wise EQ, NEQ, LT, GT, LTE or GTE, writing 1 or 0 to `out`.
+void simd_compare(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                  int64_t *out, size_t n);
+void simd_compare(uint8_t op, Operand<double> a, Operand<double> b,
+                  int64_t *out, size_t n);
+
+// Reductions over the `n` elements at `data`. MIN and MAX need n > 0 and
+// give NaN when any element is NaN. COUNT_IF counts the non-zero elements.
+// Float sums are added in a different order at each level, so they can
+// differ in the last bits.
+int64_t simd_sum(const int64_t *data, size_t n);
+double simd_sum(const double *data, size_t n);
+int64_t simd_min(const int64_t *data, size_t n);
+double simd_min(const double *data, size_t n);
+int64_t simd_max(const int64_t *data, size_t n);
+double simd_max(const double *data, size_t n);
+int64_t simd_dot(const int64_t *a, const int64_t *b, size_t n);
+double simd_dot(const double *a, const double *b, size_t n);
+size_t simd_count_if(const int64_t *data, size_t n);
+size_t simd_count_if(const double *data, size_t n);
+
+// Vector kernels behind the functions above. Each handles a prefix of the
+// elements and returns its length, leaving the rest (or everything, for
+// operations it has no instructions for) to the scalar loop.
+size_t sse2_arith(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                  int64_t *out, size_t n);
+size_t sse2_arith(uint8_t op, Operand<double> a, Operand<double> b,
+                  double *out, size_t n);
+size_t sse2_compare(uint8_t op, Operand<double> a, Operand<double> b,
+                    int64_t *out, size_t n);
+size_t avx2_arith(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                  int64_t *out, size_t n);
+size_t avx2_arith(uint8_t op, Operand<double> a, Operand<double> b,
+                  double *out, size_t n);
+size_t avx2_compare(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                    int64_t *out, size_t n);
+size_t avx2_compare(uint8_t op, Operand<double> a, Operand<double> b,
+                    int64_t *out, size_t n);
+
+// Reduction kernels fold a prefix of the elements into `acc`, which holds
+// the identity of the reduction on entry.
+size_t sse2_sum(const int64_t *data, size_t n, int64_t &acc);
+size_t sse2_sum(const double *data, size_t n, double &acc);
+size_t sse2_min(const double *data, size_t n, double &acc);
+size_t sse2_max(const double *data, size_t n, double &acc);
+size_t sse2_dot(const double *a, const double *b, size_t n, double &acc);
+size_t sse2_count_if(const double *data, size_t n, size_t &acc);
+size_t avx2_sum(const int64_t *data, size_t n, int64_t &acc);
+size_t avx2_sum(const double *data, size_t n, double &acc);
+size_t avx2_min(const int64_t *data, size_t n, int64_t &acc);
+size_t avx2_min(const double *data, size_t n, double &acc);
+size_t avx2_max(const int64_t *data, size_t n, int64_t &acc);
+size_t avx2_max(const double *data, size_t n, double &acc);
+size_t avx2_dot(const double *a, const double *b, size_t n, double &acc);
+size_t avx2_count_if(const int64_t *data, size_t n, size_t &acc);
+size_t avx2_count_if(const double *data, size_t n, size_t &acc);
+
+#endif // SIMD_H
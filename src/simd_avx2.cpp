@@ -0,0 +1,278 @@
+// Built with -mavx2. Nothing in here runs unless simd_level() says the CPU
+// supports it.
+#include "simd.h"
+#include "bytecode.h"
+
+#if defined(__x86_64__)
+#include <cstring>
+#include <immintrin.h>
+#include <limits>
+
+static inline __m256i load(const int64_t *p) {
+  return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+}
+static inline __m256d load(const double *p) { return _mm256_loadu_pd(p); }
+static inline __m256i splat(int64_t value) {
+  return _mm256_set1_epi64x(value);
+}
+static inline __m256d splat(double value) { return _mm256_set1_pd(value); }
+
+template <bool broadcast_a, bool broadcast_b, typename T, typename Body>
+static size_t vector_loop(Operand<T> a, Operand<T> b, size_t n, Body body) {
+  using V = decltype(load(a.data));
+  constexpr size_t lanes = sizeof(V) / sizeof(T);
+  V x = broadcast_a ? splat(a.data[0]) : V();
+  V y = broadcast_b ? splat(b.data[0]) : V();
+
+  size_t i = 0;
+  for (; i + lanes <= n; i += lanes)
+    body(i, broadcast_a ? x : load(a.data + i),
+         broadcast_b ? y : load(b.data + i));
+  return i;
+}
+
+template <typename T, typename Body>
+static size_t each_vector(Operand<T> a, Operand<T> b, size_t n, Body body) {
+  if (a.broadcast && b.broadcast)
+    return 0;
+  if (a.broadcast)
+    return vector_loop<true, false>(a, b, n, body);
+  if (b.broadcast)
+    return vector_loop<false, true>(a, b, n, body);
+  return vector_loop<false, false>(a, b, n, body);
+}
+
+static inline void store(int64_t *out, size_t i, __m256i value) {
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), value);
+}
+
+// AVX2 has no 64-bit multiply either, so integer MUL stays scalar.
+size_t avx2_arith(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                  int64_t *out, size_t n) {
+  switch (op) {
+  case ADD:
+    return each_vector(a, b, n, [&](size_t i, __m256i x, __m256i y) {
+      store(out, i, _mm256_add_epi64(x, y));
+    });
+  case SUB:
+    return each_vector(a, b, n, [&](size_t i, __m256i x, __m256i y) {
+      store(out, i, _mm256_sub_epi64(x, y));
+    });
+  default:
+    return 0;
+  }
+}
+
+size_t avx2_arith(uint8_t op, Operand<double> a, Operand<double> b,
+                  double *out, size_t n) {
+  switch (op) {
+  case ADD:
+    return each_vector(a, b, n, [&](size_t i, __m256d x, __m256d y) {
+      _mm256_storeu_pd(out + i, _mm256_add_pd(x, y));
+    });
+  case SUB:
+    return each_vector(a, b, n, [&](size_t i, __m256d x, __m256d y) {
+      _mm256_storeu_pd(out + i, _mm256_sub_pd(x, y));
+    });
+  case MUL:
+    return each_vector(a, b, n, [&](size_t i, __m256d x, __m256d y) {
+      _mm256_storeu_pd(out + i, _mm256_mul_pd(x, y));
+    });
+  case DIV:
+    return each_vector(a, b, n, [&](size_t i, __m256d x, __m256d y) {
+      _mm256_storeu_pd(out + i, _mm256_div_pd(x, y));
+    });
+  default:
+    return 0;
+  }
+}
+
+// Only equality and greater-than exist for 64-bit integers; the other
+// comparisons swap the operands or clear the bit that is set.
+size_t avx2_compare(uint8_t op, Operand<int64_t> a, Operand<int64_t> b,
+                    int64_t *out, size_t n) {
+  __m256i one = _mm256_set1_epi64x(1);
+  switch (op) {
+  case EQ:
+    return each_vector(a, b, n, [&](size_t i, __m256i x, __m256i y) {
+      store(out, i, _mm256_and_si256(_mm256_cmpeq_epi64(x, y), one));
+    });
+  case NEQ:
+    return each_vector(a, b, n, [&](size_t i, __m256i x, __m256i y) {
+      store(out, i, _mm256_andnot_si256(_mm256_cmpeq_epi64(x, y), one));
+    });
+  case LT:
+    return each_vector(a, b, n, [&](size_t i, __m256i x, __m256i y) {
+      store(out, i, _mm256_and_si256(_mm256_cmpgt_epi64(y, x), one));
+    });
+  case GT:
+    return each_vector(a, b, n, [&](size_t i, __m256i x, __m256i y) {
+      store(out, i, _mm256_and_si256(_mm256_cmpgt_epi64(x, y), one));
+    });
+  case LTE:
+    return each_vector(a, b, n, [&](size_t i, __m256i x, __m256i y) {
+      store(out, i, _mm256_andnot_si256(_mm256_cmpgt_epi64(x, y), one));
+    });
+  case GTE:
+    return each_vector(a, b, n, [&](size_t i, __m256i x, __m256i y) {
+      store(out, i, _mm256_andnot_si256(_mm256_cmpgt_epi64(y, x), one));
+    });
+  default:
+    return 0;
+  }
+}
+
+// Ordered predicates, except NEQ, so NaN compares the way it does in C++.
+size_t avx2_compare(uint8_t op, Operand<double> a, Operand<double> b,
+                    int64_t *out, size_t n) {
+  __m256i one = _mm256_set1_epi64x(1);
+  auto mask = [&](size_t i, __m256d cmp) {
+    store(out, i, _mm256_and_si256(_mm256_castpd_si256(cmp), one));
+  };
+  switch (op) {
+  case EQ:
+    return each_vector(a, b, n, [&](size_t i, __m256d x, __m256d y) {
+      mask(i, _mm256_cmp_pd(x, y, _CMP_EQ_OQ));
+    });
+  case NEQ:
+    return each_vector(a, b, n, [&](size_t i, __m256d x, __m256d y) {
+      mask(i, _mm256_cmp_pd(x, y, _CMP_NEQ_UQ));
+    });
+  case LT:
+    return each_vector(a, b, n, [&](size_t i, __m256d x, __m256d y) {
+      mask(i, _mm256_cmp_pd(x, y, _CMP_LT_OQ));
+    });
+  case GT:
+    return each_vector(a, b, n, [&](size_t i, __m256d x, __m256d y) {
+      mask(i, _mm256_cmp_pd(x, y, _CMP_GT_OQ));
+    });
+  case LTE:
+    return each_vector(a, b, n, [&](size_t i, __m256d x, __m256d y) {
+      mask(i, _mm256_cmp_pd(x, y, _CMP_LE_OQ));
+    });
+  case GTE:
+    return each_vector(a, b, n, [&](size_t i, __m256d x, __m256d y) {
+      mask(i, _mm256_cmp_pd(x, y, _CMP_GE_OQ));
+    });
+  default:
+    return 0;
+  }
+}
+
+template <typename T, typename V> static T lane_sum(V v) {
+  alignas(32) T lanes[sizeof(V) / sizeof(T)];
+  std::memcpy(lanes, &v, sizeof(V));
+  T sum = 0;
+  for (T lane : lanes)
+    sum += lane;
+  return sum;
+}
+
+size_t avx2_sum(const int64_t *data, size_t n, int64_t &acc) {
+  __m256i sum = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    sum = _mm256_add_epi64(sum, load(data + i));
+  acc += lane_sum<int64_t>(sum);
+  return i;
+}
+
+size_t avx2_sum(const double *data, size_t n, double &acc) {
+  __m256d sum = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    sum = _mm256_add_pd(sum, load(data + i));
+  acc += lane_sum<double>(sum);
+  return i;
+}
+
+size_t avx2_dot(const double *a, const double *b, size_t n, double &acc) {
+  __m256d sum = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    sum = _mm256_add_pd(sum, _mm256_mul_pd(load(a + i), load(b + i)));
+  acc += lane_sum<double>(sum);
+  return i;
+}
+
+// There is no 64-bit integer min or max before AVX-512, so the lanes where
+// the element wins are picked with a comparison and a blend.
+template <bool is_min>
+static size_t avx2_min_max(const int64_t *data, size_t n, int64_t &acc) {
+  __m256i best = _mm256_set1_epi64x(acc);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256i x = load(data + i);
+    __m256i wins = is_min ? _mm256_cmpgt_epi64(best, x)
+                          : _mm256_cmpgt_epi64(x, best);
+    best = _mm256_blendv_epi8(best, x, wins);
+  }
+
+  alignas(32) int64_t lanes[4];
+  _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), best);
+  for (int64_t lane : lanes)
+    acc = (is_min ? lane < acc : lane > acc) ? lane : acc;
+  return i;
+}
+
+size_t avx2_min(const int64_t *data, size_t n, int64_t &acc) {
+  return avx2_min_max<true>(data, n, acc);
+}
+
+size_t avx2_max(const int64_t *data, size_t n, int64_t &acc) {
+  return avx2_min_max<false>(data, n, acc);
+}
+
+// vminpd and vmaxpd return their second operand when either is NaN, so NaN
+// elements never reach the accumulator and are tracked separately.
+template <bool is_min>
+static size_t avx2_min_max(const double *data, size_t n, double &acc) {
+  __m256d best = _mm256_set1_pd(acc);
+  __m256d nan = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m256d x = load(data + i);
+    best = is_min ? _mm256_min_pd(x, best) : _mm256_max_pd(x, best);
+    nan = _mm256_or_pd(nan, _mm256_cmp_pd(x, x, _CMP_UNORD_Q));
+  }
+
+  alignas(32) double lanes[4];
+  _mm256_store_pd(lanes, best);
+  for (double lane : lanes)
+    acc = (is_min ? lane < acc : lane > acc) ? lane : acc;
+  if (_mm256_movemask_pd(nan) != 0)
+    acc = std::numeric_limits<double>::quiet_NaN();
+  return i;
+}
+
+size_t avx2_min(const double *data, size_t n, double &acc) {
+  return avx2_min_max<true>(data, n, acc);
+}
+
+size_t avx2_max(const double *data, size_t n, double &acc) {
+  return avx2_min_max<false>(data, n, acc);
+}
+
+// A lane that compares true is all ones, or -1, so subtracting the mask
+// counts it.
+size_t avx2_count_if(const int64_t *data, size_t n, size_t &acc) {
+  __m256i zeros = _mm256_setzero_si256();
+  __m256i zero = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    zeros = _mm256_sub_epi64(zeros, _mm256_cmpeq_epi64(load(data + i), zero));
+  acc += i - lane_sum<int64_t>(zeros);
+  return i;
+}
+
+size_t avx2_count_if(const double *data, size_t n, size_t &acc) {
+  __m256i count = _mm256_setzero_si256();
+  __m256d zero = _mm256_setzero_pd();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    count = _mm256_sub_epi64(count, _mm256_castpd_si256(_mm256_cmp_pd(
+                                        load(data + i), zero, _CMP_NEQ_UQ)));
+  acc += lane_sum<int64_t>(count);
+  return i;
+}
+#endif
@@ -0,0 +1,51 @@
+#include "sort.h"
+
+// Inputs smaller than this go to std::sort, which beats eight counting
+// passes there.
+#define RADIX_SORT_MIN 256
+
+// Least significant digit first, one byte per pass. Flipping the sign bit
+// makes the unsigned order of the keys match the signed order of the
+// values. The counts for every byte are gathered in a single pass, and a
+// byte that is the same in every value needs no pass at all, so small
+// values only cost a pass or two.
+void radix_sort(int64_t *data, size_t n) {
+  if (n < RADIX_SORT_MIN) {
+    std::sort(data, data + n);
+    return;
+  }
+
+  const uint64_t sign = uint64_t(1) << 63;
+  std::vector<size_t> counts(8 * 256);
+  for (size_t i = 0; i < n; i++) {
+    uint64_t key = static_cast<uint64_t>(data[i]) ^ sign;
+    for (int byte = 0; byte < 8; byte++)
+      counts[byte * 256 + ((key >> (8 * byte)) & 0xff)]++;
+  }
+
+  std::vector<int64_t> buffer(n);
+  int64_t *from = data;
+  int64_t *to = buffer.data();
+  for (int byte = 0; byte < 8; byte++) {
+    const size_t *count = counts.data() + byte * 256;
+    int shift = 8 * byte;
+    uint64_t first = (static_cast<uint64_t>(from[0]) ^ sign) >> shift;
+    if (count[first & 0xff] == n)
+      continue;
+
+    size_t offsets[256];
+    size_t offset = 0;
+    for (int digit = 0; digit < 256; digit++) {
+      offsets[digit] = offset;
+      offset += count[digit];
+    }
+    for (size_t i = 0; i < n; i++) {
+      uint64_t key = static_cast<uint64_t>(from[i]) ^ sign;
+      to[offsets[(key >> shift) & 0xff]++] = from[i];
+    }
+    std::swap(from, to);
+  }
+
+  if (from != data)
+    std::copy(from, from + n, data);
+}
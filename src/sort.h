@@ -0,0 +1,56 @@
+#ifndef SORT_H
+#define SORT_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Inputs smaller than this are sorted on the calling thread.
+#define PARALLEL_SORT_MIN (1 << 18)
+
+// Sorts 64-bit integers in linear time.
+void radix_sort(int64_t *data, size_t n);
+
+// Sorts the `n` elements at `data` by `less`, which must not throw. Large
+// inputs are cut into one run per thread (0 picks the hardware concurrency),
+// the runs are sorted in parallel and neighbouring runs are then merged in
+// parallel, halving their number each round.
+template <typename T, typename Less>
+void parallel_sort(T *data, size_t n, Less less, unsigned threads = 0) {
+  if (threads == 0)
+    threads = std::thread::hardware_concurrency();
+  if (n < PARALLEL_SORT_MIN || threads <= 1) {
+    std::sort(data, data + n, less);
+    return;
+  }
+
+  std::vector<size_t> bounds(threads + 1);
+  for (unsigned t = 0; t <= threads; t++)
+    bounds[t] = n * t / threads;
+
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < threads; t++)
+    workers.emplace_back([=] {
+      std::sort(data + bounds[t], data + bounds[t + 1], less);
+    });
+  for (auto &worker : workers)
+    worker.join();
+
+  for (unsigned width = 1; width < threads; width *= 2) {
+    workers.clear();
+    for (unsigned t = 0; t + width < threads; t += 2 * width) {
+      size_t first = bounds[t];
+      size_t middle = bounds[t + width];
+      size_t last = bounds[std::min(t + 2 * width, threads)];
+      workers.emplace_back([=] {
+        std::inplace_merge(data + first, data + middle, data + last, less);
+      });
+    }
+    for (auto &worker : workers)
+      worker.join();
+  }
+}
+
+#endif // SORT_H
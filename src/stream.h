@@ -0,0 +1,43 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// Sequential source of bytes consumed by decode_object.
+class ByteSource {
+public:
+  virtual ~ByteSource() = default;
+
+  // Copies exactly `size` bytes into `out` or throws if the source runs dry.
+  virtual void read(uint8_t *out, size_t size) = 0;
+  virtual bool done() = 0;
+  // How many bytes are left to read, so lengths read from the data can be
+  // checked before anything that large is allocated.
+  virtual size_t remaining() const = 0;
+};
+
+class MemorySource : public ByteSource {
+public:
+  MemorySource(const uint8_t *data, size_t size) : data(data), size(size) {}
+
+  void read(uint8_t *out, size_t count) override {
+    if (count > size - pos)
+      throw std::runtime_error("Unexpected end of data");
+    std::memcpy(out, data + pos, count);
+    pos += count;
+  }
+
+  bool done() override { return pos == size; }
+  size_t remaining() const override { return size - pos; }
+  size_t position() const { return pos; }
+
+private:
+  const uint8_t *data;
+  size_t size;
+  size_t pos = 0;
+};
+
+#endif // STREAM_H
@@ -1,9 +1,17 @@
 #include "tests.h"
+#include "arena.h"
 #include "bytecode.h"
 #include "loader.h"
+#include "lz.h"
+#include "map.h"
 #include "object.h"
+#include "simd.h"
+#include "sort.h"
+#include "verifier.h"
 #include "vm.h"
+#include <algorithm>
 #include <cmath>
+#include <cstdio>
 #include <fstream>
 #include <iomanip>
 #include <ios>
@@ -50,12 +58,12 @@ Result assert_float_result(const Object &result, double expected_value) {
 }
 
 Result assert_string_result(const Object &result, string expected_value) {
-  if (!result.is_type<string>()) {
+  if (!result.is_type<String>()) {
     return {false, "type mismatch"};
   }
-  return {result.as<string>() == expected_value,
+  return {result.as<String>().str() == expected_value,
           "value mismatch - wanted: " + expected_value +
-              ", got: " + result.as<string>()};
+              ", got: " + string(result.as<String>().str())};
 }
 
 Result assert_bool_result(const Object &result, bool expected_value) {
@@ -79,8 +87,9 @@ void run_vm_test(const std::vector<uint8_t> &bytecode,
     res = assert_int_result(result, expected_result.as<int>());
   } else if (expected_result.is_type<double>()) {
     res = assert_float_result(result, expected_result.as<double>());
-  } else if (expected_result.is_type<string>()) {
-    res = assert_string_result(result, expected_result.as<string>());
+  } else if (expected_result.is_type<String>()) {
+    res = assert_string_result(result,
+                               string(expected_result.as<String>().str()));
   } else if (expected_result.is_type<bool>()) {
     res = assert_bool_result(result, expected_result.as<bool>());
   }
@@ -175,6 +184,10 @@ void eq_test() {
       {Object(STRING, "Hello, World!"), Object(STRING, "Hello, World!")},
       "eq_test", "\"Hello, World!\" == \"Hello, World!\" = true",
       Object(BOOLEAN, true));
+
+  run_vm_test({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, EQ, HALT},
+              {Object(BOOLEAN, true), Object(BOOLEAN, false)}, "eq_test",
+              "true == false = false", Object(BOOLEAN, false));
 }
 // eq_test }}}
 
@@ -325,6 +338,24 @@ void bit_not_test() {
 }
 // bit_not_test }}}
 
+// neg_test {{{
+void neg_test() {
+  run_vm_test({PUSH, 0, 0, 0, 0, NEG, HALT}, {Object(INTEGER, 3)}, "neg_test",
+              "-3 = -3", Object(INTEGER, -3));
+  run_vm_test({PUSH, 0, 0, 0, 0, NEG, HALT}, {Object(INTEGER, INT32_MIN)},
+              "neg_test", "-INT_MIN wraps to INT_MIN",
+              Object(INTEGER, INT32_MIN));
+
+  VM vm({PUSH, 0, 0, 0, 0, NEG, HALT}, {Object(FLOAT, 0.0)});
+  vm.run();
+  Object zero = vm.pop();
+  print_test_result("neg_test", "-0.0 = -0.0",
+                    {zero.is_type<double>() && zero.as<double>() == 0 &&
+                         std::signbit(zero.as<double>()),
+                     "sign of zero lost"});
+}
+// neg_test }}}
+
 // xor_test {{{
 void xor_test() {
   run_vm_test({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, XOR, HALT},
@@ -348,7 +379,7 @@ void encode_bytecode_test() {
     Object(INTEGER, 2839),
     Object(FLOAT, 82.2842),
     Object(INTEGER, 28),
-    Object(LIST, vector<Object>{
+    Object(LIST, List{
       Object(INTEGER, 10),
       Object(INTEGER, 12),
       Object(INTEGER, 821),
@@ -369,11 +400,994 @@ void load_bytecode_test() {
 }
 // load_bytecode_test }}}
 
+// dedup_test {{{
+void dedup_test() {
+  // clang-format off
+  const vector<uint8_t> bytecode = {
+    PUSH, 1, 0, 0, 0,
+    PUSH, 3, 0, 0, 0,
+    EQ,
+    HALT,
+  };
+  const vector<Object> const_pool = {
+    Object(INTEGER, 7),
+    Object(STRING, "key"),
+    Object(INTEGER, 7),
+    Object(STRING, "key"),
+    Object(FLOAT, 7.0),
+  };
+  // clang-format on
+
+  File file = {MAJOR, MINOR, bytecode, const_pool, 0};
+  generate_file(file, "dedup.bin");
+
+  File loaded = load_from_file("dedup.bin");
+  print_test_result("dedup_test", "7, \"key\", 7, \"key\", 7.0 -> 3 constants",
+                    {loaded.const_pool.size() == 3,
+                     "pool size mismatch - wanted: 3, got: " +
+                         std::to_string(loaded.const_pool.size())});
+  run_vm_test(loaded.bytecode, loaded.const_pool, "dedup_test",
+              "\"key\" == \"key\" = true", Object(BOOLEAN, true));
+
+  // A constant one VM interned, handed to another VM's pool along with the
+  // same literal on a buffer of its own.
+  const char *literal = "longer than fifteen bytes";
+  VM first({PUSH, 0, 0, 0, 0, HALT}, {Object(STRING, literal)});
+  first.run();
+  VM second({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, EQ, HALT},
+            {first.pop(), Object(STRING, literal)});
+  second.run();
+  print_test_result("dedup_test", "constants interned by another VM are equal",
+                    assert_bool_result(second.pop(), true));
+}
+// dedup_test }}}
+
+// compression_test {{{
+void lz_roundtrip_test() {
+  // Mix of repetitive and pseudo random bytes, long enough for the streaming
+  // decoder to slide its window several times.
+  vector<uint8_t> raw;
+  uint32_t seed = 12345;
+  for (int i = 0; i < 400000; i++) {
+    seed = seed * 1103515245 + 12345;
+    raw.push_back(i % 1000 < 600 ? "clarity"[i % 7] : (seed >> 16) & 0xff);
+  }
+
+  vector<uint8_t> compressed;
+  lz_compress(raw.data(), raw.size(), compressed);
+
+  vector<uint8_t> decompressed(raw.size());
+  lz_decompress(compressed.data(), compressed.size(), decompressed.data(),
+                decompressed.size());
+
+  vector<uint8_t> streamed(raw.size());
+  LzSource source(compressed.data(), compressed.size(), raw.size());
+  for (size_t pos = 0, chunk = 1; pos < raw.size(); pos += chunk, chunk++) {
+    if (chunk > raw.size() - pos)
+      chunk = raw.size() - pos;
+    source.read(streamed.data() + pos, chunk);
+  }
+
+  print_test_result("compression_test", "lz block roundtrip",
+                    {decompressed == raw, "block decode mismatch"});
+  print_test_result("compression_test", "lz streaming roundtrip",
+                    {streamed == raw && source.done(),
+                     "streaming decode mismatch"});
+}
+
+void compressed_file_test() {
+  vector<uint8_t> bytecode;
+  vector<Object> const_pool;
+  for (int i = 0; i < 2000; i++) {
+    const_pool.push_back(Object(STRING, "label_" + std::to_string(i)));
+    const_pool.emplace_back(INTEGER, i);
+  }
+  const_pool.push_back(Object(STRING, string(200000, 'x')));
+
+  for (uint32_t i = 0; i < 2000; i++) {
+    uint32_t index = 2 * i + 1;
+    bytecode.insert(bytecode.end(), {PUSH, static_cast<uint8_t>(index),
+                                     static_cast<uint8_t>(index >> 8), 0, 0});
+    if (i != 0)
+      bytecode.push_back(ADD);
+  }
+  bytecode.push_back(HALT);
+
+  File file = {MAJOR, MINOR, bytecode, const_pool, 0};
+  generate_file(file, "compressed.bin",
+                COMPRESS_BYTECODE | COMPRESS_CONST_POOL);
+
+  File loaded = load_from_file("compressed.bin");
+  bool same = loaded.bytecode == bytecode &&
+              loaded.const_pool.size() == const_pool.size();
+  for (size_t i = 0; same && i < const_pool.size(); i++) {
+    if (const_pool[i].is_type<String>())
+      same = loaded.const_pool[i].is_type<String>() &&
+             loaded.const_pool[i].as<String>() == const_pool[i].as<String>();
+    else
+      same = loaded.const_pool[i].is_type<int>() &&
+             loaded.const_pool[i].as<int>() == const_pool[i].as<int>();
+  }
+
+  print_test_result("compression_test", "compressed file roundtrip",
+                    {same, "loaded sections differ from the original"});
+  run_vm_test(loaded.bytecode, loaded.const_pool, "compression_test",
+              "0 + 1 + ... + 1999 = 1999000", Object(INTEGER, 1999000));
+}
+
+// Whether loading `file`, written with `flags` and then the header field at
+// `offset` overwritten by `value`, fails cleanly.
+bool rejects_patched_header(const File &file, uint32_t flags, size_t offset,
+                            uint32_t value) {
+  const char *path = "patched.bin";
+  generate_file(file, path, flags);
+  std::fstream patched(path, std::ios::binary | std::ios::in | std::ios::out);
+  patched.seekp(offset);
+  for (int i = 0; i < 4; i++)
+    patched.put(static_cast<char>(value >> (8 * i)));
+  patched.close();
+  bool rejected = false;
+  try {
+    load_from_file(path);
+  } catch (const std::runtime_error &) {
+    rejected = true;
+  }
+  std::remove(path);
+  return rejected;
+}
+
+// An array or string whose length runs past the data is rejected before
+// room for it is allocated, from a compressed pool as from a plain one.
+void truncated_length_test() {
+  vector<uint8_t> encoded = {FLOAT_ARRAY, 0xff, 0xff, 0xff, 0xff, 0, 0, 0};
+  vector<uint8_t> compressed;
+  lz_compress(encoded.data(), encoded.size(), compressed);
+  LzSource source(compressed.data(), compressed.size(), encoded.size());
+  bool rejected = false;
+  try {
+    decode_object(source);
+  } catch (const std::runtime_error &) {
+    rejected = true;
+  }
+  print_test_result("compression_test",
+                    "array longer than a compressed pool is rejected",
+                    {rejected, "decoded a 4G element array"});
+
+  encoded = {STRING, 0xff, 0xff, 0xff, 0xff, 'x'};
+  MemorySource plain(encoded.data(), encoded.size());
+  rejected = false;
+  try {
+    decode_object(plain);
+  } catch (const std::runtime_error &) {
+    rejected = true;
+  }
+  print_test_result("compression_test",
+                    "string longer than its pool is rejected",
+                    {rejected, "decoded a 4 GiB string"});
+}
+
+void corrupt_header_test() {
+  File file = {MAJOR, MINOR, {PUSH, 0, 0, 0, 0, HALT},
+               {Object(STRING, string(1000, 'x'))}, 0};
+  print_test_result("compression_test",
+                    "stored section with a smaller raw size is rejected",
+                    {rejects_patched_header(file, 0, 32, 1),
+                     "loaded a bytecode section larger than its buffer"});
+  print_test_result("compression_test",
+                    "compressed section claiming 4 GiB is rejected",
+                    {rejects_patched_header(file, COMPRESS_CONST_POOL, 36,
+                                            UINT32_MAX),
+                     "accepted an impossible raw size"});
+}
+// compression_test }}}
+
+// parallel_pool_test {{{
+void parallel_pool_test() {
+  vector<uint8_t> encoded;
+  for (int i = 0; i < 20000; i++) {
+    switch (i % 5) {
+    case 0:
+      encode_object(Object(INTEGER, i), encoded);
+      break;
+    case 1:
+      encode_object(Object(FLOAT, i * 0.25), encoded);
+      break;
+    case 2:
+      encode_object(Object(STRING, "entry_" + std::to_string(i)), encoded);
+      break;
+    case 3:
+      encode_object(Object(LIST, List{Object(BOOLEAN, i % 2 == 0),
+                                                Object(STRING, "nested"),
+                                                Object()}),
+                    encoded);
+      break;
+    case 4:
+      encode_object(Object(), encoded);
+      break;
+    }
+  }
+
+  vector<Object> serial = decode_const_pool(encoded.data(), encoded.size(), 1);
+  vector<Object> parallel =
+      decode_const_pool(encoded.data(), encoded.size(), 4);
+
+  vector<uint8_t> serial_bytes, parallel_bytes;
+  for (const auto &obj : serial)
+    encode_object(obj, serial_bytes);
+  for (const auto &obj : parallel)
+    encode_object(obj, parallel_bytes);
+
+  print_test_result("parallel_pool_test",
+                    "4 threads decode the same 20000 entries as 1",
+                    {serial.size() == 20000 && parallel.size() == 20000 &&
+                         serial_bytes == encoded && parallel_bytes == encoded,
+                     "decoded pools differ"});
+}
+// parallel_pool_test }}}
+
+// verifier_test {{{
+void run_verifier_test(const vector<uint8_t> &bytecode,
+                       const vector<Object> &const_pool, const string &test,
+                       bool expected_valid) {
+  Verification result = verify(bytecode, const_pool);
+  string error = expected_valid ? result.error : "program was accepted";
+  print_test_result("verifier_test", test,
+                    {result.valid == expected_valid, error});
+}
+
+void verifier_test() {
+  const vector<Object> pool = {Object(INTEGER, 1), Object(INTEGER, 2)};
+
+  run_verifier_test({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, ADD, HALT}, pool,
+                    "push push add halt is valid", true);
+  run_verifier_test({PUSH, 0, 0, 0, 0, ADD, HALT}, pool,
+                    "stack underflow is rejected", false);
+  run_verifier_test({PUSH, 2, 0, 0, 0, HALT}, pool,
+                    "pool index out of bounds is rejected", false);
+  run_verifier_test({PUSH, 0, 0, 0, 0, 0xff, HALT}, pool,
+                    "unknown instruction is rejected", false);
+  run_verifier_test({PUSH, 0, 0}, pool, "truncated operand is rejected",
+                    false);
+  run_verifier_test({PUSH, 0, 0, 0, 0, POP}, pool,
+                    "missing HALT is rejected", false);
+
+  VM vm({PUSH, 0, 0, 0, 0, HALT}, pool);
+  print_test_result("verifier_test", "verified program takes the fast path",
+                    {vm.is_verified(), "program was not verified"});
+}
+// verifier_test }}}
+
+// arena_test {{{
+void arena_test() {
+  VM vm({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, ADD, PUSH, 2, 0, 0, 0, HALT},
+        {Object(STRING, "Hello, "), Object(STRING, "long enough World!"),
+         Object(LIST, List{Object(INTEGER, 1), Object(STRING, "two")})});
+  vm.run();
+
+  ArenaStats stats = vm.arena_stats();
+  print_test_result("arena_test", "string results use the arena",
+                    {stats.allocations >= 1 && stats.bytes_reserved > 0,
+                     "arena saw " + std::to_string(stats.allocations) +
+                         " allocations"});
+
+  Object list = vm.pop();
+  Object str = vm.pop();
+  vm.reset();
+
+  print_test_result("arena_test", "reset releases the arena",
+                    {vm.arena_stats().bytes_allocated == 0 &&
+                         vm.arena_stats().resets == 1,
+                     "arena still reports allocations"});
+  print_test_result("arena_test", "popped values outlive reset",
+                    assert_string_result(str, "Hello, long enough World!"));
+
+  vm.run();
+  print_test_result("arena_test", "vm can run again after reset",
+                    {vm.pop().is_type<List>(), "type mismatch"});
+}
+// arena_test }}}
+
+// cow_test {{{
+void cow_test() {
+  List original{Object(INTEGER, 1), Object(INTEGER, 2)};
+  List copy = original;
+  bool shared = original.is_shared() && copy.is_shared();
+
+  copy.mutate().emplace_back(INTEGER, 3);
+  print_test_result("cow_test", "copies share until mutated",
+                    {shared && !copy.is_shared() && original.size() == 2 &&
+                         copy.size() == 3,
+                     "mutation leaked into the shared list"});
+
+  const vector<Object> pool = {
+      Object(LIST, List{Object(STRING, "a"), Object(STRING, "b")})};
+  VM vm({PUSH, 0, 0, 0, 0, PUSH, 0, 0, 0, 0, POP, HALT}, pool);
+  vm.run();
+  Object result = vm.pop();
+  print_test_result("cow_test", "pushing a list constant does not copy it",
+                    {result.as<List>().is_shared() &&
+                         vm.arena_stats().allocations == 0,
+                     "list constant was copied"});
+}
+// cow_test }}}
+
+// sso_test {{{
+void sso_test() {
+  String small("fifteen chars!!");
+  String large("sixteen chars!!!");
+  print_test_result("sso_test", "strings up to 15 bytes are inline",
+                    {small.is_inline() && !large.is_inline() &&
+                         small.str() == "fifteen chars!!",
+                     "unexpected string representation"});
+
+  VM vm({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, ADD, PUSH, 0, 0, 0, 0, PUSH, 2,
+         0, 0, 0, ADD, EQ, HALT},
+        {Object(STRING, "key_"), Object(STRING, "name"),
+         Object(STRING, "name")});
+  vm.run();
+  print_test_result("sso_test", "inline ADD and EQ do not allocate",
+                    {vm.arena_stats().allocations == 0,
+                     "arena saw " +
+                         std::to_string(vm.arena_stats().allocations) +
+                         " allocations"});
+  print_test_result("sso_test", "\"key_\" + \"name\" == \"key_\" + \"name\"",
+                    assert_bool_result(vm.pop(), true));
+}
+// sso_test }}}
+
+// concat_test {{{
+void concat_test() {
+  Arena arena;
+  String base = String::concat(String("0123456789abcdef"), "!", &arena);
+  String left = String::concat(base, " left", &arena);
+  String right = String::concat(base, " right", &arena);
+  print_test_result("concat_test", "appending in place keeps other strings",
+                    {base.str() == "0123456789abcdef!" &&
+                         left.str() == "0123456789abcdef! left" &&
+                         right.str() == "0123456789abcdef! right" &&
+                         left.identity() == base.identity() &&
+                         right.identity() != base.identity(),
+                     "shared buffer was corrupted"});
+
+  // "start of the report" + "line " * 5000, one ADD at a time.
+  vector<uint8_t> bytecode = {PUSH, 0, 0, 0, 0};
+  for (int i = 0; i < 5000; i++)
+    bytecode.insert(bytecode.end(), {PUSH, 1, 0, 0, 0, ADD});
+  bytecode.push_back(HALT);
+
+  VM vm(bytecode,
+        {Object(STRING, "start of the report"), Object(STRING, "line ")});
+  vm.run();
+  size_t final_size = 19 + 5 * 5000;
+  size_t allocated = vm.arena_stats().bytes_allocated;
+  print_test_result("concat_test", "5000 ADDs allocate linear space",
+                    {allocated < 4 * final_size,
+                     std::to_string(allocated) + " bytes for a " +
+                         std::to_string(final_size) + " byte result"});
+  Object result = vm.pop();
+  print_test_result("concat_test", "repeated ADD result is intact",
+                    {result.as<String>().size() == final_size &&
+                         result.as<String>().str().substr(final_size - 10) ==
+                             "line line ",
+                     "unexpected result"});
+
+  VM mul({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, MUL, HALT},
+         {Object(STRING, "ab"), Object(INTEGER, 10000)});
+  mul.run();
+  print_test_result("concat_test", "MUL allocates the result once",
+                    {mul.arena_stats().bytes_allocated < 20000 + 256,
+                     std::to_string(mul.arena_stats().bytes_allocated) +
+                         " bytes for a 20000 byte result"});
+}
+// concat_test }}}
+
+// gc_test {{{
+void gc_test() {
+  // Builds 2000 garbage strings, keeping only the last concatenation alive.
+  vector<uint8_t> bytecode;
+  for (int i = 0; i < 2000; i++)
+    bytecode.insert(bytecode.end(),
+                    {PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, ADD, POP});
+  bytecode.insert(bytecode.end(),
+                  {PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, ADD, HALT});
+  const vector<Object> pool = {Object(STRING, "a string too long for sso "),
+                               Object(STRING, "so it hits the arena")};
+
+  VM vm(bytecode, pool);
+  vm.set_heap_config({0, 4096});
+  vm.run();
+
+  const HeapStats &stats = vm.heap_stats();
+  print_test_result("gc_test", "garbage strings are collected",
+                    {stats.collections > 0 && stats.freed_bytes > 0 &&
+                         vm.arena_stats().bytes_allocated < 8192,
+                     std::to_string(stats.collections) +
+                         " collections, arena holds " +
+                         std::to_string(vm.arena_stats().bytes_allocated) +
+                         " bytes"});
+  print_test_result(
+      "gc_test", "live string survives collection",
+      assert_string_result(vm.pop(), "a string too long for sso so it hits "
+                                     "the arena"));
+
+  VM limited({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, MUL, HALT},
+             {Object(STRING, "0123456789"), Object(INTEGER, 1000)});
+  limited.run();
+  limited.set_heap_config({1024, GC_THRESHOLD});
+
+  bool threw = false;
+  try {
+    limited.collect();
+  } catch (const std::runtime_error &) {
+    threw = true;
+  }
+  print_test_result("gc_test", "live data over the heap limit is an error",
+                    {threw, "collect() did not enforce the heap limit"});
+}
+// gc_test }}}
+
+// slice_test {{{
+void slice_test() {
+  String text("the quick brown fox jumps over the lazy dog");
+  String fox = text.substr(4, 15);
+  String jumps = text.substr(16, 20);
+  print_test_result("slice_test", "substrings share their parent's buffer",
+                    {fox.is_inline() && fox.str() == "quick brown fox" &&
+                         jumps.identity() == text.identity() &&
+                         jumps.str() == "fox jumps over the l",
+                     "unexpected substring"});
+
+  List list{Object(INTEGER, 1), Object(INTEGER, 2), Object(INTEGER, 3),
+            Object(INTEGER, 4)};
+  List middle = list.slice(1, 2);
+  List copy = middle;
+  copy.mutate().emplace_back(INTEGER, 5);
+  print_test_result("slice_test", "list slices copy on mutation",
+                    {middle.is_view() && middle.size() == 2 &&
+                         middle[0].as<int>() == 2 && !copy.is_view() &&
+                         copy.size() == 3 && list.size() == 4 &&
+                         list[3].as<int>() == 4,
+                     "mutation leaked into the parent list"});
+
+  const vector<Object> pool = {
+      Object(STRING, "a constant long enough to be shared"),
+      Object(INTEGER, 2), Object(INTEGER, 26),
+      Object(LIST, List{Object(STRING, "a"), Object(STRING, "b"),
+                        Object(STRING, "c")}),
+      Object(INTEGER, 1), Object(INTEGER, 3)};
+  VM vm({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, PUSH, 2, 0, 0, 0, SLICE,
+         PUSH, 3, 0, 0, 0, PUSH, 4, 0, 0, 0, PUSH, 5, 0, 0, 0, SLICE,
+         PUSH, 4, 0, 0, 0, INDEX, HALT},
+        pool);
+  vm.run();
+  print_test_result("slice_test", "SLICE and INDEX do not allocate",
+                    {vm.arena_stats().allocations == 0,
+                     "arena saw " +
+                         std::to_string(vm.arena_stats().allocations) +
+                         " allocations"});
+  print_test_result("slice_test", "[\"a\", \"b\", \"c\"][1:3][1]",
+                    assert_string_result(vm.pop(), "c"));
+  print_test_result("slice_test", "constant[2:26]",
+                    assert_string_result(vm.pop(),
+                                         "constant long enough to "));
+
+  // A small slice of a large arena string must not keep all of it alive.
+  VM pinned({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, MUL, PUSH, 2, 0, 0, 0,
+             PUSH, 3, 0, 0, 0, SLICE, HALT},
+            {Object(STRING, "0123456789"), Object(INTEGER, 1000),
+             Object(INTEGER, 5), Object(INTEGER, 25)});
+  pinned.run();
+  pinned.collect();
+  print_test_result("slice_test", "collector copies small slices alone",
+                    {pinned.heap_stats().live_bytes < 1000,
+                     std::to_string(pinned.heap_stats().live_bytes) +
+                         " live bytes for a 20 byte slice"});
+  print_test_result("slice_test", "(\"0123456789\" * 1000)[5:25]",
+                    assert_string_result(pinned.pop(),
+                                         "56789012345678901234"));
+}
+// slice_test }}}
+
+// array_test {{{
+void array_test() {
+  IntArray ints{1, -2, int64_t(1) << 40};
+  FloatArray floats{0.5, -1.25};
+  vector<uint8_t> encoded;
+  encode_object(Object(INT_ARRAY, ints), encoded);
+  encode_object(Object(FLOAT_ARRAY, floats), encoded);
+  size_t end = skip_object(encoded.data(), encoded.size(),
+                           skip_object(encoded.data(), encoded.size(), 0));
+  Object int_copy = decode_object(encoded);
+  Object float_copy = decode_object(encoded);
+  print_test_result("array_test", "arrays survive encoding",
+                    {end == 2 * (1 + 4) + 5 * 8 && encoded.empty() &&
+                         int_copy.is_type<IntArray>() &&
+                         int_copy.as<IntArray>().size() == 3 &&
+                         int_copy.as<IntArray>()[2] == int64_t(1) << 40 &&
+                         float_copy.is_type<FloatArray>() &&
+                         float_copy.as<FloatArray>()[1] == -1.25,
+                     "decoded arrays differ"});
+
+  // [] then APPEND 0..999, LEN. The empty array is constant 1000.
+  vector<uint8_t> bytecode = {PUSH, 0xe8, 0x03, 0, 0};
+  vector<Object> pool;
+  for (int i = 0; i < 1000; i++) {
+    bytecode.insert(bytecode.end(), {PUSH, static_cast<uint8_t>(i & 0xff),
+                                     static_cast<uint8_t>(i >> 8), 0, 0,
+                                     APPEND});
+    pool.emplace_back(INTEGER, i);
+  }
+  pool.emplace_back(INT_ARRAY, IntArray());
+  bytecode.insert(bytecode.end(), {LEN, HALT});
+
+  VM vm(bytecode, pool);
+  vm.run();
+  print_test_result("array_test", "APPEND grows the array in place",
+                    {vm.arena_stats().bytes_allocated < 4 * 1000 * 8,
+                     std::to_string(vm.arena_stats().bytes_allocated) +
+                         " bytes for 1000 elements"});
+  print_test_result("array_test", "LEN of 1000 APPENDs",
+                    assert_int_result(vm.pop(), 1000));
+
+  VM index({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, APPEND, PUSH, 2, 0, 0, 0,
+            INDEX, HALT},
+           {Object(FLOAT_ARRAY, FloatArray{1.5, 2.5}), Object(INTEGER, 7),
+            Object(INTEGER, 2)});
+  index.run();
+  print_test_result("array_test", "[1.5, 2.5] APPEND 7 INDEX 2",
+                    assert_float_result(index.pop(), 7.0));
+}
+// array_test }}}
+
+// simd_test {{{
+void simd_test() {
+  const size_t n = 11; // not a multiple of any vector width
+  vector<int64_t> ints(n);
+  vector<double> floats(n);
+  for (size_t i = 0; i < n; i++) {
+    ints[i] = static_cast<int64_t>(i) * 3 - 10;
+    floats[i] = static_cast<double>(i) * 0.5 - 2;
+  }
+  int64_t five = 5;
+  double half = 0.5;
+  const uint8_t arith[] = {ADD, SUB, MUL};
+  const uint8_t compare[] = {EQ, NEQ, LT, GT, LTE, GTE};
+
+  SimdLevel best = simd_supported();
+  for (int level = SIMD_SCALAR; level <= best; level++) {
+    set_simd_level(static_cast<SimdLevel>(level));
+    string error;
+    vector<int64_t> int_out(n);
+    vector<double> float_out(n);
+
+    for (uint8_t op : arith) {
+      simd_arith(op, {ints.data(), false}, {&five, true}, int_out.data(), n);
+      for (size_t i = 0; i < n; i++) {
+        int64_t want = op == ADD   ? ints[i] + 5
+                       : op == SUB ? ints[i] - 5
+                                   : ints[i] * 5;
+        if (int_out[i] != want)
+          error = inst_to_string(op) + " on ints at " + std::to_string(i);
+      }
+    }
+    for (uint8_t op : {ADD, SUB, MUL, DIV}) {
+      simd_arith(op, {&half, true}, {floats.data(), false}, float_out.data(),
+                 n);
+      for (size_t i = 0; i < n; i++) {
+        double want = op == ADD   ? 0.5 + floats[i]
+                      : op == SUB ? 0.5 - floats[i]
+                      : op == MUL ? 0.5 * floats[i]
+                                  : 0.5 / floats[i];
+        if (float_out[i] != want)
+          error = inst_to_string(op) + " on floats at " + std::to_string(i);
+      }
+    }
+    for (uint8_t op : compare) {
+      simd_compare(op, {ints.data(), false}, {&five, true}, int_out.data(), n);
+      vector<int64_t> float_cmp(n);
+      simd_compare(op, {floats.data(), false}, {&half, true},
+                   float_cmp.data(), n);
+      for (size_t i = 0; i < n; i++) {
+        auto expect = [op](auto x, auto y) -> int64_t {
+          switch (op) {
+          case EQ:
+            return x == y;
+          case NEQ:
+            return x != y;
+          case LT:
+            return x < y;
+          case GT:
+            return x > y;
+          case LTE:
+            return x <= y;
+          default:
+            return x >= y;
+          }
+        };
+        if (int_out[i] != expect(ints[i], five) ||
+            float_cmp[i] != expect(floats[i], half))
+          error = inst_to_string(op) + " at " + std::to_string(i);
+      }
+    }
+
+    print_test_result("simd_test",
+                      string("kernels match scalar math (") +
+                          simd_level_name(static_cast<SimdLevel>(level)) +
+                          ")",
+                      {error.empty(), error});
+  }
+  set_simd_level(best);
+
+  // [1, 2, 3] * 2.5 < [3, 5, 8]
+  VM vm({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, MUL, PUSH, 2, 0, 0, 0, LT,
+         PUSH, 3, 0, 0, 0, INDEX, HALT},
+        {Object(INT_ARRAY, IntArray{1, 2, 3}), Object(FLOAT, 2.5),
+         Object(INT_ARRAY, IntArray{3, 5, 8}), Object(INTEGER, 2)});
+  vm.run();
+  print_test_result("simd_test", "([1, 2, 3] * 2.5 < [3, 5, 8])[2]",
+                    assert_int_result(vm.pop(), 1));
+
+  VM div({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, DIV, PUSH, 2, 0, 0, 0, INDEX,
+          HALT},
+         {Object(INTEGER, 1), Object(INT_ARRAY, IntArray{1, 2, 4, 8}),
+          Object(INTEGER, 3)});
+  div.run();
+  print_test_result("simd_test", "(1 / [1, 2, 4, 8])[3]",
+                    assert_float_result(div.pop(), 0.125));
+}
+// simd_test }}}
+
+// reduce_test {{{
+void reduce_test() {
+  const size_t n = 37;
+  vector<int64_t> ints(n);
+  vector<double> floats(n);
+  for (size_t i = 0; i < n; i++) {
+    ints[i] = (static_cast<int64_t>(i) * 7919) % 101 - 50;
+    floats[i] = static_cast<double>(ints[i]) * 0.25;
+  }
+  vector<double> with_nan = floats;
+  with_nan[n - 2] = NAN;
+
+  SimdLevel best = simd_supported();
+  for (int level = SIMD_SCALAR; level <= best; level++) {
+    set_simd_level(static_cast<SimdLevel>(level));
+    int64_t sum = 0, dot = 0;
+    size_t nonzero = 0;
+    for (size_t i = 0; i < n; i++) {
+      sum += ints[i];
+      dot += ints[i] * ints[i];
+      nonzero += ints[i] != 0;
+    }
+    int64_t min = *std::min_element(ints.begin(), ints.end());
+    int64_t max = *std::max_element(ints.begin(), ints.end());
+
+    bool passed =
+        simd_sum(ints.data(), n) == sum &&
+        simd_min(ints.data(), n) == min && simd_max(ints.data(), n) == max &&
+        simd_dot(ints.data(), ints.data(), n) == dot &&
+        simd_count_if(ints.data(), n) == nonzero &&
+        std::fabs(simd_sum(floats.data(), n) - sum * 0.25) < EPSILON &&
+        simd_min(floats.data(), n) == min * 0.25 &&
+        simd_max(floats.data(), n) == max * 0.25 &&
+        std::fabs(simd_dot(floats.data(), floats.data(), n) - dot / 16.0) <
+            EPSILON &&
+        simd_count_if(floats.data(), n) == nonzero &&
+        std::isnan(simd_min(with_nan.data(), n)) &&
+        std::isnan(simd_max(with_nan.data(), n));
+    print_test_result("reduce_test",
+                      string("reductions match scalar math (") +
+                          simd_level_name(static_cast<SimdLevel>(level)) +
+                          ")",
+                      {passed, "a reduction disagrees"});
+  }
+  set_simd_level(best);
+
+  vector<int64_t> random(100000);
+  uint64_t state = 12345;
+  for (auto &value : random) {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    value = static_cast<int64_t>(state);
+  }
+  random[0] = INT64_MIN;
+  random[1] = INT64_MAX;
+  vector<int64_t> expected = random;
+  std::sort(expected.begin(), expected.end());
+  radix_sort(random.data(), random.size());
+
+  vector<double> doubles(PARALLEL_SORT_MIN + 3);
+  for (size_t i = 0; i < doubles.size(); i++)
+    doubles[i] = static_cast<double>((i * 2654435761u) % 1000003) - 500000;
+  vector<double> sorted_doubles = doubles;
+  std::sort(sorted_doubles.begin(), sorted_doubles.end());
+  parallel_sort(doubles.data(), doubles.size(), std::less<double>(), 4);
+  print_test_result("reduce_test", "radix and parallel sort match std::sort",
+                    {random == expected && doubles == sorted_doubles,
+                     "sorted output differs"});
+
+  const vector<Object> pool = {
+      Object(LIST, List{Object(INTEGER, 1), Object(FLOAT, 2.5),
+                        Object(BOOLEAN, true)}),
+      Object(INT_ARRAY, IntArray{4, -3, 9, 2}),
+      Object(FLOAT_ARRAY, FloatArray{0.5, 1, 2, 4}),
+      Object(INTEGER, 2),
+      Object(LIST, List{Object(STRING, "pear"), Object(STRING, "apple"),
+                        Object(STRING, "fig")}),
+      Object(INTEGER, 0)};
+  // [sum, min, dot, count_if(> 2), sort(...)[0], sort(ints)[0]]
+  VM vm({PUSH, 0, 0, 0, 0, SUM, PUSH, 1, 0, 0, 0, MIN, PUSH, 1, 0, 0, 0,
+         PUSH, 2, 0, 0, 0, DOT, PUSH, 1, 0, 0, 0, PUSH, 3, 0, 0, 0, GT,
+         COUNT_IF, PUSH, 4, 0, 0, 0, SORT, PUSH, 5, 0, 0, 0, INDEX, PUSH, 1,
+         0, 0, 0, SORT, PUSH, 5, 0, 0, 0, INDEX, HALT},
+        pool);
+  vm.run();
+  print_test_result("reduce_test", "SORT([4, -3, 9, 2])[0]",
+                    assert_int_result(vm.pop(), -3));
+  print_test_result("reduce_test", "SORT([\"pear\", \"apple\", \"fig\"])[0]",
+                    assert_string_result(vm.pop(), "apple"));
+  print_test_result("reduce_test", "COUNT_IF([4, -3, 9, 2] > 2)",
+                    assert_int_result(vm.pop(), 2));
+  print_test_result("reduce_test", "DOT([4, -3, 9, 2], [0.5, 1, 2, 4])",
+                    assert_float_result(vm.pop(), 25.0));
+  print_test_result("reduce_test", "MIN([4, -3, 9, 2])",
+                    assert_int_result(vm.pop(), -3));
+  print_test_result("reduce_test", "SUM([1, 2.5, true])",
+                    assert_float_result(vm.pop(), 4.5));
+}
+// reduce_test }}}
+
+// map_test {{{
+void map_test() {
+  // Enough keys to grow the table several times, with every third one erased
+  // so lookups have to probe past tombstones.
+  MapTable table;
+  const int n = 5000;
+  for (int i = 0; i < n; i++)
+    table.set(Object(INTEGER, i), Object(INTEGER, i * 2));
+  for (int i = 0; i < n; i += 3)
+    table.erase(Object(INTEGER, i));
+  for (int i = 0; i < n; i += 6)
+    table.set(Object(INTEGER, i), Object(INTEGER, -i));
+  bool found = true;
+  for (int i = 0; i < n; i++) {
+    const Object *value = table.find(Object(INTEGER, i));
+    int expected = i % 6 == 0 ? -i : i * 2;
+    if (i % 3 == 0 && i % 6 != 0)
+      found &= value == nullptr;
+    else
+      found &= value != nullptr && value->as<int>() == expected;
+  }
+  size_t size = n - (n + 2) / 3 + (n + 5) / 6;
+  print_test_result("map_test", "set, find and erase over 5000 keys",
+                    {found && table.size() == size,
+                     "lookup mismatch, size " + std::to_string(table.size())});
+
+  MapTable keys;
+  keys.set(Object(INTEGER, 1), Object(STRING, "int"));
+  keys.set(Object(FLOAT, 1.0), Object(STRING, "float"));
+  keys.set(Object(BOOLEAN, true), Object(STRING, "bool"));
+  keys.set(Object(FLOAT, 0.0), Object(STRING, "zero"));
+  keys.set(Object(STRING, "a key long enough for the heap"),
+           Object(STRING, "string"));
+  const Object *negative_zero = keys.find(Object(FLOAT, -0.0));
+  const Object *string_key = keys.find(
+      Object(STRING, String("a key long enough for the heap, really")
+                         .substr(0, 30)));
+  print_test_result(
+      "map_test", "keys of different types stay distinct",
+      {keys.size() == 5 &&
+           keys.find(Object(INTEGER, 1))->as<String>().str() == "int" &&
+           keys.find(Object(FLOAT, 1.0))->as<String>().str() == "float" &&
+           negative_zero && negative_zero->as<String>().str() == "zero" &&
+           string_key && string_key->as<String>().str() == "string" &&
+           !MapTable::is_hashable(Object(FLOAT, NAN)),
+       "key lookup mismatch"});
+
+  vector<uint8_t> encoded;
+  encode_object(Object(MAP, Map(std::move(keys))), encoded);
+  bool skipped = skip_object(encoded.data(), encoded.size(), 0) ==
+                 encoded.size();
+  Object copy = decode_object(encoded);
+  print_test_result("map_test", "maps survive encoding",
+                    {skipped && copy.is_type<Map>() &&
+                         copy.as<Map>().size() == 5 &&
+                         copy.as<Map>()
+                                 .find(Object(BOOLEAN, true))
+                                 ->as<String>()
+                                 .str() == "bool",
+                     "decoded map differs"});
+
+  const vector<Object> pool = {Object(MAP, Map()),
+                               Object(STRING, "a long key for the arena"),
+                               Object(INTEGER, 7), Object(INTEGER, 8),
+                               Object(STRING, "missing")};
+  // m = {k: 7, 8: 7}; delete m[8]; m[k + k] = 7; m[k + k]
+  VM vm({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, PUSH, 2, 0, 0, 0, SET,
+         PUSH, 3, 0, 0, 0, PUSH, 2, 0, 0, 0, SET, PUSH, 3, 0, 0, 0, DELETE,
+         PUSH, 1, 0, 0, 0, PUSH, 1, 0, 0, 0, ADD, PUSH, 2, 0, 0, 0, SET,
+         PUSH, 1, 0, 0, 0, PUSH, 1, 0, 0, 0, ADD, GET, HALT},
+        pool);
+  vm.run();
+  print_test_result("map_test", "GET of a key built at runtime",
+                    assert_int_result(vm.pop(), 7));
+
+  VM ops({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, PUSH, 2, 0, 0, 0, SET,
+          PUSH, 3, 0, 0, 0, PUSH, 2, 0, 0, 0, SET, PUSH, 3, 0, 0, 0, DELETE,
+          LEN, PUSH, 0, 0, 0, 0, PUSH, 3, 0, 0, 0, CONTAINS, PUSH, 0, 0, 0, 0,
+          PUSH, 4, 0, 0, 0, GET, HALT},
+         pool);
+  ops.run();
+  Object missing = ops.pop();
+  print_test_result("map_test", "GET of a missing key is null",
+                    {missing.type == NULL_TYPE, "got " +
+                                                    type_to_string(
+                                                        missing.type)});
+  print_test_result("map_test", "CONTAINS of a key never set",
+                    assert_bool_result(ops.pop(), false));
+  print_test_result("map_test", "LEN after SET, SET, DELETE",
+                    assert_int_result(ops.pop(), 1));
+  print_test_result("map_test", "constant map is left untouched",
+                    {pool[0].as<Map>().size() == 0,
+                     "SET wrote through to the constant pool"});
+
+  // Garbage maps are collected and the live one keeps its arena key.
+  vector<uint8_t> bytecode;
+  for (int i = 0; i < 500; i++)
+    bytecode.insert(bytecode.end(), {PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0,
+                                     PUSH, 2, 0, 0, 0, SET, POP});
+  bytecode.insert(bytecode.end(),
+                  {PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, PUSH, 1, 0, 0, 0, ADD,
+                   PUSH, 2, 0, 0, 0, SET, HALT});
+  VM gc(bytecode, pool);
+  gc.set_heap_config({0, 4096});
+  gc.run();
+  gc.collect();
+  Object live = gc.pop();
+  const Object *value =
+      live.as<Map>().find(Object(STRING, "a long key for the arenaa long key "
+                                         "for the arena"));
+  print_test_result("map_test", "maps survive collection",
+                    {gc.heap_stats().collections > 1 && value &&
+                         value->as<int>() == 7,
+                     "map lost across " +
+                         std::to_string(gc.heap_stats().collections) +
+                         " collections"});
+}
+// map_test }}}
+
+// control_flow_test {{{
+// Appends `inst` and its 4 byte operand, returning where it starts so jumps
+// to it or from it can be patched.
+size_t emit(vector<uint8_t> &bytecode, uint8_t inst, uint32_t operand) {
+  size_t at = bytecode.size();
+  bytecode.insert(bytecode.end(),
+                  {inst, static_cast<uint8_t>(operand),
+                   static_cast<uint8_t>(operand >> 8),
+                   static_cast<uint8_t>(operand >> 16),
+                   static_cast<uint8_t>(operand >> 24)});
+  return at;
+}
+
+void patch(vector<uint8_t> &bytecode, size_t at, uint32_t target) {
+  for (int i = 0; i < 4; i++)
+    bytecode[at + 1 + i] = static_cast<uint8_t>(target >> (8 * i));
+}
+
+void control_flow_test() {
+  const vector<Object> pool = {Object(INTEGER, 0), Object(INTEGER, 1),
+                               Object(INTEGER, 10), Object(INTEGER, 5),
+                               Object(BOOLEAN, true)};
+
+  // i = 0; sum = 0; while i < 10: i = i + 1; sum = sum + i
+  vector<uint8_t> loop;
+  emit(loop, PUSH, 0);
+  emit(loop, PUSH, 0);
+  size_t top = emit(loop, LOAD, 0);
+  emit(loop, PUSH, 2);
+  loop.push_back(LT);
+  size_t exit = emit(loop, JMP_IF_FALSE, 0);
+  emit(loop, LOAD, 0);
+  emit(loop, PUSH, 1);
+  loop.push_back(ADD);
+  emit(loop, STORE, 0);
+  emit(loop, LOAD, 1);
+  emit(loop, LOAD, 0);
+  loop.push_back(ADD);
+  emit(loop, STORE, 1);
+  emit(loop, JMP, top);
+  patch(loop, exit, loop.size());
+  emit(loop, LOAD, 1);
+  loop.push_back(HALT);
+
+  VM vm(loop, pool);
+  vm.run();
+  print_test_result("control_flow_test", "loop is verified",
+                    {vm.is_verified(), "loop was not verified"});
+  print_test_result("control_flow_test", "sum of 1..10 in a loop",
+                    assert_int_result(vm.pop(), 55));
+
+  // fact(n) = n <= 1 ? 1 : n * fact(n - 1)
+  vector<uint8_t> fact;
+  emit(fact, PUSH, 3);
+  size_t call = emit(fact, CALL, 0);
+  fact.insert(fact.end(), {1, HALT});
+  size_t entry = fact.size();
+  patch(fact, call, entry);
+  emit(fact, LOAD, 0);
+  emit(fact, PUSH, 1);
+  fact.push_back(LTE);
+  size_t recurse = emit(fact, JMP_IF_FALSE, 0);
+  emit(fact, PUSH, 1);
+  fact.push_back(RET);
+  patch(fact, recurse, fact.size());
+  emit(fact, LOAD, 0);
+  emit(fact, LOAD, 0);
+  emit(fact, PUSH, 1);
+  fact.push_back(SUB);
+  emit(fact, CALL, entry);
+  fact.insert(fact.end(), {1, MUL, RET});
+
+  VM calls(fact, pool);
+  calls.run();
+  print_test_result("control_flow_test", "recursive fact(5)",
+                    assert_int_result(calls.pop(), 120));
+  calls.reset();
+  calls.run();
+  print_test_result("control_flow_test", "fact(5) again after reset",
+                    assert_int_result(calls.pop(), 120));
+
+  run_verifier_test({PUSH, 4, 0, 0, 0, JMP_IF_FALSE, 15, 0, 0, 0, PUSH, 0, 0,
+                     0, 0, HALT},
+                    pool, "paths disagreeing on the stack are rejected",
+                    false);
+  run_verifier_test({JMP, 100, 0, 0, 0, HALT}, pool,
+                    "jump out of bounds is rejected", false);
+  run_verifier_test({LOAD, 0, 0, 0, 0, HALT}, pool,
+                    "load of a missing local is rejected", false);
+  run_verifier_test({PUSH, 0, 0, 0, 0, RET}, pool,
+                    "RET outside of a function is rejected", false);
+  run_verifier_test({PUSH, 0, 0, 0, 0, CALL, 18, 0, 0, 0, 1, CALL, 18, 0, 0,
+                     0, 0, HALT, PUSH, 0, 0, 0, 0, RET},
+                    pool, "calls with different arities are rejected",
+                    false);
+}
+// control_flow_test }}}
+
+// typed_test {{{
+void typed_test() {
+  const vector<uint8_t> add = {PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, ADD_INT,
+                               HALT};
+  run_vm_test(add, {Object(INTEGER, 10), Object(INTEGER, 12)}, "typed_test",
+              "ADD_INT 10 + 12 = 22", Object(INTEGER, 22));
+  run_vm_test({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, DIV_FLOAT, HALT},
+              {Object(FLOAT, 7.5), Object(FLOAT, 2.5)}, "typed_test",
+              "DIV_FLOAT 7.5 / 2.5 = 3", Object(FLOAT, 3.0));
+  run_vm_test({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, GTE_INT, HALT},
+              {Object(INTEGER, -3), Object(INTEGER, 4)}, "typed_test",
+              "GTE_INT -3 >= 4 = false", Object(BOOLEAN, false));
+  run_vm_test({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, LT_FLOAT, HALT},
+              {Object(FLOAT, 1.5), Object(FLOAT, 2.5)}, "typed_test",
+              "LT_FLOAT 1.5 < 2.5 = true", Object(BOOLEAN, true));
+
+  // Operands of another type take the generic instruction's path.
+  run_vm_test(add, {Object(FLOAT, 10.5), Object(INTEGER, 12)}, "typed_test",
+              "ADD_INT falls back for 10.5 + 12", Object(FLOAT, 22.5));
+  run_vm_test(add, {Object(STRING, "ab"), Object(STRING, "cd")}, "typed_test",
+              "ADD_INT falls back for strings", Object(STRING, "abcd"));
+  run_vm_test({PUSH, 0, 0, 0, 0, PUSH, 1, 0, 0, 0, EQ_INT, HALT},
+              {Object(INTEGER, 1), Object()}, "typed_test",
+              "EQ_INT falls back for 1 == null", Object(BOOLEAN, false));
+
+  run_verifier_test(add, {Object(INTEGER, 10), Object(INTEGER, 12)},
+                    "typed instructions are verified", true);
+}
+// typed_test }}}
+
 // const_load_test {{{
 void write_objects() {
   vector<Object> objs = {
       Object(LIST,
-             vector<Object>{Object(INTEGER, 43),
+             List{Object(INTEGER, 43),
                             Object(STRING, "Hello, World!"),
                             Object(BOOLEAN, true), Object(FLOAT, 10.2841)}),
       Object(INTEGER, 10), Object()};
@@ -422,8 +1436,28 @@ void tests() {
   bit_or_test();
   bit_not_test();
   xor_test();
+  neg_test();
 
   encode_bytecode_test();
   load_bytecode_test();
+  dedup_test();
+  lz_roundtrip_test();
+  compressed_file_test();
+  corrupt_header_test();
+  truncated_length_test();
+  parallel_pool_test();
+  verifier_test();
+  arena_test();
+  cow_test();
+  sso_test();
+  concat_test();
+  gc_test();
+  slice_test();
+  array_test();
+  simd_test();
+  reduce_test();
+  map_test();
+  control_flow_test();
+  typed_test();
 }
 // tests }}}
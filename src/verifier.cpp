@@ -0,0 +1,129 @@
+#include "verifier.h"
+#include "bytecode.h"
+#include <unordered_map>
+
+static Verification fail(uint32_t pc, const string &error) {
+  return {false, "Verification error at " + std::to_string(pc) + ": " + error,
+          0};
+}
+
+static uint32_t operand(const vector<uint8_t> &bytecode, uint32_t pc) {
+  return static_cast<uint32_t>(bytecode[pc + 1]) |
+         (static_cast<uint32_t>(bytecode[pc + 2]) << 8) |
+         (static_cast<uint32_t>(bytecode[pc + 3]) << 16) |
+         (static_cast<uint32_t>(bytecode[pc + 4]) << 24);
+}
+
+// A path still to be walked: where it starts, the stack depth there
+// relative to the frame of the function it runs in, and whether it runs in
+// one at all.
+struct Path {
+  uint32_t pc;
+  uint32_t depth;
+  bool in_function;
+};
+
+Verification verify(const vector<uint8_t> &bytecode,
+                    const vector<Object> &const_pool) {
+  static constexpr uint32_t UNVISITED = UINT32_MAX;
+  // Depth on entry to every instruction reached so far, and whether it was
+  // reached inside a function.
+  vector<uint32_t> depths(bytecode.size(), UNVISITED);
+  vector<bool> in_functions(bytecode.size());
+  // Argument count of every function called, by entry point.
+  std::unordered_map<uint32_t, uint8_t> arities;
+  vector<Path> paths = {{0, 0, false}};
+  uint32_t max_stack = 0;
+
+  while (!paths.empty()) {
+    auto [pc, depth, in_function] = paths.back();
+    paths.pop_back();
+
+    while (true) {
+      if (pc >= bytecode.size())
+        return fail(pc, "program does not reach HALT");
+
+      // Each instruction is checked once; later paths only have to agree
+      // with the first one on the stack they find there.
+      if (depths[pc] != UNVISITED) {
+        if (in_functions[pc] != in_function)
+          return fail(pc, "reached both inside and outside of a function");
+        if (depths[pc] != depth)
+          return fail(pc, "reached with " + std::to_string(depth) +
+                              " values on the stack, and with " +
+                              std::to_string(depths[pc]) + " before");
+        break;
+      }
+      depths[pc] = depth;
+      in_functions[pc] = in_function;
+
+      uint8_t inst = bytecode[pc];
+      StackEffect effect;
+      if (!stack_effect(inst, effect))
+        return fail(pc, "unknown instruction " + std::to_string(inst));
+
+      uint32_t length = inst_length(inst);
+      if (bytecode.size() - pc < length)
+        return fail(pc, inst_to_string(inst) + " is missing its operand");
+
+      uint32_t target = length > 1 ? operand(bytecode, pc) : 0;
+      switch (inst) {
+      case PUSH:
+        if (target >= const_pool.size())
+          return fail(pc, "constant pool index " + std::to_string(target) +
+                              " is out of bounds (size: " +
+                              std::to_string(const_pool.size()) + ")");
+        break;
+      case LOAD:
+      case STORE:
+        if (target >= depth - (inst == STORE) || depth == 0)
+          return fail(pc, inst_to_string(inst) + " of local " +
+                              std::to_string(target) + " with only " +
+                              std::to_string(depth) +
+                              " values in the frame");
+        break;
+      case JMP:
+      case JMP_IF_FALSE:
+      case CALL:
+        if (target >= bytecode.size())
+          return fail(pc, inst_to_string(inst) + " target " +
+                              std::to_string(target) + " is out of bounds");
+        break;
+      case RET:
+        if (!in_function)
+          return fail(pc, "RET outside of a function");
+        break;
+      }
+
+      if (inst == CALL) {
+        uint8_t argc = bytecode[pc + 5];
+        auto [it, first_call] = arities.emplace(target, argc);
+        if (it->second != argc)
+          return fail(pc, "function at " + std::to_string(target) +
+                              " called with " + std::to_string(argc) +
+                              " arguments and with " +
+                              std::to_string(it->second) + " elsewhere");
+        if (first_call)
+          paths.push_back({target, argc, true});
+        effect.pops = argc;
+      }
+
+      if (depth < effect.pops)
+        return fail(pc, inst_to_string(inst) + " pops " +
+                            std::to_string(effect.pops) + " values but only " +
+                            std::to_string(depth) + " are on the stack");
+
+      depth = depth - effect.pops + effect.pushes;
+      if (depth > max_stack)
+        max_stack = depth;
+
+      if (inst == HALT || inst == RET)
+        break;
+      if (inst == JMP_IF_FALSE)
+        paths.push_back({target, depth, in_function});
+      pc = inst == JMP ? target : pc + length;
+    }
+  }
+
+  return {true, "", max_stack};
+}
@@ -0,0 +1,27 @@
+#ifndef VERIFIER_H
+#define VERIFIER_H
+
+#include "object.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using std::string, std::vector;
+
+struct Verification {
+  bool valid;
+  string error;
+  uint32_t max_stack;
+};
+
+// Walks every path through the program from pc 0, and through every
+// function it calls, and proves that each instruction is known, has its
+// operands, only references existing constants, locals and jump targets and
+// never pops an empty stack, that paths meeting at an instruction agree on
+// the stack depth there and that execution ends in HALT or, in functions,
+// RET. Programs that pass can be run without the per-instruction checks.
+// max_stack is the deepest any single frame gets.
+Verification verify(const vector<uint8_t> &bytecode,
+                    const vector<Object> &const_pool);
+
+#endif // VERIFIER_H
@@ -1,24 +1,473 @@
 #include "vm.h"
 #include "bytecode.h"
+#include "map.h"
+#include "simd.h"
+#include "sort.h"
+#include "verifier.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+
+static vector<Object> intern_pool(const vector<Object> &pool,
+                                  StringTable &table) {
+  vector<Object> interned;
+  interned.reserve(pool.size());
+  for (const auto &obj : pool)
+    interned.push_back(intern_object(obj, table));
+  return interned;
+}
 
 VM::VM(const vector<uint8_t> bc, const vector<Object> pool)
-    : bytecode(bc), const_pool(pool) {}
+    : bytecode(bc), const_pool(intern_pool(pool, strings)) {
+  Verification result = verify(bytecode, const_pool);
+  verified = result.valid;
+  if (verified)
+    stack.reserve(result.max_stack);
+}
+
+// Copy of `array` whose storage lives in `resource`.
+template <typename T>
+static Array<T> copy_array(const Array<T> &array,
+                           std::pmr::memory_resource *resource) {
+  return Array<T>(
+      typename Array<T>::Data(array.begin(), array.end(), resource));
+}
 
-Object VM::pop() {
-  if (stack.empty()) {
+// Number of elements in a string, list or array. Returns false for values
+// that are not sequences.
+static bool sequence_size(const Object &obj, size_t &size) {
+  if (obj.is_type<String>())
+    size = obj.as<String>().size();
+  else if (obj.is_type<List>())
+    size = obj.as<List>().size();
+  else if (obj.is_type<IntArray>())
+    size = obj.as<IntArray>().size();
+  else if (obj.is_type<FloatArray>())
+    size = obj.as<FloatArray>().size();
+  else
+    return false;
+  return true;
+}
+
+static bool is_array(const Object &obj) {
+  return obj.is_type<IntArray>() || obj.is_type<FloatArray>();
+}
+
+// `obj` as an operand of an element-wise kernel over T. Scalars are
+// broadcast through `scalar`; an IntArray used as floats is converted into
+// `converted` first.
+template <typename T>
+static Operand<T> as_operand(const Object &obj, T &scalar,
+                             vector<T> &converted) {
+  if (obj.is_type<int>()) {
+    scalar = obj.as<int>();
+    return {&scalar, true};
+  }
+  if constexpr (std::is_same_v<T, double>) {
+    if (obj.is_type<double>()) {
+      scalar = obj.as<double>();
+      return {&scalar, true};
+    }
+    if (obj.is_type<IntArray>()) {
+      converted.assign(obj.as<IntArray>().begin(), obj.as<IntArray>().end());
+      return {converted.data(), false};
+    }
+  }
+  return {obj.as<Array<T>>().begin(), false};
+}
+
+// Element-wise `a op b` where at least one side is an array and the other
+// is an array of the same size or a number, which is broadcast. The result
+// is an IntArray when both sides are integers and an op other than DIV, and
+// a FloatArray otherwise; comparisons give an IntArray of 1s and 0s.
+Object VM::array_op(uint8_t op, const Object &a, const Object &b) {
+  auto numeric = [](const Object &obj) {
+    return is_array(obj) || obj.is_type<int>() || obj.is_type<double>();
+  };
+  if (!numeric(a) || !numeric(b)) {
+    throw std::runtime_error("Type error in " + inst_to_string(op) +
+                             " operation: unsupported operand types '" +
+                             type_to_string(a.type) + "' and '" +
+                             type_to_string(b.type) + "'.");
+  }
+
+  size_t a_size = 0, b_size = 0;
+  bool a_array = sequence_size(a, a_size), b_array = sequence_size(b, b_size);
+  if (a_array && b_array && a_size != b_size) {
+    throw std::runtime_error(inst_to_string(op) +
+                             " operation error: array sizes " +
+                             std::to_string(a_size) + " and " +
+                             std::to_string(b_size) + " do not match.");
+  }
+  size_t n = a_array ? a_size : b_size;
+  bool compare = op != ADD && op != SUB && op != MUL && op != DIV;
+
+  if (op != DIV && !a.is_type<double>() && !a.is_type<FloatArray>() &&
+      !b.is_type<double>() && !b.is_type<FloatArray>()) {
+    int64_t a_scalar, b_scalar;
+    vector<int64_t> unused;
+    Operand<int64_t> x = as_operand(a, a_scalar, unused);
+    Operand<int64_t> y = as_operand(b, b_scalar, unused);
+
+    IntArray::Data out(n, arena);
+    if (compare)
+      simd_compare(op, x, y, out.data(), n);
+    else
+      simd_arith(op, x, y, out.data(), n);
+    return Object(INT_ARRAY, IntArray(std::move(out)));
+  }
+
+  double a_scalar, b_scalar;
+  vector<double> a_converted, b_converted;
+  Operand<double> x = as_operand(a, a_scalar, a_converted);
+  Operand<double> y = as_operand(b, b_scalar, b_converted);
+
+  if (compare) {
+    IntArray::Data out(n, arena);
+    simd_compare(op, x, y, out.data(), n);
+    return Object(INT_ARRAY, IntArray(std::move(out)));
+  }
+  FloatArray::Data out(n, arena);
+  simd_arith(op, x, y, out.data(), n);
+  return Object(FLOAT_ARRAY, FloatArray(std::move(out)));
+}
+
+static void check_map_operands(uint8_t op, const Object &map,
+                               const Object &key) {
+  if (!map.is_type<Map>()) {
+    throw std::runtime_error("Type error in " + inst_to_string(op) +
+                             " operation: unsupported operand type '" +
+                             type_to_string(map.type) + "'.");
+  }
+  if (!MapTable::is_hashable(key)) {
+    throw std::runtime_error("Type error in " + inst_to_string(op) +
+                             " operation: '" + type_to_string(key.type) +
+                             "' cannot be a MAP key.");
+  }
+}
+
+// `value` as an INTEGER, which is only 32 bits wide.
+static Object integer_result(uint8_t op, int64_t value) {
+  if (value < INT32_MIN || value > INT32_MAX) {
+    throw std::runtime_error(inst_to_string(op) + " operation error: result " +
+                             std::to_string(value) +
+                             " does not fit in an INTEGER.");
+  }
+  return Object(Type::INTEGER, static_cast<int>(value));
+}
+
+// The elements of an array, or of a list of numbers packed into `ints` or
+// `floats`, as one contiguous run. Booleans in a list count as 0 or 1.
+// Floats are used when an element is a float or `as_floats` is set.
+struct Numbers {
+  bool is_float;
+  const int64_t *ints;
+  const double *floats;
+  size_t size;
+};
+
+static bool numbers_of(const Object &obj, Numbers &numbers,
+                       vector<int64_t> &ints, vector<double> &floats,
+                       bool as_floats = false) {
+  if (obj.is_type<FloatArray>()) {
+    const FloatArray &array = obj.as<FloatArray>();
+    numbers = {true, nullptr, array.begin(), array.size()};
+    return true;
+  }
+  if (obj.is_type<IntArray>() && !as_floats) {
+    const IntArray &array = obj.as<IntArray>();
+    numbers = {false, array.begin(), nullptr, array.size()};
+    return true;
+  }
+  if (obj.is_type<IntArray>()) {
+    floats.assign(obj.as<IntArray>().begin(), obj.as<IntArray>().end());
+    numbers = {true, nullptr, floats.data(), floats.size()};
+    return true;
+  }
+  if (!obj.is_type<List>())
+    return false;
+
+  const List &list = obj.as<List>();
+  for (const auto &elem : list) {
+    if (elem.is_type<double>())
+      as_floats = true;
+    else if (!elem.is_type<int>() && !elem.is_type<bool>())
+      return false;
+  }
+
+  auto value = [](const Object &elem) -> int64_t {
+    return elem.is_type<int>() ? elem.as<int>() : elem.as<bool>();
+  };
+  if (as_floats) {
+    floats.reserve(list.size());
+    for (const auto &elem : list)
+      floats.push_back(elem.is_type<double>() ? elem.as<double>()
+                                              : value(elem));
+    numbers = {true, nullptr, floats.data(), floats.size()};
+  } else {
+    ints.reserve(list.size());
+    for (const auto &elem : list)
+      ints.push_back(value(elem));
+    numbers = {false, ints.data(), nullptr, ints.size()};
+  }
+  return true;
+}
+
+// SUM, MIN, MAX or COUNT_IF of `numbers`, which is not empty for MIN and
+// MAX.
+static Object reduce(uint8_t op, const Numbers &numbers) {
+  const int64_t *ints = numbers.ints;
+  const double *floats = numbers.floats;
+  size_t n = numbers.size;
+
+  switch (op) {
+  case SUM:
+    return numbers.is_float ? Object(Type::FLOAT, simd_sum(floats, n))
+                            : integer_result(op, simd_sum(ints, n));
+  case MIN:
+    return numbers.is_float ? Object(Type::FLOAT, simd_min(floats, n))
+                            : integer_result(op, simd_min(ints, n));
+  case MAX:
+    return numbers.is_float ? Object(Type::FLOAT, simd_max(floats, n))
+                            : integer_result(op, simd_max(ints, n));
+  default:
+    return integer_result(op, numbers.is_float ? simd_count_if(floats, n)
+                                               : simd_count_if(ints, n));
+  }
+}
+
+// NaN sorts after every number.
+static bool float_less(double a, double b) {
+  return a < b || (std::isnan(b) && !std::isnan(a));
+}
+
+// A sorted copy of a list whose elements are all numbers or all strings.
+static ListData sorted_list(const List &list,
+                            std::pmr::memory_resource *resource) {
+  ListData elems(list.begin(), list.end(), resource);
+  bool numbers = true, strings = true;
+  for (const auto &elem : elems) {
+    numbers = numbers && (elem.is_type<int>() || elem.is_type<double>());
+    strings = strings && elem.is_type<String>();
+  }
+
+  if (numbers) {
+    auto value = [](const Object &elem) {
+      return elem.is_type<int>() ? elem.as<int>() : elem.as<double>();
+    };
+    parallel_sort(elems.data(), elems.size(),
+                  [&](const Object &a, const Object &b) {
+                    return float_less(value(a), value(b));
+                  });
+  } else if (strings) {
+    parallel_sort(elems.data(), elems.size(),
+                  [](const Object &a, const Object &b) {
+                    return a.as<String>().str() < b.as<String>().str();
+                  });
+  } else {
+    throw std::runtime_error("Type error in SORT operation: list elements "
+                             "must all be numbers or all be strings.");
+  }
+  return elems;
+}
+
+bool VM::in_arena(const Object &obj) const {
+  if (obj.is_type<String>())
+    return obj.as<String>().resource() == arena;
+  if (obj.is_type<List>())
+    return obj.as<List>().resource() == arena;
+  if (obj.is_type<IntArray>())
+    return obj.as<IntArray>().resource() == arena;
+  if (obj.is_type<FloatArray>())
+    return obj.as<FloatArray>().resource() == arena;
+  if (obj.is_type<Map>())
+    return obj.as<Map>().resource() == arena;
+  return false;
+}
+
+// Copies whatever part of a value lives in the arena so it stays valid after
+// reset(). Values that never touched the arena are shared as they are.
+Object VM::export_object(const Object &obj) const {
+  if (!in_arena(obj))
+    return obj;
+
+  if (obj.is_type<String>())
+    return Object(obj.type, String(obj.as<String>().str()));
+  if (obj.is_type<IntArray>())
+    return Object(obj.type, copy_array(obj.as<IntArray>(),
+                                       std::pmr::get_default_resource()));
+  if (obj.is_type<FloatArray>())
+    return Object(obj.type, copy_array(obj.as<FloatArray>(),
+                                       std::pmr::get_default_resource()));
+  if (obj.is_type<Map>())
+    return Object(obj.type, Map(obj.as<Map>().table().copy(
+                                std::pmr::get_default_resource(),
+                                [&](const Object &elem) {
+                                  return export_object(elem);
+                                })));
+
+  ListData list;
+  list.reserve(obj.as<List>().size());
+  for (const auto &elem : obj.as<List>())
+    list.push_back(export_object(elem));
+  return Object(obj.type, List(std::move(list)));
+}
+
+Object VM::pop() { return export_object(pop<true>()); }
+
+void VM::reset() {
+  stack.clear();
+  frames.clear();
+  fp = 0;
+  pc = 0;
+  halt = false;
+  arena->reset();
+  gc_threshold = heap_config.threshold;
+}
+
+void VM::set_heap_config(HeapConfig config) {
+  heap_config = config;
+  gc_threshold = config.threshold;
+}
+
+// Copies a live arena value into `to`. Values already copied during this
+// collection are looked up in `forwarded` so sharing is preserved; the whole
+// buffer of a string or list is forwarded and each value keeps its window of
+// it. A slice much smaller than its buffer is copied alone instead, so the
+// rest of the buffer can die.
+Object VM::evacuate(const Object &obj, Arena *to,
+                    std::unordered_map<const void *, Object> &forwarded) {
+  if (!in_arena(obj))
+    return obj;
+
+  if (obj.is_type<String>()) {
+    const String &str = obj.as<String>();
+    if (str.size() * SLICE_PIN_RATIO < str.buffer().size())
+      return Object(obj.type, String(StringData(str.str(), to)));
+
+    auto it = forwarded.find(str.identity());
+    if (it == forwarded.end()) {
+      String copy(StringData(str.buffer(), to));
+      it = forwarded.emplace(str.identity(), Object(obj.type, copy)).first;
+    }
+    return Object(obj.type, it->second.as<String>().substr(
+                                str.buffer_offset(), str.size()));
+  }
+
+  if (obj.is_type<IntArray>()) {
+    auto it = forwarded.find(obj.as<IntArray>().identity());
+    if (it == forwarded.end())
+      it = forwarded
+               .emplace(obj.as<IntArray>().identity(),
+                        Object(obj.type, copy_array(obj.as<IntArray>(), to)))
+               .first;
+    return it->second;
+  }
+
+  if (obj.is_type<FloatArray>()) {
+    auto it = forwarded.find(obj.as<FloatArray>().identity());
+    if (it == forwarded.end())
+      it = forwarded
+               .emplace(obj.as<FloatArray>().identity(),
+                        Object(obj.type, copy_array(obj.as<FloatArray>(), to)))
+               .first;
+    return it->second;
+  }
+
+  if (obj.is_type<Map>()) {
+    auto it = forwarded.find(obj.as<Map>().identity());
+    if (it == forwarded.end()) {
+      Map copy(obj.as<Map>().table().copy(to, [&](const Object &elem) {
+        return evacuate(elem, to, forwarded);
+      }));
+      it = forwarded.emplace(obj.as<Map>().identity(), Object(obj.type, copy))
+               .first;
+    }
+    return it->second;
+  }
+
+  const List &list = obj.as<List>();
+  if (list.size() * SLICE_PIN_RATIO < list.buffer().size()) {
+    ListData elems(to);
+    elems.reserve(list.size());
+    for (const auto &elem : list)
+      elems.push_back(evacuate(elem, to, forwarded));
+    return Object(obj.type, List(std::move(elems)));
+  }
+
+  auto it = forwarded.find(list.identity());
+  if (it == forwarded.end()) {
+    ListData elems(to);
+    elems.reserve(list.buffer().size());
+    for (const auto &elem : list.buffer())
+      elems.push_back(evacuate(elem, to, forwarded));
+    it = forwarded
+             .emplace(list.identity(), Object(obj.type, List(std::move(elems))))
+             .first;
+  }
+  return Object(obj.type, it->second.as<List>().slice(list.buffer_offset(),
+                                                      list.size()));
+}
+
+// Copying collector over the two arenas. Everything reachable from the stack
+// is traced and compacted into the idle arena, then the old one is released
+// as a whole, so a pause costs time in live data and never touches garbage.
+// The constant pool never lives in an arena and needs no tracing.
+void VM::collect() {
+  auto start = std::chrono::steady_clock::now();
+
+  Arena *from = arena;
+  Arena *to = arena == &arenas[0] ? &arenas[1] : &arenas[0];
+  size_t before = from->stats().bytes_allocated;
+
+  {
+    std::unordered_map<const void *, Object> forwarded;
+    for (auto &obj : stack)
+      obj = evacuate(obj, to, forwarded);
+  }
+
+  arena = to;
+  from->reset();
+
+  size_t live = to->stats().bytes_allocated;
+  gc_threshold = 2 * live > heap_config.threshold ? 2 * live
+                                                  : heap_config.threshold;
+
+  std::chrono::duration<double, std::milli> pause =
+      std::chrono::steady_clock::now() - start;
+  heap.collections++;
+  heap.live_bytes = live;
+  heap.freed_bytes += before > live ? before - live : 0;
+  heap.heap_size =
+      arenas[0].stats().bytes_reserved + arenas[1].stats().bytes_reserved;
+  heap.last_pause_ms = pause.count();
+  heap.total_pause_ms += pause.count();
+  if (pause.count() > heap.max_pause_ms)
+    heap.max_pause_ms = pause.count();
+
+  if (heap_config.limit != 0 && live > heap_config.limit) {
+    throw std::runtime_error("Out of memory: " + std::to_string(live) +
+                             " live bytes exceed the heap limit of " +
+                             std::to_string(heap_config.limit) + ".");
+  }
+}
+
+template <bool checked> Object VM::pop() {
+  if (checked && stack.empty()) {
     throw std::runtime_error(
         "Stack underflow: Attempt to pop from an empty stack.");
   }
 
-  Object obj = stack.back();
+  Object obj = std::move(stack.back());
   stack.pop_back();
   return obj;
 }
 
-void VM::push(Object obj) { stack.push_back(obj); }
+void VM::push(Object obj) { stack.push_back(std::move(obj)); }
 
-uint32_t VM::btoi(uint32_t offset) {
-  if (offset + 3 >= bytecode.size()) {
+template <bool checked> uint32_t VM::btoi(uint32_t offset) {
+  if (checked && offset + 3 >= bytecode.size()) {
     throw std::runtime_error(
         "Offset out of bounds: Unable to read 4 bytes from bytecode.");
   }
@@ -30,27 +479,68 @@ uint32_t VM::btoi(uint32_t offset) {
 }
 
 void VM::run() {
-  while (!halt) {
+  try {
+    if (verified) {
+      while (!halt) {
+        if (arena->stats().bytes_allocated >= gc_threshold)
+          collect();
+        execute<false>();
+      }
+      return;
+    }
 
-    // NOTE: Debug code
-    // print_state();
-    // ENDNOTE
+    while (!halt) {
 
-    try {
-      execute();
-    } catch (const std::exception &ex) {
-      cerr << ex.what() << endl;
-      exit(1);
+      // NOTE: Debug code
+      // print_state();
+      // ENDNOTE
+
+      if (pc >= bytecode.size()) {
+        throw std::runtime_error(
+            "Program counter out of bounds: execution ran past the end of "
+            "the bytecode.");
+      }
+      if (arena->stats().bytes_allocated >= gc_threshold)
+        collect();
+      execute<true>();
     }
+  } catch (const std::exception &ex) {
+    cerr << ex.what() << endl;
+    exit(1);
+  }
+}
+
+template <bool checked, typename T, typename F> bool VM::typed_op(F f) {
+  if (checked && stack.size() < 2)
+    return false;
+
+  Object &a = stack[stack.size() - 2];
+  T *a_val = std::get_if<T>(&a.value);
+  const T *b_val = std::get_if<T>(&stack.back().value);
+  if (a_val == nullptr || b_val == nullptr)
+    return false;
+
+  auto result = f(*a_val, *b_val);
+  if constexpr (std::is_same_v<decltype(result), bool>) {
+    a.type = Type::BOOLEAN;
+    a.value.template emplace<bool>(result);
+  } else {
+    *a_val = result;
   }
+  stack.pop_back();
+  pc++;
+  return true;
 }
 
-void VM::execute() {
+template <bool checked> void VM::execute() {
   uint8_t byte = bytecode[pc];
+  // A typed instruction whose operands are not of its type comes back here
+  // as its generic instruction.
+dispatch:
   switch (byte) {
   case ADD: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if (a.is_type<int>() && b.is_type<int>()) {
       int a_val = a.as<int>();
@@ -75,11 +565,13 @@ void VM::execute() {
       }
 
       push(Object(Type::FLOAT, a_val + b_val));
-    } else if (a.is_type<string>() && b.is_type<string>()) {
-      string a_val = a.as<string>();
-      string b_val = b.as<string>();
+    } else if (a.is_type<String>() && b.is_type<String>()) {
+      const String &a_val = a.as<String>();
+      string_view b_val = b.as<String>().str();
 
-      push(Object(Type::STRING, a_val + b_val));
+      push(Object(Type::STRING, String::concat(a_val, b_val, arena)));
+    } else if (is_array(a) || is_array(b)) {
+      push(array_op(ADD, a, b));
     } else {
       throw std::runtime_error(
           "Type error in ADD operation: unsupported operand types '" +
@@ -90,8 +582,8 @@ void VM::execute() {
     break;
   }
   case SUB: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if (a.is_type<int>() && b.is_type<int>()) {
       int a_val = a.as<int>();
@@ -116,6 +608,8 @@ void VM::execute() {
       }
 
       push(Object(Type::FLOAT, a_val - b_val));
+    } else if (is_array(a) || is_array(b)) {
+      push(array_op(SUB, a, b));
     } else {
       throw std::runtime_error(
           "Type error in SUB operation: unsupported operand types '" +
@@ -126,8 +620,8 @@ void VM::execute() {
     break;
   }
   case MUL: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if (a.is_type<int>() && b.is_type<int>()) {
       int a_val = a.as<int>();
@@ -152,16 +646,19 @@ void VM::execute() {
       }
 
       push(Object(Type::FLOAT, a_val * b_val));
-    } else if (a.is_type<string>() && b.is_type<int>()) {
-      string a_val = a.as<string>();
+    } else if (a.is_type<String>() && b.is_type<int>()) {
+      string_view a_val = a.as<String>().str();
       int b_val = b.as<int>();
 
-      string repeated;
+      StringData repeated(arena);
+      repeated.reserve(a_val.size() * (b_val > 0 ? b_val : 0));
       for (int i = 0; i < b_val; i++) {
-        repeated += a_val;
+        repeated.append(a_val);
       }
 
-      push(Object(Type::STRING, repeated));
+      push(Object(Type::STRING, String(std::move(repeated))));
+    } else if (is_array(a) || is_array(b)) {
+      push(array_op(MUL, a, b));
     } else {
       throw std::runtime_error(
           "Type error in MUL operation: unsupported operand types '" +
@@ -172,8 +669,8 @@ void VM::execute() {
     break;
   }
   case DIV: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if ((a.is_type<int>() || a.is_type<double>()) &&
         (b.is_type<int>() || b.is_type<double>())) {
@@ -193,6 +690,8 @@ void VM::execute() {
       }
 
       push(Object(Type::FLOAT, a_val / b_val));
+    } else if (is_array(a) || is_array(b)) {
+      push(array_op(DIV, a, b));
     } else {
       throw std::runtime_error(
           "Type error in DIV operation: unsupported operand types '" +
@@ -203,8 +702,8 @@ void VM::execute() {
     break;
   }
   case IDIV: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if ((a.is_type<int>() || a.is_type<double>()) &&
         (b.is_type<int>() || b.is_type<double>())) {
@@ -233,9 +732,29 @@ void VM::execute() {
     pc++;
     break;
   }
+  case NEG: {
+    Object a = pop<checked>();
+
+    if (a.is_type<int>()) {
+      uint32_t a_val = a.as<int>();
+
+      push(Object(Type::INTEGER, static_cast<int>(0u - a_val)));
+    } else if (a.is_type<double>()) {
+      push(Object(Type::FLOAT, -a.as<double>()));
+    } else if (is_array(a)) {
+      push(array_op(MUL, a, Object(Type::INTEGER, -1)));
+    } else {
+      throw std::runtime_error(
+          "Type error in NEG operation: unsupported operand types -'" +
+          type_to_string(a.type) + "'.");
+    }
+
+    pc++;
+    break;
+  }
   case PUSH: {
-    uint32_t obj = btoi(pc + 1);
-    if (obj >= const_pool.size()) {
+    uint32_t obj = btoi<checked>(pc + 1);
+    if (checked && obj >= const_pool.size()) {
       throw std::runtime_error(
           "PUSH operation error: constant pool index " + std::to_string(obj) +
           " is out of bounds (size: " + std::to_string(const_pool.size()) +
@@ -247,7 +766,7 @@ void VM::execute() {
     break;
   }
   case POP: {
-    pop();
+    pop<checked>();
     pc++;
     break;
   }
@@ -257,14 +776,16 @@ void VM::execute() {
     break;
   }
   case EQ: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
-    if (a.type != b.type) {
+    if (is_array(a) || is_array(b)) {
+      push(array_op(EQ, a, b));
+    } else if (a.type != b.type) {
       push(Object(Type::BOOLEAN, false));
-    } else if (a.is_type<string>()) {
-      string a_val = a.as<string>();
-      string b_val = b.as<string>();
+    } else if (a.is_type<String>()) {
+      const String &a_val = a.as<String>();
+      const String &b_val = b.as<String>();
 
       push(Object(Type::BOOLEAN, a_val == b_val));
     } else if (a.is_type<int>()) {
@@ -278,8 +799,8 @@ void VM::execute() {
 
       push(Object(Type::BOOLEAN, a_val == b_val));
     } else if (a.is_type<bool>()) {
-      bool a_val = a.as<double>();
-      bool b_val = b.as<double>();
+      bool a_val = a.as<bool>();
+      bool b_val = b.as<bool>();
 
       push(Object(Type::BOOLEAN, a_val == b_val));
     } else {
@@ -292,14 +813,16 @@ void VM::execute() {
     break;
   }
   case NEQ: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
-    if (a.type != b.type) {
+    if (is_array(a) || is_array(b)) {
+      push(array_op(NEQ, a, b));
+    } else if (a.type != b.type) {
       push(Object(Type::BOOLEAN, true));
-    } else if (a.is_type<string>()) {
-      string a_val = a.as<string>();
-      string b_val = b.as<string>();
+    } else if (a.is_type<String>()) {
+      const String &a_val = a.as<String>();
+      const String &b_val = b.as<String>();
 
       push(Object(Type::BOOLEAN, a_val != b_val));
     } else if (a.is_type<int>()) {
@@ -327,8 +850,8 @@ void VM::execute() {
     break;
   }
   case LT: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if ((a.is_type<int>() || a.is_type<double>()) &&
         (b.is_type<int>() || b.is_type<double>())) {
@@ -348,6 +871,8 @@ void VM::execute() {
       }
 
       push(Object(Type::BOOLEAN, a_val < b_val));
+    } else if (is_array(a) || is_array(b)) {
+      push(array_op(LT, a, b));
     } else {
       throw std::runtime_error(
           "Type error in LT operation: unsupported operand types '" +
@@ -358,8 +883,8 @@ void VM::execute() {
     break;
   }
   case GT: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if ((a.is_type<int>() || a.is_type<double>()) &&
         (b.is_type<int>() || b.is_type<double>())) {
@@ -379,6 +904,8 @@ void VM::execute() {
       }
 
       push(Object(Type::BOOLEAN, a_val > b_val));
+    } else if (is_array(a) || is_array(b)) {
+      push(array_op(GT, a, b));
     } else {
       throw std::runtime_error(
           "Type error in GT operation: unsupported operand types '" +
@@ -389,8 +916,8 @@ void VM::execute() {
     break;
   }
   case LTE: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if ((a.is_type<int>() || a.is_type<double>()) &&
         (b.is_type<int>() || b.is_type<double>())) {
@@ -410,6 +937,8 @@ void VM::execute() {
       }
 
       push(Object(Type::BOOLEAN, a_val <= b_val));
+    } else if (is_array(a) || is_array(b)) {
+      push(array_op(LTE, a, b));
     } else {
       throw std::runtime_error(
           "Type error in LTE operation: unsupported operand types '" +
@@ -420,8 +949,8 @@ void VM::execute() {
     break;
   }
   case GTE: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if ((a.is_type<int>() || a.is_type<double>()) &&
         (b.is_type<int>() || b.is_type<double>())) {
@@ -441,6 +970,8 @@ void VM::execute() {
       }
 
       push(Object(Type::BOOLEAN, a_val >= b_val));
+    } else if (is_array(a) || is_array(b)) {
+      push(array_op(GTE, a, b));
     } else {
       throw std::runtime_error(
           "Type error in GTE operation: unsupported operand types '" +
@@ -451,8 +982,8 @@ void VM::execute() {
     break;
   }
   case LOG_AND: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if (a.is_type<bool>() && b.is_type<bool>()) {
       bool a_val = a.as<bool>();
@@ -469,8 +1000,8 @@ void VM::execute() {
     break;
   }
   case LOG_OR: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if (a.is_type<bool>() && b.is_type<bool>()) {
       bool a_val = a.as<bool>();
@@ -487,7 +1018,7 @@ void VM::execute() {
     break;
   }
   case LOG_NOT: {
-    Object a = pop();
+    Object a = pop<checked>();
 
     if (a.is_type<bool>()) {
       bool a_val = a.as<bool>();
@@ -503,8 +1034,8 @@ void VM::execute() {
     break;
   }
   case BIT_AND: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if (a.is_type<int>() && b.is_type<int>()) {
       int a_val = a.as<int>();
@@ -521,8 +1052,8 @@ void VM::execute() {
     break;
   }
   case BIT_OR: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if (a.is_type<int>() && b.is_type<int>()) {
       int a_val = a.as<int>();
@@ -539,7 +1070,7 @@ void VM::execute() {
     break;
   }
   case BIT_NOT: {
-    Object a = pop();
+    Object a = pop<checked>();
 
     if (a.is_type<int>()) {
       int a_val = a.as<int>();
@@ -555,8 +1086,8 @@ void VM::execute() {
     break;
   }
   case XOR: {
-    Object b = pop();
-    Object a = pop();
+    Object b = pop<checked>();
+    Object a = pop<checked>();
 
     if (a.is_type<int>() && b.is_type<int>()) {
       int a_val = a.as<int>();
@@ -572,6 +1103,417 @@ void VM::execute() {
     pc++;
     break;
   }
+  case SLICE: {
+    Object end = pop<checked>();
+    Object start = pop<checked>();
+    Object seq = pop<checked>();
+
+    if ((seq.is_type<String>() || seq.is_type<List>()) &&
+        start.is_type<int>() && end.is_type<int>()) {
+      int start_val = start.as<int>();
+      int end_val = end.as<int>();
+      size_t size = seq.is_type<String>() ? seq.as<String>().size()
+                                          : seq.as<List>().size();
+
+      if (start_val < 0 || start_val > end_val ||
+          static_cast<size_t>(end_val) > size) {
+        throw std::runtime_error(
+            "SLICE operation error: range [" + std::to_string(start_val) +
+            ", " + std::to_string(end_val) + ") is out of bounds (size: " +
+            std::to_string(size) + ").");
+      }
+
+      if (seq.is_type<String>()) {
+        push(Object(Type::STRING,
+                    seq.as<String>().substr(start_val, end_val - start_val)));
+      } else {
+        push(Object(Type::LIST,
+                    seq.as<List>().slice(start_val, end_val - start_val)));
+      }
+    } else {
+      throw std::runtime_error(
+          "Type error in SLICE operation: unsupported operand types '" +
+          type_to_string(seq.type) + "'[" + type_to_string(start.type) +
+          ":" + type_to_string(end.type) + "].");
+    }
+
+    pc++;
+    break;
+  }
+  case INDEX: {
+    Object index = pop<checked>();
+    Object seq = pop<checked>();
+    size_t size;
+
+    if (sequence_size(seq, size) && index.is_type<int>()) {
+      int index_val = index.as<int>();
+
+      if (index_val < 0 || static_cast<size_t>(index_val) >= size) {
+        throw std::runtime_error(
+            "INDEX operation error: index " + std::to_string(index_val) +
+            " is out of bounds (size: " + std::to_string(size) + ").");
+      }
+
+      if (seq.is_type<String>()) {
+        push(Object(Type::STRING, seq.as<String>().substr(index_val, 1)));
+      } else if (seq.is_type<List>()) {
+        push(seq.as<List>()[index_val]);
+      } else if (seq.is_type<FloatArray>()) {
+        push(Object(Type::FLOAT, seq.as<FloatArray>()[index_val]));
+      } else {
+        int64_t elem = seq.as<IntArray>()[index_val];
+        if (elem < INT32_MIN || elem > INT32_MAX) {
+          throw std::runtime_error(
+              "INDEX operation error: element " + std::to_string(elem) +
+              " does not fit in an INTEGER.");
+        }
+        push(Object(Type::INTEGER, static_cast<int>(elem)));
+      }
+    } else {
+      throw std::runtime_error(
+          "Type error in INDEX operation: unsupported operand types '" +
+          type_to_string(seq.type) + "'[" + type_to_string(index.type) +
+          "].");
+    }
+
+    pc++;
+    break;
+  }
+  case LEN: {
+    Object seq = pop<checked>();
+    size_t size;
+
+    if (sequence_size(seq, size)) {
+      push(Object(Type::INTEGER, static_cast<int>(size)));
+    } else if (seq.is_type<Map>()) {
+      push(Object(Type::INTEGER, static_cast<int>(seq.as<Map>().size())));
+    } else {
+      throw std::runtime_error(
+          "Type error in LEN operation: unsupported operand type '" +
+          type_to_string(seq.type) + "'.");
+    }
+
+    pc++;
+    break;
+  }
+  case APPEND: {
+    Object value = pop<checked>();
+    Object seq = pop<checked>();
+
+    // Appending to a value nothing else references grows it in place.
+    if (seq.is_type<List>()) {
+      seq.as<List>().mutate(arena).push_back(std::move(value));
+    } else if (seq.is_type<IntArray>() && value.is_type<int>()) {
+      seq.as<IntArray>().mutate(arena).push_back(value.as<int>());
+    } else if (seq.is_type<FloatArray>() && value.is_type<double>()) {
+      seq.as<FloatArray>().mutate(arena).push_back(value.as<double>());
+    } else if (seq.is_type<FloatArray>() && value.is_type<int>()) {
+      seq.as<FloatArray>().mutate(arena).push_back(value.as<int>());
+    } else {
+      throw std::runtime_error(
+          "Type error in APPEND operation: cannot append '" +
+          type_to_string(value.type) + "' to '" + type_to_string(seq.type) +
+          "'.");
+    }
+    push(std::move(seq));
+
+    pc++;
+    break;
+  }
+  case SUM:
+  case MIN:
+  case MAX:
+  case COUNT_IF: {
+    Object seq = pop<checked>();
+    Numbers numbers;
+    vector<int64_t> ints;
+    vector<double> floats;
+
+    if (!numbers_of(seq, numbers, ints, floats)) {
+      throw std::runtime_error("Type error in " + inst_to_string(byte) +
+                               " operation: unsupported operand type '" +
+                               type_to_string(seq.type) + "'.");
+    }
+    if ((byte == MIN || byte == MAX) && numbers.size == 0) {
+      throw std::runtime_error(inst_to_string(byte) +
+                               " operation error: empty sequence.");
+    }
+    push(reduce(byte, numbers));
+
+    pc++;
+    break;
+  }
+  case DOT: {
+    Object b = pop<checked>();
+    Object a = pop<checked>();
+    Numbers x, y;
+    vector<int64_t> a_ints, b_ints;
+    vector<double> a_floats, b_floats;
+
+    if (!numbers_of(a, x, a_ints, a_floats) ||
+        !numbers_of(b, y, b_ints, b_floats)) {
+      throw std::runtime_error(
+          "Type error in DOT operation: unsupported operand types '" +
+          type_to_string(a.type) + "' and '" + type_to_string(b.type) + "'.");
+    }
+    if (x.size != y.size) {
+      throw std::runtime_error("DOT operation error: sizes " +
+                               std::to_string(x.size) + " and " +
+                               std::to_string(y.size) + " do not match.");
+    }
+    if (!x.is_float && y.is_float)
+      numbers_of(a, x, a_ints, a_floats, true);
+    else if (x.is_float && !y.is_float)
+      numbers_of(b, y, b_ints, b_floats, true);
+
+    if (x.is_float)
+      push(Object(Type::FLOAT, simd_dot(x.floats, y.floats, x.size)));
+    else
+      push(integer_result(DOT, simd_dot(x.ints, y.ints, x.size)));
+
+    pc++;
+    break;
+  }
+  case SORT: {
+    Object seq = pop<checked>();
+
+    if (seq.is_type<IntArray>()) {
+      const IntArray &array = seq.as<IntArray>();
+      IntArray::Data sorted(array.begin(), array.end(), arena);
+      radix_sort(sorted.data(), sorted.size());
+      push(Object(Type::INT_ARRAY, IntArray(std::move(sorted))));
+    } else if (seq.is_type<FloatArray>()) {
+      const FloatArray &array = seq.as<FloatArray>();
+      FloatArray::Data sorted(array.begin(), array.end(), arena);
+      // Moving NaNs to the end first lets the sort use a plain comparison.
+      double *numbers_end =
+          std::partition(sorted.data(), sorted.data() + sorted.size(),
+                         [](double x) { return !std::isnan(x); });
+      parallel_sort(sorted.data(), numbers_end - sorted.data(),
+                    std::less<double>());
+      push(Object(Type::FLOAT_ARRAY, FloatArray(std::move(sorted))));
+    } else if (seq.is_type<List>()) {
+      push(Object(Type::LIST, List(sorted_list(seq.as<List>(), arena))));
+    } else {
+      throw std::runtime_error(
+          "Type error in SORT operation: unsupported operand type '" +
+          type_to_string(seq.type) + "'.");
+    }
+
+    pc++;
+    break;
+  }
+  case JMP: {
+    pc = btoi<checked>(pc + 1);
+    break;
+  }
+  case JMP_IF_FALSE: {
+    Object condition = pop<checked>();
+
+    if (!condition.is_type<bool>()) {
+      throw std::runtime_error("Type error in JMP_IF_FALSE operation: "
+                               "condition of type '" +
+                               type_to_string(condition.type) +
+                               "' is not a BOOLEAN.");
+    }
+    pc = condition.as<bool>() ? pc + 5 : btoi<checked>(pc + 1);
+    break;
+  }
+  case LOAD:
+  case STORE: {
+    uint32_t slot = fp + btoi<checked>(pc + 1);
+    if (checked && slot >= stack.size() - (byte == STORE)) {
+      throw std::runtime_error(inst_to_string(byte) +
+                               " operation error: local " +
+                               std::to_string(slot - fp) +
+                               " does not exist.");
+    }
+
+    if (byte == LOAD) {
+      Object value = stack[slot];
+      push(std::move(value));
+    } else {
+      stack[slot] = pop<checked>();
+    }
+
+    pc += 5;
+    break;
+  }
+  case CALL: {
+    uint32_t target = btoi<checked>(pc + 1);
+    if (checked && pc + 5 >= bytecode.size()) {
+      throw std::runtime_error(
+          "Offset out of bounds: CALL is missing its argument count.");
+    }
+    uint8_t argc = bytecode[pc + 5];
+    if (checked && argc > stack.size() - fp) {
+      throw std::runtime_error("CALL operation error: " +
+                               std::to_string(argc) +
+                               " arguments expected on the stack.");
+    }
+    if (frames.size() >= MAX_CALL_DEPTH) {
+      throw std::runtime_error("Stack overflow: calls are nested deeper than " +
+                               std::to_string(MAX_CALL_DEPTH) + ".");
+    }
+
+    frames.push_back({pc + 6, fp});
+    fp = stack.size() - argc;
+    pc = target;
+    break;
+  }
+  case RET: {
+    if (checked && frames.empty()) {
+      throw std::runtime_error(
+          "RET operation error: there is no function to return from.");
+    }
+    Object value = pop<checked>();
+    if (checked && stack.size() < fp) {
+      throw std::runtime_error(
+          "RET operation error: the function popped its caller's values.");
+    }
+
+    // Arguments, locals and whatever else the function left are dropped.
+    stack.resize(fp);
+    push(std::move(value));
+    pc = frames.back().return_pc;
+    fp = frames.back().fp;
+    frames.pop_back();
+    break;
+  }
+  case GET:
+  case CONTAINS:
+  case DELETE: {
+    Object key = pop<checked>();
+    Object map = pop<checked>();
+    check_map_operands(byte, map, key);
+
+    if (byte == GET) {
+      // A missing key gives null rather than an error, so programs can
+      // look up and test in one instruction.
+      const Object *value = map.as<Map>().find(key);
+      push(value ? *value : Object());
+    } else if (byte == CONTAINS) {
+      push(Object(Type::BOOLEAN, map.as<Map>().find(key) != nullptr));
+    } else {
+      if (map.as<Map>().find(key))
+        map.as<Map>().mutate(arena).erase(key);
+      push(std::move(map));
+    }
+
+    pc++;
+    break;
+  }
+  case SET: {
+    Object value = pop<checked>();
+    Object key = pop<checked>();
+    Object map = pop<checked>();
+    check_map_operands(SET, map, key);
+
+    // Like APPEND, a map nothing else references is updated in place.
+    map.as<Map>().mutate(arena).set(std::move(key), std::move(value));
+    push(std::move(map));
+
+    pc++;
+    break;
+  }
+  case ADD_INT:
+    if (typed_op<checked, int>(std::plus<>()))
+      break;
+    byte = ADD;
+    goto dispatch;
+  case SUB_INT:
+    if (typed_op<checked, int>(std::minus<>()))
+      break;
+    byte = SUB;
+    goto dispatch;
+  case MUL_INT:
+    if (typed_op<checked, int>(std::multiplies<>()))
+      break;
+    byte = MUL;
+    goto dispatch;
+  case EQ_INT:
+    if (typed_op<checked, int>(std::equal_to<>()))
+      break;
+    byte = EQ;
+    goto dispatch;
+  case NEQ_INT:
+    if (typed_op<checked, int>(std::not_equal_to<>()))
+      break;
+    byte = NEQ;
+    goto dispatch;
+  case LT_INT:
+    if (typed_op<checked, int>(std::less<>()))
+      break;
+    byte = LT;
+    goto dispatch;
+  case GT_INT:
+    if (typed_op<checked, int>(std::greater<>()))
+      break;
+    byte = GT;
+    goto dispatch;
+  case LTE_INT:
+    if (typed_op<checked, int>(std::less_equal<>()))
+      break;
+    byte = LTE;
+    goto dispatch;
+  case GTE_INT:
+    if (typed_op<checked, int>(std::greater_equal<>()))
+      break;
+    byte = GTE;
+    goto dispatch;
+  case ADD_FLOAT:
+    if (typed_op<checked, double>(std::plus<>()))
+      break;
+    byte = ADD;
+    goto dispatch;
+  case SUB_FLOAT:
+    if (typed_op<checked, double>(std::minus<>()))
+      break;
+    byte = SUB;
+    goto dispatch;
+  case MUL_FLOAT:
+    if (typed_op<checked, double>(std::multiplies<>()))
+      break;
+    byte = MUL;
+    goto dispatch;
+  case DIV_FLOAT:
+    if (typed_op<checked, double>(std::divides<>()))
+      break;
+    byte = DIV;
+    goto dispatch;
+  case EQ_FLOAT:
+    if (typed_op<checked, double>(std::equal_to<>()))
+      break;
+    byte = EQ;
+    goto dispatch;
+  case NEQ_FLOAT:
+    if (typed_op<checked, double>(std::not_equal_to<>()))
+      break;
+    byte = NEQ;
+    goto dispatch;
+  case LT_FLOAT:
+    if (typed_op<checked, double>(std::less<>()))
+      break;
+    byte = LT;
+    goto dispatch;
+  case GT_FLOAT:
+    if (typed_op<checked, double>(std::greater<>()))
+      break;
+    byte = GT;
+    goto dispatch;
+  case LTE_FLOAT:
+    if (typed_op<checked, double>(std::less_equal<>()))
+      break;
+    byte = LTE;
+    goto dispatch;
+  case GTE_FLOAT:
+    if (typed_op<checked, double>(std::greater_equal<>()))
+      break;
+    byte = GTE;
+    goto dispatch;
+  default:
+    throw std::runtime_error("Unknown instruction " + std::to_string(byte) +
+                             " at " + std::to_string(pc) + ".");
   }
 }
 
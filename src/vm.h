@@ -1,12 +1,36 @@
 #ifndef VM_H
 #define VM_H
 
+#include "arena.h"
 #include "object.h"
 #include <cstdint>
+#include <unordered_map>
 
 #define MAJOR 0
 #define MINOR 1
 
+#define GC_THRESHOLD (1024 * 1024)
+// Calls nested deeper than this are a stack overflow.
+#define MAX_CALL_DEPTH 10000
+// A slice this many times smaller than the buffer it shares is copied on its
+// own by the collector instead of keeping the whole buffer alive.
+#define SLICE_PIN_RATIO 4
+
+struct HeapConfig {
+  size_t limit = 0; // live bytes allowed after a collection, 0 is unlimited
+  size_t threshold = GC_THRESHOLD; // arena bytes that trigger the first GC
+};
+
+struct HeapStats {
+  size_t collections = 0;
+  size_t heap_size = 0;  // bytes reserved by both semispaces
+  size_t live_bytes = 0; // bytes surviving the last collection
+  size_t freed_bytes = 0;
+  double last_pause_ms = 0;
+  double max_pause_ms = 0;
+  double total_pause_ms = 0;
+};
+
 using std::vector, std::cerr, std::string, std::endl, std::cout;
 
 class VM {
@@ -15,17 +39,56 @@ public:
   void print_state();
   Object pop();
   void run();
+  void reset();
+  void collect();
+  bool is_verified() const { return verified; }
+  void set_heap_config(HeapConfig config);
+  const ArenaStats &arena_stats() const { return arena->stats(); }
+  const HeapStats &heap_stats() const { return heap; }
 
 private:
   uint32_t pc = 0;
   bool halt = false;
+  bool verified = false;
+  // Strings and lists created while running live in the active arena, which
+  // must outlive the stack that points into it. The other arena is the
+  // to-space of the copying collector. Lists outside the arena never hold
+  // arena values: the VM only builds or mutates lists inside it.
+  Arena arenas[2];
+  Arena *arena = &arenas[0];
+  HeapConfig heap_config;
+  HeapStats heap;
+  size_t gc_threshold = GC_THRESHOLD;
   vector<Object> stack;
+  // A function's arguments and locals are the slots of the stack from `fp`
+  // on, so the collector finds them with the temporaries. CALL saves the
+  // caller's frame here and RET restores it.
+  struct Frame {
+    uint32_t return_pc;
+    uint32_t fp;
+  };
+  vector<Frame> frames;
+  uint32_t fp = 0;
+  StringTable strings;
   const vector<uint8_t> bytecode;
   const vector<Object> const_pool;
 
+  // With `checked` off the interpreter trusts the verifier and skips stack,
+  // operand and constant pool bounds checks.
+  template <bool checked> Object pop();
+  template <bool checked> uint32_t btoi(uint32_t offset);
+  template <bool checked> void execute();
+  // The fast path of a typed instruction: replaces the two operands on top
+  // of the stack with f(a, b) when both hold a T, otherwise leaves them for
+  // the generic instruction.
+  template <bool checked, typename T, typename F> bool typed_op(F f);
+
   void push(Object obj);
-  uint32_t btoi(uint32_t offset);
-  void execute();
+  bool in_arena(const Object &obj) const;
+  Object export_object(const Object &obj) const;
+  Object array_op(uint8_t op, const Object &a, const Object &b);
+  Object evacuate(const Object &obj, Arena *to,
+                  std::unordered_map<const void *, Object> &forwarded);
 };
 
 #endif // VM_H